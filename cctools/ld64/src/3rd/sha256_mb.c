@@ -0,0 +1,390 @@
+/*
+ * hash several independent messages (code signing pages) at once.
+ *
+ * x86 cpus with the sha extensions hash each message with the sha-ni
+ * instructions, cpus with avx2 hash up to eight messages of the same
+ * length side by side, one message per 32-bit lane.  Everything else,
+ * and every message that does not fit those kernels, goes through the
+ * scalar SHA256_Init/Update/Final in sha256.c.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha256_mb.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define SHA256_MB_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SHA256_MB_X86 0
+#endif
+
+enum { IMPL_SCALAR, IMPL_SHA_NI, IMPL_AVX2 };
+
+static int impl = IMPL_SCALAR;
+/* bit per IMPL_* the cpu can run, so the benchmark can try each one */
+static unsigned impl_usable = 1u << IMPL_SCALAR;
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+
+static void
+select_impl(void)
+{
+#if SHA256_MB_X86
+	unsigned int eax, ebx, ecx, edx;
+	int ssse3 = 0, sse41 = 0, ymm = 0;
+
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+		ssse3 = (ecx >> 9) & 1;
+		sse41 = (ecx >> 19) & 1;
+		/* avx needs the os to save the ymm registers (osxsave + xcr0) */
+		if (((ecx >> 27) & 1) && ((ecx >> 28) & 1)) {
+			unsigned int xcr0lo, xcr0hi;
+			__asm__ __volatile__("xgetbv" : "=a"(xcr0lo), "=d"(xcr0hi) : "c"(0));
+			ymm = (xcr0lo & 6) == 6;
+		}
+	}
+	if (__get_cpuid_max(0, NULL) >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if (ssse3 && sse41 && ((ebx >> 29) & 1))
+			impl_usable |= 1u << IMPL_SHA_NI;
+		if (ymm && ((ebx >> 5) & 1))
+			impl_usable |= 1u << IMPL_AVX2;
+	}
+#endif
+	if (impl_usable & (1u << IMPL_SHA_NI))
+		impl = IMPL_SHA_NI;
+	else if (impl_usable & (1u << IMPL_AVX2))
+		impl = IMPL_AVX2;
+	else
+		impl = IMPL_SCALAR;
+}
+
+static void
+scalar_hash(const uint8_t *m, size_t len, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	SHA256_CTX ctx;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, m, len);
+	SHA256_Final(&ctx, digest);
+}
+
+#if SHA256_MB_X86
+
+static const uint32_t K[64] = {
+0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t H0[8] = {
+0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* the padded last one or two blocks of a message, returns the number of blocks */
+static unsigned
+tail_blocks(const uint8_t *m, size_t len, uint8_t tail[128])
+{
+	size_t full = len & ~(size_t)63;
+	unsigned r = (unsigned)(len - full);
+	unsigned n = (r < 56) ? 1 : 2;
+	uint64_t bits = (uint64_t)len * 8;
+	int i;
+
+	memset(tail, 0, 128);
+	memcpy(tail, m + full, r);
+	tail[r] = 0x80;
+	for (i = 0; i < 8; i++)
+		tail[n*64 - 1 - i] = (uint8_t)(bits >> (8*i));
+	return n;
+}
+
+static void
+put_digest(const uint32_t h[8], uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		digest[4*i] = h[i] >> 24;
+		digest[4*i+1] = h[i] >> 16;
+		digest[4*i+2] = h[i] >> 8;
+		digest[4*i+3] = h[i];
+	}
+}
+
+/* sha-ni: one message, four rounds per pair of sha256rnds2 */
+
+__attribute__((target("sha,sse4.1,ssse3"))) static void
+sha_ni_blocks(uint32_t h[8], const uint8_t *m, size_t blocks)
+{
+	const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i s0, s1, t;
+
+	/* the instructions keep the state as ABEF and CDGH */
+	t = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[0]), 0xB1);
+	s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&h[4]), 0x1B);
+	s0 = _mm_alignr_epi8(t, s1, 8);
+	s1 = _mm_blend_epi16(s1, t, 0xF0);
+
+	for (; blocks; blocks--, m += 64) {
+		__m128i save0 = s0, save1 = s1, w[16], x;
+		int i;
+
+		for (i = 0; i < 16; i++) {
+			if (i < 4)
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(m + 16*i)), mask);
+			else
+				w[i] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(w[i-4], w[i-3]),
+				                                          _mm_alignr_epi8(w[i-1], w[i-2], 4)), w[i-1]);
+			x = _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i *)&K[4*i]));
+			s1 = _mm_sha256rnds2_epu32(s1, s0, x);
+			s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(x, 0x0E));
+		}
+		s0 = _mm_add_epi32(s0, save0);
+		s1 = _mm_add_epi32(s1, save1);
+	}
+
+	t = _mm_shuffle_epi32(s0, 0x1B);
+	s1 = _mm_shuffle_epi32(s1, 0xB1);
+	s0 = _mm_blend_epi16(t, s1, 0xF0);
+	s1 = _mm_alignr_epi8(s1, t, 8);
+	_mm_storeu_si128((__m128i *)&h[0], s0);
+	_mm_storeu_si128((__m128i *)&h[4], s1);
+}
+
+static void
+sha_ni_hash(const uint8_t *m, size_t len, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+	uint32_t h[8];
+	uint8_t tail[128];
+	unsigned n;
+
+	memcpy(h, H0, sizeof(h));
+	sha_ni_blocks(h, m, len / 64);
+	n = tail_blocks(m, len, tail);
+	sha_ni_blocks(h, tail, n);
+	put_digest(h, digest);
+}
+
+/* avx2: eight messages, lane i of every register belongs to message i */
+
+#define ROR8(x, n)    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32-(n)))
+#define CH8(x,y,z)    _mm256_xor_si256(z, _mm256_and_si256(x, _mm256_xor_si256(y, z)))
+#define MAJ8(x,y,z)   _mm256_or_si256(_mm256_and_si256(x, y), _mm256_and_si256(z, _mm256_or_si256(x, y)))
+#define S08(x)        _mm256_xor_si256(ROR8(x,2), _mm256_xor_si256(ROR8(x,13), ROR8(x,22)))
+#define S18(x)        _mm256_xor_si256(ROR8(x,6), _mm256_xor_si256(ROR8(x,11), ROR8(x,25)))
+#define R08(x)        _mm256_xor_si256(ROR8(x,7), _mm256_xor_si256(ROR8(x,18), _mm256_srli_epi32(x,3)))
+#define R18(x)        _mm256_xor_si256(ROR8(x,17), _mm256_xor_si256(ROR8(x,19), _mm256_srli_epi32(x,10)))
+
+__attribute__((target("avx2"))) static void
+avx2_blocks(uint32_t state[8][8], const uint8_t *const m[8], size_t blocks)
+{
+	const __m256i bswap = _mm256_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+	                                      12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+	__m256i h[8];
+	size_t b;
+	int i, lane;
+
+	for (i = 0; i < 8; i++)
+		h[i] = _mm256_loadu_si256((const __m256i *)state[i]);
+
+	for (b = 0; b < blocks; b++) {
+		__m256i w[16], a, bb, c, d, e, f, g, hh, t1, t2;
+
+		for (i = 0; i < 16; i++) {
+			uint32_t v[8];
+			for (lane = 0; lane < 8; lane++)
+				memcpy(&v[lane], m[lane] + 64*b + 4*i, 4);
+			w[i] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)v), bswap);
+		}
+		a = h[0]; bb = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+		for (i = 0; i < 64; i++) {
+			if (i >= 16)
+				w[i&15] = _mm256_add_epi32(_mm256_add_epi32(R18(w[(i-2)&15]), w[(i-7)&15]),
+				                           _mm256_add_epi32(R08(w[(i-15)&15]), w[i&15]));
+			t1 = _mm256_add_epi32(_mm256_add_epi32(hh, S18(e)),
+			                      _mm256_add_epi32(CH8(e,f,g), _mm256_add_epi32(_mm256_set1_epi32((int)K[i]), w[i&15])));
+			t2 = _mm256_add_epi32(S08(a), MAJ8(a,bb,c));
+			hh = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = bb;
+			bb = a;
+			a = _mm256_add_epi32(t1, t2);
+		}
+		h[0] = _mm256_add_epi32(h[0], a);
+		h[1] = _mm256_add_epi32(h[1], bb);
+		h[2] = _mm256_add_epi32(h[2], c);
+		h[3] = _mm256_add_epi32(h[3], d);
+		h[4] = _mm256_add_epi32(h[4], e);
+		h[5] = _mm256_add_epi32(h[5], f);
+		h[6] = _mm256_add_epi32(h[6], g);
+		h[7] = _mm256_add_epi32(h[7], hh);
+	}
+
+	for (i = 0; i < 8; i++)
+		_mm256_storeu_si256((__m256i *)state[i], h[i]);
+}
+
+/* count (at most 8) messages that all have the same length */
+static void
+avx2_hash(const uint8_t *const m[], size_t len, unsigned count, uint8_t *digest[])
+{
+	uint32_t state[8][8];
+	uint8_t tails[8][128];
+	const uint8_t *lanes[8];
+	uint32_t h[8];
+	unsigned i, j, n = 0;
+
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 8; j++)
+			state[i][j] = H0[i];
+	}
+	/* unused lanes hash message 0 again, their result is dropped */
+	for (j = 0; j < 8; j++)
+		lanes[j] = m[j < count ? j : 0];
+	avx2_blocks(state, lanes, len / 64);
+	for (j = 0; j < 8; j++) {
+		n = tail_blocks(lanes[j], len, tails[j]);
+		lanes[j] = tails[j];
+	}
+	avx2_blocks(state, lanes, n);
+	for (j = 0; j < count; j++) {
+		for (i = 0; i < 8; i++)
+			h[i] = state[i][j];
+		put_digest(h, digest[j]);
+	}
+}
+
+#endif /* SHA256_MB_X86 */
+
+void
+SHA256_Multi(const uint8_t *const m[], const size_t len[], unsigned count,
+             uint8_t digest[][SHA256_DIGEST_SIZE])
+{
+	unsigned i;
+
+	pthread_once(&impl_once, select_impl);
+#if SHA256_MB_X86
+	if (impl == IMPL_SHA_NI) {
+		for (i = 0; i < count; i++)
+			sha_ni_hash(m[i], len[i], digest[i]);
+		return;
+	}
+	if (impl == IMPL_AVX2 && count > 1) {
+		int done[SHA256_MULTI_MAX] = { 0 };
+		for (i = 0; i < count; i++) {
+			const uint8_t *group[SHA256_MULTI_MAX];
+			uint8_t *out[SHA256_MULTI_MAX];
+			unsigned j, n = 0;
+			if (done[i])
+				continue;
+			/* pages are all the same size, except maybe the last one */
+			for (j = i; j < count; j++) {
+				if (!done[j] && len[j] == len[i]) {
+					group[n] = m[j];
+					out[n++] = digest[j];
+					done[j] = 1;
+				}
+			}
+			if (n > 1)
+				avx2_hash(group, len[i], n, out);
+			else
+				scalar_hash(m[i], len[i], digest[i]);
+		}
+		return;
+	}
+#endif
+	for (i = 0; i < count; i++)
+		scalar_hash(m[i], len[i], digest[i]);
+}
+
+const char *
+SHA256_Multi_Impl(void)
+{
+	pthread_once(&impl_once, select_impl);
+	switch (impl) {
+	case IMPL_SHA_NI:
+		return "sha-ni";
+	case IMPL_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+#if TESTING
+/*
+ * page hashing micro benchmark:
+ *   cc -DTESTING -O2 -o sha256_mb sha256_mb.c sha256.c -lpthread && ./sha256_mb [MB]
+ */
+#include <time.h>
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int argc, const char *argv[])
+{
+	const size_t page_size = 4096;
+	size_t pages = (argc > 1 ? (size_t)atoi(argv[1]) : 256) * (1024 * 1024 / page_size);
+	uint8_t *buffer = malloc(pages * page_size);
+	uint8_t (*expected)[SHA256_DIGEST_SIZE] = malloc(pages * SHA256_DIGEST_SIZE);
+	uint8_t (*digests)[SHA256_DIGEST_SIZE] = malloc(pages * SHA256_DIGEST_SIZE);
+	const char *names[] = { "scalar", "sha-ni", "avx2" };
+	size_t i, p;
+	int k;
+
+	srand(1);
+	for (i = 0; i < pages * page_size; i++)
+		buffer[i] = (uint8_t)rand();
+
+	pthread_once(&impl_once, select_impl);
+	printf("selected: %s\n", SHA256_Multi_Impl());
+	const int detected = impl;
+	for (k = IMPL_SCALAR; k <= IMPL_AVX2; k++) {
+		if (!(impl_usable & (1u << k)))
+			continue;
+		impl = k;
+		double start = now();
+		for (p = 0; p < pages; p += SHA256_MULTI_MAX) {
+			const uint8_t *m[SHA256_MULTI_MAX];
+			size_t len[SHA256_MULTI_MAX];
+			unsigned n = 0;
+			for (; n < SHA256_MULTI_MAX && p + n < pages; n++) {
+				m[n] = buffer + (p + n) * page_size;
+				/* odd sized last page, like the end of an image */
+				len[n] = (p + n == pages - 1) ? page_size - 77 : page_size;
+			}
+			SHA256_Multi(m, len, n, &digests[p]);
+		}
+		double elapsed = now() - start;
+		if (k == IMPL_SCALAR)
+			memcpy(expected, digests, pages * SHA256_DIGEST_SIZE);
+		else if (memcmp(expected, digests, pages * SHA256_DIGEST_SIZE) != 0)
+			printf("%s: digests differ from scalar\n", names[k]);
+		printf("%-7s %10.0f pages/s %8.1f MB/s\n", names[k], pages / elapsed,
+		       pages * page_size / elapsed / (1024 * 1024));
+	}
+	impl = detected;
+	return 0;
+}
+#endif
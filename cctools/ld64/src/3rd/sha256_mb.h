@@ -0,0 +1,29 @@
+/* hash several independent messages with the fastest sha256 the cpu has */
+#ifndef __SHA256_MB_H
+#define __SHA256_MB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sha256.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* most messages hashed by one SHA256_Multi() call */
+#define SHA256_MULTI_MAX 8
+
+/* hash count (at most SHA256_MULTI_MAX) messages, digest[i] is the hash of m[i] */
+/* messages of the same length are hashed side by side when the cpu allows it */
+void SHA256_Multi(const uint8_t *const m[], const size_t len[], unsigned count,
+                  uint8_t digest[][SHA256_DIGEST_SIZE]);
+/* name of the implementation SHA256_Multi() uses: "sha-ni", "avx2" or "scalar" */
+const char *SHA256_Multi_Impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif                          /* __SHA256_MB_H */
@@ -25,6 +25,7 @@
 #define __MACH_O_TRIE__
 
 #include <algorithm>
+#include <vector>
 #include <assert.h>
 
 #include "MachOFileAbstraction.hpp"
@@ -323,6 +324,99 @@ struct EntryWithOffset
 
 
 
+static inline void readTerminalInfo(const uint8_t* p, const uint8_t* const end, Entry& entry)
+{
+	entry.flags = read_uleb128(p, end);
+	if ( entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT ) {
+		entry.address = 0;
+		entry.other = read_uleb128(p, end); // dylib ordinal
+		entry.importName = (char*)p;
+	}
+	else {
+		entry.address = read_uleb128(p, end); 
+		if ( entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER )
+			entry.other = read_uleb128(p, end); 
+		else
+			entry.other = 0;
+		entry.importName = NULL;
+	}
+}
+
+//
+// Follows the edges spelling out 'str' from the root and returns the node reached, or NULL.
+// If 'prefixMatch' is true, the walk may stop part way along an edge, so the returned node is the
+// root of the sub-trie containing every symbol starting with 'str'.  The path to the returned
+// node is copied to 'cummulativeString' and its length returned in 'curStrOffset'.
+//
+static inline const uint8_t* findExportNode(const uint8_t* const start, const uint8_t* const end, const char* str,
+											bool prefixMatch, char* cummulativeString, int& curStrOffset)
+{
+	const uint8_t* p = start;
+	curStrOffset = 0;
+	cummulativeString[0] = '\0';
+	while ( true ) {
+		if ( p >= end )
+			throw "malformed trie, node past end";
+		const uint8_t* node = p;
+		const uint64_t terminalSize = read_uleb128(p, end);
+		if ( (*str == '\0') && (prefixMatch || (terminalSize != 0)) )
+			return node;
+		const uint8_t* s = p + terminalSize;
+		if ( s >= end )
+			throw "malformed trie, terminalSize extends beyond trie data";
+		const uint8_t childrenCount = *s++;
+		const uint8_t* childNode = NULL;
+		for (uint8_t i=0; (i < childrenCount) && (childNode == NULL); ++i) {
+			const uint8_t* edge = s;
+			while ( (s < end) && (*s != '\0') )
+				++s;
+			if ( s >= end )
+				throw "malformed trie, edge string extends beyond trie data";
+			const size_t edgeStrLen = s - edge;
+			++s;
+			const uint32_t childNodeOffset = read_uleb128(s, end);
+			if ( childNodeOffset == 0 )
+				throw "malformed trie, childNodeOffset==0";
+			// like dyld, take the first edge that spells out the start of what is left of str
+			const size_t strLen = strlen(str);
+			const size_t matchLen = (edgeStrLen < strLen) ? edgeStrLen : strLen;
+			if ( strncmp((char*)edge, str, matchLen) != 0 )
+				continue;
+			if ( (edgeStrLen > strLen) && !prefixMatch )
+				continue;
+			memcpy(&cummulativeString[curStrOffset], edge, edgeStrLen+1);
+			curStrOffset += edgeStrLen;
+			str += matchLen;
+			childNode = start + childNodeOffset;
+		}
+		if ( childNode == NULL )
+			return NULL;
+		p = childNode;
+	}
+}
+
+//
+// Looks up a single symbol without walking the rest of the trie.  Returns false if the symbol
+// is not exported.  On success entry.name is set to 'symbol' itself (it is not copied).
+//
+inline bool findTrieEntry(const uint8_t* start, const uint8_t* end, const char* symbol, Entry& entry)
+{
+	// empty trie has no entries
+	if ( start == end )
+		return false;
+	char cummulativeString[strlen(symbol)+1];
+	int curStrOffset;
+	const uint8_t* node = findExportNode(start, end, symbol, false, cummulativeString, curStrOffset);
+	if ( node == NULL )
+		return false;
+	const uint64_t terminalSize = read_uleb128(node, end);
+	if ( terminalSize == 0 )
+		return false;
+	entry.name = symbol;
+	readTerminalInfo(node, end, entry);
+	return true;
+}
+
 static inline void processExportNode(const uint8_t* const start, const uint8_t* p, const uint8_t* const end, 
 									char* cummulativeString, int curStrOffset, 
 									std::vector<EntryWithOffset>& output) 
@@ -335,20 +429,7 @@ static inline void processExportNode(const uint8_t* const start, const uint8_t*
 		EntryWithOffset e;
 		e.nodeOffset = p-start;
 		e.entry.name = strdup(cummulativeString);
-		e.entry.flags = read_uleb128(p, end);
-		if ( e.entry.flags & EXPORT_SYMBOL_FLAGS_REEXPORT ) {
-			e.entry.address = 0;
-			e.entry.other = read_uleb128(p, end); // dylib ordinal
-			e.entry.importName = (char*)p;
-		}
-		else {
-			e.entry.address = read_uleb128(p, end); 
-			if ( e.entry.flags & EXPORT_SYMBOL_FLAGS_STUB_AND_RESOLVER )
-				e.entry.other = read_uleb128(p, end); 
-			else
-				e.entry.other = 0;
-			e.entry.importName = NULL;
-		}
+		readTerminalInfo(p, end, e.entry);
 		output.push_back(e);
 	}
 	if ( children > end )
@@ -388,6 +469,26 @@ inline void parseTrie(const uint8_t* start, const uint8_t* end, std::vector<Entr
 	delete [] cummulativeString;
 }
 
+// like parseTrie() but only returns the symbols that start with 'prefix'
+inline void parseTrie(const uint8_t* start, const uint8_t* end, const char* prefix, std::vector<Entry>& output)
+{
+	// empty trie has no entries
+	if ( start == end )
+		return;
+	char* cummulativeString = new char[end-start+strlen(prefix)+1];
+	int curStrOffset;
+	const uint8_t* node = findExportNode(start, end, prefix, true, cummulativeString, curStrOffset);
+	if ( node != NULL ) {
+		std::vector<EntryWithOffset> entries;
+		processExportNode(start, node, end, cummulativeString, curStrOffset, entries);
+		std::sort(entries.begin(), entries.end());
+		output.reserve(output.size()+entries.size());
+		for (std::vector<EntryWithOffset>::iterator it=entries.begin(); it != entries.end(); ++it)
+			output.push_back(it->entry);
+	}
+	delete [] cummulativeString;
+}
+
 
 
 
@@ -0,0 +1,946 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <mach-o/loader.h>
+#include <mach-o/nlist.h>
+#include <mach-o/stab.h>
+
+#include <vector>
+#include <string>
+#include <set>
+#include <algorithm>
+#include <unordered_map>
+
+#include "MachOFileAbstraction.hpp"
+#include "Incremental.h"
+#include "InputFiles.h"
+#include "OutputFile.h"
+#include "macho_relocatable_file.h"
+
+extern const char ld_classicVersionString[];
+
+namespace ld {
+namespace tool {
+
+// change when anything saved in the state file changes
+static const char kStateMagic[8] = "ldinc01";
+
+
+//
+// FNV-1a, used for atom signatures and content hashes
+//
+class Hasher
+{
+public:
+				Hasher() : _hash(0xcbf29ce484222325ULL) { }
+
+	void		bytes(const void* p, size_t len) {
+					const uint8_t* s = (const uint8_t*)p;
+					for (size_t i=0; i < len; ++i) {
+						_hash ^= s[i];
+						_hash *= 0x100000001b3ULL;
+					}
+				}
+	void		u64(uint64_t value)			{ bytes(&value, sizeof(value)); }
+	void		str(const char* s)			{ if ( s == NULL ) u64(0); else bytes(s, strlen(s)+1); }
+	uint64_t	value() const				{ return _hash; }
+
+private:
+	uint64_t	_hash;
+};
+
+
+//
+// The state file is only read back by the same linker on the same machine, so values are
+// saved in host byte order.
+//
+class StateWriter
+{
+public:
+	void		u8(uint8_t value)			{ _bytes.push_back(value); }
+	void		u32(uint32_t value)			{ _bytes.insert(_bytes.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value)); }
+	void		u64(uint64_t value)			{ _bytes.insert(_bytes.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value)); }
+	void		str(const std::string& s)	{ u32((uint32_t)s.size()); _bytes.insert(_bytes.end(), s.begin(), s.end()); }
+	const std::vector<uint8_t>& bytes() const { return _bytes; }
+
+private:
+	std::vector<uint8_t>	_bytes;
+};
+
+class StateReader
+{
+public:
+				StateReader(const uint8_t* start, uint64_t size) : _p(start), _end(start+size), _ok(true) { }
+
+	bool		ok() const					{ return _ok; }
+	uint8_t		u8()						{ uint8_t v = 0;  read(&v, sizeof(v)); return v; }
+	uint32_t	u32()						{ uint32_t v = 0; read(&v, sizeof(v)); return v; }
+	uint64_t	u64()						{ uint64_t v = 0; read(&v, sizeof(v)); return v; }
+	std::string	str() {
+					uint32_t len = u32();
+					if ( !_ok || (len > (uint64_t)(_end - _p)) ) {
+						_ok = false;
+						return std::string();
+					}
+					std::string result((const char*)_p, len);
+					_p += len;
+					return result;
+				}
+	// count of records that are each at least minSize bytes, zero if the count can't be right
+	uint32_t	count(uint32_t minSize) {
+					uint32_t result = u32();
+					if ( !_ok || ((uint64_t)result*minSize > (uint64_t)(_end - _p)) ) {
+						_ok = false;
+						return 0;
+					}
+					return result;
+				}
+
+private:
+	void		read(void* value, size_t len) {
+					if ( !_ok || (len > (size_t)(_end - _p)) ) {
+						_ok = false;
+						return;
+					}
+					memcpy(value, _p, len);
+					_p += len;
+				}
+
+	const uint8_t*	_p;
+	const uint8_t*	_end;
+	bool			_ok;
+};
+
+
+static bool readWholeFile(const char* path, std::vector<uint8_t>& content)
+{
+	int fd = ::open(path, O_RDONLY, 0);
+	if ( fd == -1 )
+		return false;
+	struct stat statBuffer;
+	if ( ::fstat(fd, &statBuffer) != 0 ) {
+		::close(fd);
+		return false;
+	}
+	content.resize(statBuffer.st_size);
+	uint64_t done = 0;
+	while ( done < content.size() ) {
+		ssize_t amount = ::pread(fd, &content[done], content.size()-done, done);
+		if ( amount <= 0 ) {
+			::close(fd);
+			return false;
+		}
+		done += amount;
+	}
+	::close(fd);
+	return true;
+}
+
+
+template <typename P>
+static void scanOutput(const uint8_t* buffer, uint64_t size, uint64_t& uuidOffset,
+						std::unordered_map<std::string, uint64_t>& osoValueOffsets)
+{
+	const macho_header<P>* mh = (const macho_header<P>*)buffer;
+	const uint8_t* cmdsEnd = buffer + sizeof(macho_header<P>) + mh->sizeofcmds();
+	const macho_load_command<P>* cmd = (const macho_load_command<P>*)(buffer + sizeof(macho_header<P>));
+	for (uint32_t i = 0; (i < mh->ncmds()) && ((const uint8_t*)cmd < cmdsEnd); ++i) {
+		switch ( cmd->cmd() ) {
+			case LC_UUID:
+				uuidOffset = ((const macho_uuid_command<P>*)cmd)->uuid() - buffer;
+				break;
+			case LC_SYMTAB:
+			{
+				const macho_symtab_command<P>* symtab = (const macho_symtab_command<P>*)cmd;
+				if ( (symtab->symoff() + (uint64_t)symtab->nsyms()*sizeof(macho_nlist<P>) > size) || (symtab->stroff() + (uint64_t)symtab->strsize() > size) )
+					break;
+				const macho_nlist<P>* symbols = (const macho_nlist<P>*)&buffer[symtab->symoff()];
+				const char* strings = (const char*)&buffer[symtab->stroff()];
+				for (uint32_t s = 0; s < symtab->nsyms(); ++s) {
+					if ( (symbols[s].n_type() == N_OSO) && (symbols[s].n_strx() < symtab->strsize()) ) {
+						// n_value follows n_strx, n_type, n_sect and n_desc in both nlist and nlist_64
+						osoValueOffsets[&strings[symbols[s].n_strx()]] = (const uint8_t*)&symbols[s] - buffer + 8;
+					}
+				}
+			}
+				break;
+		}
+		cmd = (const macho_load_command<P>*)((const uint8_t*)cmd + cmd->cmdsize());
+	}
+}
+
+
+Incremental::Incremental(const Options& opts, int argc, const char* argv[])
+	: _options(opts), _argc(argc), _argv(argv), _patchedAtomCount(0), _patchedFileCount(0),
+	  _blocker(NULL), _is64(false), _contentUUID(false), _uuidOffset(0),
+	  _codeSignatureOffset(0), _codeSignatureSize(0), _codeSignatureTextSize(0)
+{
+	_outputStamp = stampOf(NULL);
+}
+
+
+Incremental::Stamp Incremental::stampOf(const char* path)
+{
+	Stamp stamp;
+	stamp.size    = 0;
+	stamp.modTime = 0;
+	stamp.exists  = false;
+	struct stat statBuffer;
+	if ( (path != NULL) && (::stat(path, &statBuffer) == 0) ) {
+		stamp.exists = true;
+		stamp.size   = statBuffer.st_size;
+		stamp.modTime = ld::utils::modTimeNanoseconds(statBuffer);
+	}
+	return stamp;
+}
+
+
+std::string Incremental::statePath() const
+{
+	return std::string(_options.outputFilePath()) + ".ldinc";
+}
+
+
+uint64_t Incremental::argumentsHash() const
+{
+	Hasher hasher;
+	// relative paths on the command line depend on the current directory
+	char cwd[MAXPATHLEN];
+	if ( ::getcwd(cwd, sizeof(cwd)) != NULL )
+		hasher.str(cwd);
+	for (int i=1; i < _argc; ++i) {
+		hasher.str(_argv[i]);
+		// response files are expanded by Options, so their content is part of the arguments
+		if ( _argv[i][0] == '@' ) {
+			std::vector<uint8_t> content;
+			if ( readWholeFile(&_argv[i][1], content) )
+				hasher.bytes(content.data(), content.size());
+		}
+	}
+	return hasher.value();
+}
+
+
+bool Incremental::patchable(const ld::Atom* atom) const
+{
+	// only content the linker copies to the output and applies fixups to can be patched, not content
+	// it interprets or rewrites, like literals, unwind info, objc metadata, or initializer lists
+	const ld::Section& sect = atom->section();
+	switch ( sect.type() ) {
+		case ld::Section::typeCode:
+		case ld::Section::typeUnclassified:
+		case ld::Section::typeLSDA:
+			break;
+		default:
+			return false;
+	}
+	if ( strncmp(sect.sectionName(), "__objc_", 7) == 0 )
+		return false;
+	switch ( atom->contentType() ) {
+		case ld::Atom::typeUnclassified:
+		case ld::Atom::typeLSDA:
+			break;
+		default:
+			return false;
+	}
+	switch ( atom->combine() ) {
+		case ld::Atom::combineNever:
+		case ld::Atom::combineByName:
+			break;
+		default:
+			return false;
+	}
+	return true;
+}
+
+
+uint64_t Incremental::fileSignature(const ld::relocatable::File* file)
+{
+	// everything about an object file, besides its atoms, that ends up in the output
+	Hasher hasher;
+	hasher.u64(file->sourceKind());
+	hasher.u64(file->cpuSubType());
+	hasher.u64(file->cpuSubTypeFlags());
+	hasher.u64(file->swiftVersion());
+	hasher.u64(file->swiftLanguageVersion());
+	hasher.u64(file->debugInfo());
+	hasher.u64(file->canScatterAtoms());
+	hasher.u64(((ld::relocatable::File*)file)->hasLongBranchStubs());
+	hasher.u64(file->hasllvmProfiling());
+	hasher.u64(file->hasObjC());
+	hasher.u64(file->objcHasSignedClassROs());
+	hasher.u64(file->objcHasCategoryClassPropertiesField());
+	Hasher* platformHasher = &hasher;
+	file->platforms().forEach(^(ld::Platform platform, uint32_t minVersion, uint32_t sdkVersion, bool& stop) {
+		platformHasher->u64((uint64_t)platform);
+		platformHasher->u64(minVersion);
+		platformHasher->u64(sdkVersion);
+	});
+	if ( ld::relocatable::File::LinkerOptionsList* lo = file->linkerOptions() ) {
+		for (const std::vector<const char*>& option : *lo) {
+			hasher.u64(option.size());
+			for (const char* arg : option)
+				hasher.str(arg);
+		}
+	}
+	for (const std::pair<uint32_t,uint32_t>& tool : file->toolVersions()) {
+		hasher.u64(tool.first);
+		hasher.u64(tool.second);
+	}
+	if ( const std::vector<ld::relocatable::File::AstTimeAndPath>* asts = file->astFiles() ) {
+		for (const ld::relocatable::File::AstTimeAndPath& ast : *asts) {
+			hasher.u64(ast.time);
+			hasher.str(ast.path.c_str());
+		}
+	}
+	return hasher.value();
+}
+
+
+void Incremental::collectAtoms(const ld::relocatable::File* file, ParsedObject& parsed)
+{
+	ld::File::AtomSinkHandler handler;
+	file->forEachAtom(handler);
+	parsed.atoms.swap(handler.atoms);
+	for (uint32_t i=0; i < parsed.atoms.size(); ++i)
+		parsed.atomIndexes[parsed.atoms[i]] = i;
+}
+
+
+uint64_t Incremental::atomSignature(const ld::Atom* atom, const ParsedObject& parsed, bool patchable)
+{
+	Hasher hasher;
+	const ld::Section& sect = atom->section();
+	hasher.str(sect.segmentName());
+	hasher.str(sect.sectionName());
+	hasher.u64(sect.type());
+	hasher.u64(sect.isSectionHidden());
+	hasher.str(atom->name());
+	hasher.u64(atom->objectAddress());
+	hasher.u64(atom->size());
+	hasher.u64(atom->alignment().powerOf2);
+	hasher.u64(atom->alignment().modulus);
+	hasher.u64(atom->definition());
+	hasher.u64(atom->combine());
+	hasher.u64(atom->scope());
+	hasher.u64(atom->contentType());
+	hasher.u64(atom->symbolTableInclusion());
+	hasher.u64(atom->dontDeadStrip());
+	hasher.u64(atom->dontDeadStripIfReferencesLive());
+	hasher.u64(atom->isThumb());
+	hasher.u64(atom->isAlias());
+	hasher.u64(atom->autoHide());
+	hasher.u64(atom->cold());
+	hasher.u64(patchable);
+
+	// fixups, with targets in the same file identified by their position in the file
+	for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+		hasher.u64(fit->offsetInAtom);
+		hasher.u64(fit->kind);
+		hasher.u64(fit->clusterSize);
+		hasher.u64(fit->weakImport);
+		hasher.u64(fit->binding);
+		hasher.u64(fit->contentAddendOnly);
+		hasher.u64(fit->contentDetlaToAddendOnly);
+		hasher.u64(fit->contentIgnoresAddend);
+		switch ( fit->binding ) {
+			case ld::Fixup::bindingNone:
+#if SUPPORT_ARCH_arm64e
+				if ( fit->kind == ld::Fixup::kindSetAuthData ) {
+					hasher.u64(fit->u.authData.discriminator);
+					hasher.u64(fit->u.authData.hasAddressDiversity);
+					hasher.u64(fit->u.authData.key);
+					break;
+				}
+#endif
+				hasher.u64(fit->u.addend);
+				break;
+			case ld::Fixup::bindingByNameUnbound:
+				hasher.str(fit->u.name);
+				break;
+			case ld::Fixup::bindingDirectlyBound:
+			case ld::Fixup::bindingByContentBound:
+			{
+				std::unordered_map<const ld::Atom*, uint32_t>::const_iterator pos = parsed.atomIndexes.find(fit->u.target);
+				if ( pos != parsed.atomIndexes.end() ) {
+					hasher.u64(1);
+					hasher.u64(pos->second);
+				}
+				else {
+					hasher.u64(2);
+					hasher.str(fit->u.target->name());
+				}
+			}
+				break;
+			case ld::Fixup::bindingsIndirectlyBound:
+				hasher.u64(fit->u.bindingIndex);
+				break;
+		}
+	}
+
+	for (ld::Atom::UnwindInfo::iterator uit = atom->beginUnwind(), end=atom->endUnwind(); uit != end; ++uit) {
+		hasher.u64(uit->startOffset);
+		hasher.u64(uit->unwindInfo);
+	}
+
+	// debug notes use the translation unit and the file names of line info, but not line numbers
+	hasher.str(atom->translationUnitSource());
+	const char* lastFileName = NULL;
+	for (ld::Atom::LineInfo::iterator lit = atom->beginLineInfo(), end=atom->endLineInfo(); lit != end; ++lit) {
+		if ( (lit->fileName == NULL) || ((lastFileName != NULL) && (strcmp(lit->fileName, lastFileName) == 0)) )
+			continue;
+		hasher.str(lit->fileName);
+		lastFileName = lit->fileName;
+	}
+	return hasher.value();
+}
+
+
+static void addWindow(std::vector<std::pair<uint32_t, uint32_t>>& windows, int64_t start, int64_t end, uint64_t atomSize)
+{
+	if ( start < 0 )
+		start = 0;
+	if ( end > (int64_t)atomSize )
+		end = atomSize;
+	if ( start < end )
+		windows.push_back(std::make_pair((uint32_t)start, (uint32_t)end));
+}
+
+void Incremental::fixupWindows(const ld::Atom* atom, Windows& windows)
+{
+	// The bytes the linker may change when applying fixups.  Besides the fixup location itself,
+	// some fixups rewrite the instruction in front of it, like x86_64 GOT loads turned into LEAs,
+	// and optimization hints may rewrite each instruction they cover.
+	windows.clear();
+	const uint64_t size = atom->size();
+	for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+		if ( fit->kind == ld::Fixup::kindLinkerOptimizationHint ) {
+			ld::Fixup::LOH_arm64 extra;
+			extra.addend = fit->u.addend;
+			int64_t offset = fit->offsetInAtom;
+			addWindow(windows, offset + (extra.info.delta1 << 2), offset + (extra.info.delta1 << 2) + 4, size);
+			addWindow(windows, offset + (extra.info.delta2 << 2), offset + (extra.info.delta2 << 2) + 4, size);
+			if ( extra.info.count > 1 )
+				addWindow(windows, offset + (extra.info.delta3 << 2), offset + (extra.info.delta3 << 2) + 4, size);
+			if ( extra.info.count > 2 )
+				addWindow(windows, offset + (extra.info.delta4 << 2), offset + (extra.info.delta4 << 2) + 4, size);
+		}
+		else if ( fit->isStore() ) {
+			addWindow(windows, (int64_t)fit->offsetInAtom - 4, (int64_t)fit->offsetInAtom + 8, size);
+		}
+	}
+	// sort and merge overlapping windows
+	std::sort(windows.begin(), windows.end());
+	size_t merged = 0;
+	for (size_t i=0; i < windows.size(); ++i) {
+		if ( (merged != 0) && (windows[i].first <= windows[merged-1].second) )
+			windows[merged-1].second = std::max(windows[merged-1].second, windows[i].second);
+		else
+			windows[merged++] = windows[i];
+	}
+	windows.resize(merged);
+}
+
+
+uint64_t Incremental::contentHash(const ld::Atom* atom, const uint8_t* content, bool patchable)
+{
+	Hasher hasher;
+	if ( patchable ) {
+		// the rest of a patchable atom's content is copied to the output as is
+		Windows windows;
+		fixupWindows(atom, windows);
+		for (const std::pair<uint32_t, uint32_t>& window : windows) {
+			hasher.u64(window.first);
+			hasher.bytes(&content[window.first], window.second - window.first);
+		}
+	}
+	else {
+		hasher.bytes(content, atom->size());
+	}
+	return hasher.value();
+}
+
+
+void Incremental::recordObjectFile(const ld::relocatable::File* file)
+{
+	if ( file->sourceKind() != ld::relocatable::File::kSourceObj ) {
+		_blocker = "an input is an LLVM bitcode file";
+		return;
+	}
+	if ( (file->debugInfo() == ld::relocatable::File::kDebugInfoStabs) || (file->debugInfo() == ld::relocatable::File::kDebugInfoStabsUUID) ) {
+		_blocker = "an input object file has stabs debug info";
+		return;
+	}
+
+	const uint32_t fileIndex = (uint32_t)_objects.size();
+	_objects.resize(_objects.size()+1);
+	ObjectRecord& object = _objects.back();
+	object.path				= file->path();
+	object.stamp			= stampOf(file->path());
+	object.signature		= fileSignature(file);
+	object.osoValueOffset	= 0;
+	_files.push_back(file);
+
+	ParsedObject parsed;
+	collectAtoms(file, parsed);
+	std::vector<uint8_t> content;
+	object.atoms.resize(parsed.atoms.size());
+	for (uint32_t i=0; i < parsed.atoms.size(); ++i) {
+		const ld::Atom* atom = parsed.atoms[i];
+		AtomRecord& record = object.atoms[i];
+		const bool isPatchable = patchable(atom);
+		content.resize(atom->size());
+		atom->copyRawContent(content.data());
+		record.signature	= atomSignature(atom, parsed, isPatchable);
+		record.contentHash	= contentHash(atom, content.data(), isPatchable);
+		record.fileOffset	= 0;
+		record.flags		= (isPatchable ? kAtomPatchable : 0);
+		_atomIndexes[atom]	= std::make_pair(fileIndex, i);
+	}
+}
+
+
+bool Incremental::fullLink(const char* format, ...)
+{
+	char* reason;
+	va_list	list;
+	va_start(list, format);
+	vasprintf(&reason, format, list);
+	va_end(list);
+	_reason = reason;
+	free(reason);
+	// forget the previous link, save() records this one
+	_dependencies.clear();
+	_objects.clear();
+	_uuidExcludedRanges.clear();
+	return false;
+}
+
+
+bool Incremental::loadState(const uint8_t* buffer, uint64_t size)
+{
+	StateReader reader(buffer, size);
+	char magic[8];
+	for (int i=0; i < 8; ++i)
+		magic[i] = reader.u8();
+	if ( !reader.ok() || (memcmp(magic, kStateMagic, 8) != 0) )
+		return fullLink("saved state is not from this version of ld");
+	if ( reader.str() != ld_classicVersionString )
+		return fullLink("saved state is not from this version of ld");
+	if ( reader.u64() != argumentsHash() )
+		return fullLink("link arguments or working directory changed");
+	uint32_t arch = reader.u32();
+	uint32_t subArch = reader.u32();
+	if ( (arch != (uint32_t)_options.architecture()) || (subArch != (uint32_t)_options.subArchitecture()) )
+		return fullLink("link arguments or working directory changed");
+
+	_outputStamp.exists		= reader.u8();
+	_outputStamp.size		= reader.u64();
+	_outputStamp.modTime	= reader.u64();
+	_is64					= reader.u8();
+	_contentUUID			= reader.u8();
+	_uuidOffset				= reader.u64();
+	uint32_t rangeCount = reader.count(16);
+	for (uint32_t i=0; i < rangeCount; ++i) {
+		uint64_t start = reader.u64();
+		uint64_t end = reader.u64();
+		_uuidExcludedRanges.push_back(std::make_pair(start, end));
+	}
+	_codeSignatureOffset	= reader.u64();
+	_codeSignatureSize		= reader.u64();
+	_codeSignatureTextSize	= reader.u64();
+
+	uint32_t dependencyCount = reader.count(22);
+	_dependencies.resize(dependencyCount);
+	for (Dependency& dep : _dependencies) {
+		dep.opcode			= reader.u8();
+		dep.path			= reader.str();
+		dep.stamp.exists	= reader.u8();
+		dep.stamp.size		= reader.u64();
+		dep.stamp.modTime	= reader.u64();
+	}
+
+	uint32_t objectCount = reader.count(41);
+	_objects.resize(objectCount);
+	for (ObjectRecord& object : _objects) {
+		object.path				= reader.str();
+		object.stamp.exists		= reader.u8();
+		object.stamp.size		= reader.u64();
+		object.stamp.modTime	= reader.u64();
+		object.signature		= reader.u64();
+		object.osoValueOffset	= reader.u64();
+		uint32_t atomCount = reader.count(28);
+		object.atoms.resize(atomCount);
+		for (AtomRecord& record : object.atoms) {
+			record.signature	= reader.u64();
+			record.contentHash	= reader.u64();
+			record.fileOffset	= reader.u64();
+			record.flags		= reader.u32();
+		}
+	}
+	if ( !reader.ok() )
+		return fullLink("saved state is damaged");
+	return true;
+}
+
+
+void Incremental::writeState()
+{
+	StateWriter writer;
+	for (int i=0; i < 8; ++i)
+		writer.u8(kStateMagic[i]);
+	writer.str(ld_classicVersionString);
+	writer.u64(argumentsHash());
+	writer.u32((uint32_t)_options.architecture());
+	writer.u32((uint32_t)_options.subArchitecture());
+
+	writer.u8(_outputStamp.exists);
+	writer.u64(_outputStamp.size);
+	writer.u64(_outputStamp.modTime);
+	writer.u8(_is64);
+	writer.u8(_contentUUID);
+	writer.u64(_uuidOffset);
+	writer.u32((uint32_t)_uuidExcludedRanges.size());
+	for (const std::pair<uint64_t, uint64_t>& range : _uuidExcludedRanges) {
+		writer.u64(range.first);
+		writer.u64(range.second);
+	}
+	writer.u64(_codeSignatureOffset);
+	writer.u64(_codeSignatureSize);
+	writer.u64(_codeSignatureTextSize);
+
+	writer.u32((uint32_t)_dependencies.size());
+	for (const Dependency& dep : _dependencies) {
+		writer.u8(dep.opcode);
+		writer.str(dep.path);
+		writer.u8(dep.stamp.exists);
+		writer.u64(dep.stamp.size);
+		writer.u64(dep.stamp.modTime);
+	}
+
+	writer.u32((uint32_t)_objects.size());
+	for (const ObjectRecord& object : _objects) {
+		writer.str(object.path);
+		writer.u8(object.stamp.exists);
+		writer.u64(object.stamp.size);
+		writer.u64(object.stamp.modTime);
+		writer.u64(object.signature);
+		writer.u64(object.osoValueOffset);
+		writer.u32((uint32_t)object.atoms.size());
+		for (const AtomRecord& record : object.atoms) {
+			writer.u64(record.signature);
+			writer.u64(record.contentHash);
+			writer.u64(record.fileOffset);
+			writer.u32(record.flags);
+		}
+	}
+
+	std::string path = statePath();
+	const bool written = ld::utils::writeFileAtomically(path, 0600, false, [&writer](int fd) {
+		return (ld::utils::write64(fd, writer.bytes().data(), writer.bytes().size()) == (ssize_t)writer.bytes().size());
+	});
+	if ( !written )
+		warning("can't save -incremental state to %s, errno=%d", path.c_str(), errno);
+}
+
+
+void Incremental::save(ld::Internal& state, OutputFile& out)
+{
+	// a state that does not describe the new output must never be used again
+	std::string path = statePath();
+	::unlink(path.c_str());
+
+	if ( _blocker != NULL )
+		return;
+	if ( _options.bundleBitcode() || (_options.UUIDMode() == Options::kUUIDRandom) || _options.renameReverseSymbolMap() )
+		return;
+	_outputStamp = stampOf(_options.outputFilePath());
+	if ( !_outputStamp.exists || (_outputStamp.size != out.fileSize()) )
+		return;
+
+	// everything besides command line object files is only checked for changes
+	_options.forEachDependency(^(uint8_t opcode, const char* depPath) {
+		if ( opcode == Options::depOutputFile )
+			return;
+		Dependency dep;
+		dep.opcode	= opcode;
+		dep.path	= depPath;
+		dep.stamp	= stampOf(depPath);
+		_dependencies.push_back(dep);
+	});
+
+	// find where each atom of the command line object files was written
+	for (const ld::Internal::FinalSection* sect : state.sections) {
+		switch ( sect->type() ) {
+			case ld::Section::typeZeroFill:
+			case ld::Section::typeTLVZeroFill:
+			case ld::Section::typeTentativeDefs:
+				continue;
+			default:
+				break;
+		}
+		for (const ld::Atom* atom : sect->atoms) {
+			std::unordered_map<const ld::Atom*, std::pair<uint32_t, uint32_t>>::iterator pos = _atomIndexes.find(atom);
+			if ( pos == _atomIndexes.end() )
+				continue;
+			AtomRecord& record = _objects[pos->second.first].atoms[pos->second.second];
+			record.fileOffset = atom->finalAddress() - sect->address + sect->fileOffset;
+			record.flags |= kAtomInOutput;
+		}
+	}
+
+	// the UUID and code signature must be recomputed after patching
+	_contentUUID = (_options.UUIDMode() == Options::kUUIDContent);
+	out.uuidExcludedRanges(state, _uuidExcludedRanges);
+	if ( _options.adHocSign() ) {
+		for (const ld::Internal::FinalSection* sect : state.sections) {
+			if ( (strcmp(sect->segmentName(), "__LINKEDIT") == 0) && (strcmp(sect->sectionName(), "__code_sign") == 0) ) {
+				_codeSignatureOffset = sect->fileOffset;
+				_codeSignatureSize   = sect->size;
+			}
+		}
+		_codeSignatureTextSize = OutputFile::codeSignatureTextSize(state);
+	}
+
+	// find the LC_UUID and the N_OSO debug notes in the output
+	std::vector<uint8_t> output;
+	if ( !readWholeFile(_options.outputFilePath(), output) || (output.size() < sizeof(mach_header)) )
+		return;
+	std::unordered_map<std::string, uint64_t> osoValueOffsets;
+	const uint32_t magic = LittleEndian::get32(*(uint32_t*)output.data());
+	_is64 = (magic == MH_MAGIC_64);
+	if ( _is64 )
+		scanOutput<Pointer64<LittleEndian>>(output.data(), output.size(), _uuidOffset, osoValueOffsets);
+	else if ( magic == MH_MAGIC )
+		scanOutput<Pointer32<LittleEndian>>(output.data(), output.size(), _uuidOffset, osoValueOffsets);
+	else
+		return;
+	if ( !_options.zeroModTimeInDebugMap() ) {
+		for (size_t i=0; i < _files.size(); ++i) {
+			std::unordered_map<std::string, uint64_t>::iterator pos = osoValueOffsets.find(out.canonicalOSOPath(_files[i]->debugInfoPath()));
+			if ( pos != osoValueOffsets.end() )
+				_objects[i].osoValueOffset = pos->second;
+		}
+	}
+
+	writeState();
+}
+
+
+bool Incremental::patchObject(ObjectRecord& object, uint8_t* output, uint64_t outputSize)
+{
+	const char* path = object.path.c_str();
+	int fd = ::open(path, O_RDONLY, 0);
+	if ( fd == -1 )
+		return fullLink("can't open %s", path);
+	struct stat statBuffer;
+	if ( ::fstat(fd, &statBuffer) != 0 ) {
+		::close(fd);
+		return fullLink("can't stat %s", path);
+	}
+	uint64_t len = statBuffer.st_size;
+	uint8_t* p = (uint8_t*)::mmap(NULL, len, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if ( p == (uint8_t*)(-1) )
+		return fullLink("can't map %s", path);
+
+	// parse it the same way InputFiles does
+	mach_o::relocatable::ParserOptions objOpts = InputFiles::objectParserOptions(_options);
+	ld::relocatable::File* file = NULL;
+	try {
+		file = mach_o::relocatable::parse(p, len, strdup(path), statBuffer.st_mtime, ld::File::Ordinal::makeArgOrdinal(0), objOpts);
+	}
+	catch (const char* msg) {
+		return fullLink("%s in %s", msg, path);
+	}
+	if ( file == NULL )
+		return fullLink("%s is no longer a mach-o object file", path);
+	if ( fileSignature(file) != object.signature )
+		return fullLink("attributes of %s changed", path);
+	ParsedObject parsed;
+	collectAtoms(file, parsed);
+	if ( parsed.atoms.size() != object.atoms.size() )
+		return fullLink("atoms were added to or removed from %s", path);
+
+	// check every atom before patching any, so a file is either patched completely or not at all
+	std::vector<uint8_t> content;
+	std::vector<uint32_t> patches;
+	for (uint32_t i=0; i < parsed.atoms.size(); ++i) {
+		const ld::Atom* atom = parsed.atoms[i];
+		const AtomRecord& record = object.atoms[i];
+		const bool isPatchable = (record.flags & kAtomPatchable);
+		if ( atomSignature(atom, parsed, isPatchable) != record.signature )
+			return fullLink("'%s' in %s changed layout, attributes, or references", atom->name(), path);
+		content.resize(atom->size());
+		atom->copyRawContent(content.data());
+		if ( contentHash(atom, content.data(), isPatchable) != record.contentHash ) {
+			if ( isPatchable )
+				return fullLink("content of '%s' in %s changed under a fixup", atom->name(), path);
+			return fullLink("content of '%s' in %s changed, and section %s can't be patched", atom->name(), path, atom->section().sectionName());
+		}
+		if ( isPatchable && (record.flags & kAtomInOutput) ) {
+			if ( record.fileOffset + atom->size() > outputSize )
+				return fullLink("saved state is damaged");
+			patches.push_back(i);
+		}
+	}
+
+	// copy new content over everything but the bytes fixups were applied to
+	Windows windows;
+	for (uint32_t i : patches) {
+		const ld::Atom* atom = parsed.atoms[i];
+		const uint64_t size = atom->size();
+		content.resize(size);
+		atom->copyRawContent(content.data());
+		fixupWindows(atom, windows);
+		uint8_t* dst = &output[object.atoms[i].fileOffset];
+		bool changed = false;
+		uint64_t start = 0;
+		windows.push_back(std::make_pair((uint32_t)size, (uint32_t)size));
+		for (const std::pair<uint32_t, uint32_t>& window : windows) {
+			if ( window.first > start ) {
+				if ( memcmp(&dst[start], &content[start], window.first - start) != 0 ) {
+					memcpy(&dst[start], &content[start], window.first - start);
+					changed = true;
+				}
+			}
+			start = window.second;
+		}
+		if ( changed )
+			++_patchedAtomCount;
+	}
+	return true;
+}
+
+
+bool Incremental::relink()
+{
+	std::vector<uint8_t> stateContent;
+	if ( !readWholeFile(statePath().c_str(), stateContent) )
+		return fullLink("no saved state from a previous -incremental link");
+	if ( !loadState(stateContent.data(), stateContent.size()) )
+		return false;
+
+	const char* outputPath = _options.outputFilePath();
+	if ( stampOf(outputPath) != _outputStamp )
+		return fullLink("%s was changed since the last link", outputPath);
+	// object files that can be patched are checked below, every other input must be unchanged.
+	// depObjectFile shares its opcode with archives, dylibs and option files, so go by path,
+	// made absolute like Options::addDependency() does.
+	std::set<std::string> objectPaths;
+	for (const ObjectRecord& object : _objects) {
+		char realPath[PATH_MAX];
+		if ( (object.path[0] != '/') && (::realpath(object.path.c_str(), realPath) != NULL) )
+			objectPaths.insert(realPath);
+		else
+			objectPaths.insert(object.path);
+	}
+	for (const Dependency& dep : _dependencies) {
+		if ( (dep.opcode == Options::depObjectFile) && (objectPaths.count(dep.path) != 0) )
+			continue;
+		if ( stampOf(dep.path.c_str()) != dep.stamp ) {
+			if ( dep.opcode == Options::depNotFound )
+				return fullLink("%s now exists", dep.path.c_str());
+			return fullLink("%s changed", dep.path.c_str());
+		}
+	}
+
+	std::vector<uint8_t> output;
+	if ( !readWholeFile(outputPath, output) || (output.size() != _outputStamp.size) )
+		return fullLink("can't read %s", outputPath);
+	struct stat outputStat;
+	if ( ::stat(outputPath, &outputStat) != 0 )
+		return fullLink("can't stat %s", outputPath);
+
+	for (ObjectRecord& object : _objects) {
+		Stamp stamp = stampOf(object.path.c_str());
+		if ( stamp == object.stamp )
+			continue;
+		if ( !stamp.exists )
+			return fullLink("%s was removed", object.path.c_str());
+		if ( !patchObject(object, output.data(), output.size()) )
+			return false;
+		object.stamp = stamp;
+		++_patchedFileCount;
+		// the debug map records when each object file was modified
+		if ( (object.osoValueOffset != 0) && !_options.zeroModTimeInDebugMap() ) {
+			const uint64_t modTime = stamp.modTime / 1000000000ULL;
+			if ( _is64 )
+				LittleEndian::set64(*(uint64_t*)&output[object.osoValueOffset], modTime);
+			else
+				LittleEndian::set32(*(uint32_t*)&output[object.osoValueOffset], (uint32_t)modTime);
+		}
+	}
+
+	if ( _patchedFileCount != 0 ) {
+		// UUID and code signature were computed with these ranges zeroed
+		if ( _codeSignatureSize != 0 )
+			bzero(&output[_codeSignatureOffset], _codeSignatureSize);
+		if ( _contentUUID && (_uuidOffset != 0) ) {
+			uint8_t uuid[16];
+			bzero(&output[_uuidOffset], 16);
+			OutputFile::contentUUID(_options, output.data(), output.size(), _uuidExcludedRanges, uuid);
+			memcpy(&output[_uuidOffset], uuid, 16);
+		}
+		if ( _codeSignatureSize != 0 )
+			OutputFile::adHocSign(_options, output.data(), _codeSignatureOffset, _codeSignatureSize, _codeSignatureTextSize);
+
+		const bool written = ld::utils::writeFileAtomically(outputPath, outputStat.st_mode & 07777, false, [&output](int fd) {
+			return (ld::utils::write64(fd, output.data(), output.size()) == (ssize_t)output.size());
+		});
+		if ( !written )
+			throwf("can't write output file: %s, errno=%d", outputPath, errno);
+	}
+	else {
+		// nothing changed, but the output must still look newer than its inputs
+		::utimes(outputPath, NULL);
+	}
+	_outputStamp = stampOf(outputPath);
+	writeState();
+
+	// -dependency_info lists the same dependencies as the last link
+	__block std::set<std::pair<uint8_t, std::string>> known;
+	_options.forEachDependency(^(uint8_t opcode, const char* depPath) {
+		known.insert(std::make_pair(opcode, std::string(depPath)));
+	});
+	for (const Dependency& dep : _dependencies) {
+		if ( known.count(std::make_pair(dep.opcode, dep.path)) == 0 )
+			_options.addDependency(dep.opcode, dep.path.c_str());
+	}
+	return true;
+}
+
+
+} // namespace tool
+} // namespace ld
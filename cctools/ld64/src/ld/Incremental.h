@@ -0,0 +1,154 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __INCREMENTAL_H__
+#define __INCREMENTAL_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "Options.h"
+#include "ld.hpp"
+
+namespace ld {
+namespace tool {
+
+class OutputFile;
+
+//
+// -incremental saves a description of each link next to its output file (<output>.ldinc).
+// The description records every dependency of the link, and for each command line object
+// file, a signature of each of its atoms and where the atom was written in the output.
+//
+// The next -incremental link with the same arguments first calls relink().  If only the
+// contents of command line object files changed, and the changed files still have the same
+// atoms with the same names, sizes, attributes, fixups, unwind info and debug notes, the new
+// atom content is copied over the old content in the previous output, the N_OSO time stamps,
+// UUID and ad-hoc code signature are brought up to date, and the link is done.  Otherwise
+// relink() returns false, fullLinkReason() says why, and the normal link runs and calls
+// save() after the output is written.
+//
+class Incremental
+{
+public:
+							Incremental(const Options& opts, int argc, const char* argv[]);
+
+	// returns true if the previous output was brought up to date, and no link is needed
+	bool					relink();
+	const char*				fullLinkReason() const		{ return _reason.c_str(); }
+	uint32_t				patchedAtomCount() const	{ return _patchedAtomCount; }
+	uint32_t				patchedFileCount() const	{ return _patchedFileCount; }
+
+	// called for each command line object file, before its atoms are handed to the resolver
+	void					recordObjectFile(const ld::relocatable::File* file);
+	// called once the output file is written
+	void					save(ld::Internal& state, OutputFile& out);
+
+private:
+	struct Stamp {
+		uint64_t			size;
+		uint64_t			modTime;
+		bool				exists;
+
+		bool				operator==(const Stamp& other) const {
+								return (exists == other.exists) && (size == other.size) && (modTime == other.modTime);
+							}
+		bool				operator!=(const Stamp& other) const { return !(*this == other); }
+	};
+
+	enum { kAtomInOutput = 0x1, kAtomPatchable = 0x2 };
+
+	struct AtomRecord {
+		uint64_t			signature;		// everything about the atom except patchable content
+		uint64_t			contentHash;	// whole content, or only fixup windows if patchable
+		uint64_t			fileOffset;		// where the atom was written in the output
+		uint32_t			flags;
+	};
+
+	struct ObjectRecord {
+		std::string					path;
+		Stamp						stamp;
+		uint64_t					signature;
+		uint64_t					osoValueOffset;	// file offset of N_OSO n_value, zero if none
+		std::vector<AtomRecord>		atoms;
+	};
+
+	struct Dependency {
+		uint8_t				opcode;
+		std::string			path;
+		Stamp				stamp;
+	};
+
+	struct ParsedObject {
+		std::vector<const ld::Atom*>						atoms;
+		std::unordered_map<const ld::Atom*, uint32_t>		atomIndexes;
+	};
+
+	typedef std::vector<std::pair<uint32_t, uint32_t>>		Windows;
+
+	static Stamp			stampOf(const char* path);
+	std::string				statePath() const;
+	uint64_t				argumentsHash() const;
+	bool					patchable(const ld::Atom* atom) const;
+	static uint64_t			fileSignature(const ld::relocatable::File* file);
+	static void				collectAtoms(const ld::relocatable::File* file, ParsedObject& parsed);
+	static uint64_t			atomSignature(const ld::Atom* atom, const ParsedObject& parsed, bool patchable);
+	static void				fixupWindows(const ld::Atom* atom, Windows& windows);
+	static uint64_t			contentHash(const ld::Atom* atom, const uint8_t* content, bool patchable);
+	bool					fullLink(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	bool					loadState(const uint8_t* buffer, uint64_t size);
+	bool					patchObject(ObjectRecord& object, uint8_t* output, uint64_t outputSize);
+	void					writeState();
+
+	const Options&							_options;
+	int										_argc;
+	const char**							_argv;
+	std::string								_reason;
+	uint32_t								_patchedAtomCount;
+	uint32_t								_patchedFileCount;
+
+	// atoms of command line object files, as recorded before the resolver changed them
+	std::vector<const ld::relocatable::File*>						_files;
+	std::unordered_map<const ld::Atom*, std::pair<uint32_t, uint32_t>>	_atomIndexes;
+	const char*												_blocker;
+
+	// the state of the previous link
+	Stamp									_outputStamp;
+	std::vector<Dependency>					_dependencies;
+	std::vector<ObjectRecord>				_objects;
+	bool									_is64;
+	bool									_contentUUID;
+	uint64_t								_uuidOffset;		// zero if no LC_UUID
+	std::vector<std::pair<uint64_t, uint64_t>>	_uuidExcludedRanges;
+	uint64_t								_codeSignatureOffset;
+	uint64_t								_codeSignatureSize;	// zero if not code signed
+	uint64_t								_codeSignatureTextSize;
+};
+
+} // namespace tool
+} // namespace ld
+
+#endif // __INCREMENTAL_H__
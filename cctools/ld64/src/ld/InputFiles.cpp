@@ -23,7 +23,7 @@
  * @APPLE_LICENSE_HEADER_END@
  */
  
-#define HAVE_LIBDISPATCH 1
+#define PARSE_IN_TASK_POOL 1
 
 #include <stdlib.h>
 #include <sys/types.h>
@@ -46,9 +46,6 @@
 #include <mach-o/dyld.h>
 #include <mach-o/fat.h>
 #include <libkern/OSAtomic.h>
-#if HAVE_LIBDISPATCH
-#include <dispatch/dispatch.h>
-#endif
 
 #include <string>
 #include <map>
@@ -72,6 +69,9 @@
 #include "MachOFileAbstraction.hpp"
 #include "Containers.h"
 #include "Snapshot.h"
+#include "TaskPool.h"
+#include "Timeline.h"
+#include "Incremental.h"
 #include "FatFile.h"
 
 #ifndef MAP_RESILIENT_CODESIGN // ld64-port
@@ -80,6 +80,20 @@
 
 const bool _s_logPThreads = false;
 
+// terminates a chain in the library search index
+static const uint32_t kSearchIndexEnd = 0xFFFFFFFF;
+
+// the order of _installPathToDylibs, which is the order indirect dylibs are searched in
+static bool installPathLess(const ld::dylib::File* lhs, const ld::dylib::File* rhs)
+{
+	return ( strcmp(lhs->installPath() ? lhs->installPath() : "", rhs->installPath() ? rhs->installPath() : "") < 0 );
+}
+
+static void insertByInstallPath(std::vector<ld::dylib::File*>& dylibs, ld::dylib::File* dylib)
+{
+	dylibs.insert(std::upper_bound(dylibs.begin(), dylibs.end(), dylib, installPathLess), dylib);
+}
+
 namespace ld {
 namespace tool {
 
@@ -240,8 +254,72 @@ const char* InputFiles::extractFileInfo(const uint8_t* p, unsigned len, const ch
 }
 
 
+mach_o::relocatable::ParserOptions InputFiles::objectParserOptions(const Options& options)
+{
+	mach_o::relocatable::ParserOptions objOpts;
+	objOpts.architecture		= options.architecture();
+	objOpts.objSubtypeMustMatch = !options.allowSubArchitectureMismatches();
+	objOpts.logAllFiles			= options.logAllFiles();
+	objOpts.warnUnwindConversionProblems	= options.needsUnwindInfoSection();
+	objOpts.keepDwarfUnwind		= options.keepDwarfUnwind();
+	objOpts.forceDwarfConversion= false;
+	objOpts.neverConvertDwarf   = !options.needsUnwindInfoSection();
+	objOpts.verboseOptimizationHints = options.verboseOptimizationHints();
+	objOpts.armUsesZeroCostExceptions = options.armUsesZeroCostExceptions();
+#if SUPPORT_ARCH_arm64e
+	objOpts.supportsAuthenticatedPointers = options.supportsAuthenticatedPointers();
+#endif
+	objOpts.subType				= options.subArchitecture();
+	objOpts.platforms			= options.platforms();
+	objOpts.srcKind				= ld::relocatable::File::kSourceObj;
+	objOpts.treateBitcodeAsData	= options.bitcodeKind() == Options::kBitcodeAsData;
+	objOpts.usingBitcode		= options.bundleBitcode();
+	objOpts.maxDefaultCommonAlignment = options.maxDefaultCommonAlign();
+	objOpts.internalSDK 		= options.internalSDK();
+	objOpts.forceHidden			= false;
+	objOpts.platformMismatchesAreWarning = options.platformMismatchesAreWarning();
+	objOpts.avoidMisalignedPointers  = (options.architecture() & CPU_ARCH_ABI64) && options.makeChainedFixups() && options.dyldLoadsOutput();
+	return objOpts;
+}
+
+//
+// Ask the kernel to start reading all input files ahead of the parsers faulting their pages in.
+// Object files are read completely.  Of archives and dylibs only the start of the file
+// (archive table of contents, load commands) is known to be needed.
+//
+void InputFiles::prefetchInputFiles() const
+{
+	ld::timeline::Span span("prefetch files", "input");
+	const off_t headLength = 1024*1024;
+	for (const Options::FileInfo& info : _options.getInputFiles()) {
+		if ( info.isInlined )
+			continue;
+		int fd = ::open(info.path, O_RDONLY, 0);
+		if ( fd == -1 )
+			continue;	// makeFile() reports the error
+		const char* dot = strrchr(info.path, '.');
+		off_t length = ((dot != NULL) && (strcmp(dot, ".o") == 0)) ? 0 : headLength;
+#if defined(__APPLE__)
+		struct stat stat_buf;
+		if ( ::fstat(fd, &stat_buf) == 0 ) {
+			off_t size = stat_buf.st_size;
+			if ( (length != 0) && (length < size) )
+				size = length;
+			struct radvisory advice;
+			advice.ra_offset = 0;
+			advice.ra_count  = (int)std::min(size, (off_t)INT_MAX);
+			(void)::fcntl(fd, F_RDADVISE, &advice);
+		}
+#else // ld64-port
+		(void)::posix_fadvise(fd, 0, length, POSIX_FADV_WILLNEED);
+#endif
+		::close(fd);
+	}
+}
+
 ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib)
 {
+	ld::timeline::Span span("load file", "input", info.path);
 	bool fromSDK = _options.fromSDK(info.path);
 #ifdef TAPI_SUPPORT
 	// handle inlined framework first.
@@ -379,30 +457,7 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 	::close(fd);
 
 	// see if it is an object file
-	mach_o::relocatable::ParserOptions objOpts;
-	objOpts.architecture		= _options.architecture();
-	objOpts.objSubtypeMustMatch = !_options.allowSubArchitectureMismatches();
-	objOpts.logAllFiles			= _options.logAllFiles();
-	objOpts.warnUnwindConversionProblems	= _options.needsUnwindInfoSection();
-	objOpts.keepDwarfUnwind		= _options.keepDwarfUnwind();
-	objOpts.forceDwarfConversion= false;
-	objOpts.neverConvertDwarf   = !_options.needsUnwindInfoSection();
-	objOpts.verboseOptimizationHints = _options.verboseOptimizationHints();
-	objOpts.armUsesZeroCostExceptions = _options.armUsesZeroCostExceptions();
-#if SUPPORT_ARCH_arm64e
-	objOpts.supportsAuthenticatedPointers = _options.supportsAuthenticatedPointers();
-#endif
-	objOpts.subType				= _options.subArchitecture();
-	objOpts.platforms			= _options.platforms();
-	objOpts.srcKind				= ld::relocatable::File::kSourceObj;
-	objOpts.treateBitcodeAsData	= _options.bitcodeKind() == Options::kBitcodeAsData;
-	objOpts.usingBitcode		= _options.bundleBitcode();
-	objOpts.maxDefaultCommonAlignment = _options.maxDefaultCommonAlign();
-	objOpts.internalSDK 		= _options.internalSDK();
-	objOpts.forceHidden			= false;
-	objOpts.platformMismatchesAreWarning = _options.platformMismatchesAreWarning();
-	objOpts.avoidMisalignedPointers  = (_options.architecture() & CPU_ARCH_ABI64) && _options.makeChainedFixups() && _options.dyldLoadsOutput();
-
+	mach_o::relocatable::ParserOptions objOpts = objectParserOptions(_options);
 	ld::relocatable::File* objResult = mach_o::relocatable::parse(p, len, info.path, info.modTime, info.ordinal, objOpts);
 	if ( objResult != NULL ) {
 		OSAtomicAdd64(len, &_totalObjectSize);
@@ -455,6 +510,7 @@ ld::File* InputFiles::makeFile(const Options::FileInfo& info, bool indirectDylib
 	archOpts.objcABI2				= _options.objCABIVersion2POverride();
 	archOpts.verboseLoad			= _options.whyLoad();
 	archOpts.logAllFiles			= _options.logAllFiles();
+	archOpts.indexCachePath			= _options.archiveIndexCachePath();
 	// Set ObjSource Kind, libclang_rt is compiler static library
 	if ( isCompilerSupportLib(info.path) )
 		archOpts.objOpts.srcKind = ld::relocatable::File::kSourceCompilerArchive;
@@ -1001,36 +1057,46 @@ InputFiles::InputFiles(Options& opts)
 		throw "no object files specified";
 
 	_inputFiles.reserve(files.size());
-#if HAVE_LIBDISPATCH
+#if PARSE_IN_TASK_POOL
+	// prefetch on a thread of its own, so waiting for the disk overlaps with parsing the files already read
+	std::thread prefetcher([this]() { prefetchInputFiles(); });
 	_inputFiles.resize(files.size(), nullptr);
 	__block const char* firstError = nullptr;
-	dispatch_apply(files.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
-		try {
-			_inputFiles[index] = makeFile(files[index], false);
-		}
-		catch (const char *msg) {
-			if ( ((strstr(msg, "architecture") != NULL)  || (strstr(msg, "attempting to link") != NULL)) && !_options.errorOnOtherArchFiles() ) {
-				if ( _options.ignoreOtherArchInputFiles() ) {
-					// ignore, because this is about an architecture not in use
+	try {
+		ld::parallelFor(files.size(), ^(size_t index) {
+			try {
+				_inputFiles[index] = makeFile(files[index], false);
+			}
+			catch (const char *msg) {
+				if ( ((strstr(msg, "architecture") != NULL)  || (strstr(msg, "attempting to link") != NULL)) && !_options.errorOnOtherArchFiles() ) {
+					if ( _options.ignoreOtherArchInputFiles() ) {
+						// ignore, because this is about an architecture not in use
+					}
+					else {
+						warning("ignoring file %s, %s", files[index].path, msg);
+					}
+				}
+				else if ( strstr(msg, "ignoring unexpected") != NULL ) {
+					warning("%s, %s", files[index].path, msg);
 				}
 				else {
-					warning("ignoring file %s, %s", files[index].path, msg);
+					if ( firstError == nullptr )
+						asprintf((char**)&firstError, "%s file '%s'", msg, files[index].path);
 				}
+				_inputFiles[index] = new IgnoredFile(files[index].path, files[index].modTime, files[index].ordinal, ld::File::Other);
 			}
-			else if ( strstr(msg, "ignoring unexpected") != NULL ) {
-				warning("%s, %s", files[index].path, msg);
-			}
-			else {
-				if ( firstError == nullptr )
-					asprintf((char**)&firstError, "%s file '%s'", msg, files[index].path);
-			}
-			_inputFiles[index] = new IgnoredFile(files[index].path, files[index].modTime, files[index].ordinal, ld::File::Other);
-		}
-	});
+		});
+	}
+	catch (...) {
+		prefetcher.join();
+		throw;
+	}
+	prefetcher.join();
 	if ( firstError != nullptr )
 		throw firstError;
 
 #else
+	prefetchInputFiles();
 #if HAVE_PTHREADS
 	unsigned int inputFileSlot = 0;
 	_availableInputFiles = 0;
@@ -1351,6 +1417,8 @@ void InputFiles::forEachInitialAtom(ld::File::AtomHandler& handler, ld::Internal
 				ld::relocatable::File* reloc = (ld::relocatable::File*)file;
 				_options.snapshot().recordObjectFile(reloc->path());
 				_options.addDependency(Options::depObjectFile, reloc->path());
+				if ( _incremental != nullptr )
+					_incremental->recordObjectFile(reloc);
 			}
 				break;
 			case ld::File::Dylib:
@@ -1451,77 +1519,270 @@ void InputFiles::forEachInitialAtom(ld::File::AtomHandler& handler, ld::Internal
 }
 
 
-bool InputFiles::searchLibraries(const char* name, bool searchDylibs, bool searchArchives, bool dataSymbolOnly, ld::File::AtomHandler& handler) const
+bool InputFiles::addToSearchIndex(ld::StringViewMap<SearchIndexChain>& index, const ld::File* file, uint32_t library) const
 {
-	// Check each input library.
-    for (std::vector<LibraryInfo>::const_iterator it=_searchLibraries.begin(); it != _searchLibraries.end(); ++it) {
-        LibraryInfo lib = *it;
-        if (lib.isDylib()) {
-            if (searchDylibs) {
-                ld::dylib::File *dylibFile = lib.dylib();
-                //fprintf(stderr, "searchLibraries(%s), looking in linked %s\n", name, dylibFile->path() );
-                if ( dylibFile->justInTimeforEachAtom(name, handler) ) {
-                    // we found a definition in this dylib
-                    // done, unless it is a weak definition in which case we keep searching
-                    _options.snapshot().recordDylibSymbol(dylibFile, name);
-                    if ( !dylibFile->hasWeakExternals() || !dylibFile->hasWeakDefinition(name)) {
-                        return true;
-                    }
-                    // else continue search for a non-weak definition
-                }
-            }
-        } else {
-            if (searchArchives) {
-                ld::archive::File *archiveFile = lib.archive();
-                if ( dataSymbolOnly ) {
-                    if ( archiveFile->justInTimeDataOnlyforEachAtom(name, handler) ) {
-                        if ( _options.traceArchives() || _options.traceEmitJSON())
-                            logArchive(archiveFile);
-                        _options.snapshot().recordArchive(archiveFile->path());
-						// DALLAS _state.archives.push_back(archiveFile);
-                        // found data definition in static library, done
-                       return true;
-                    }
-                }
-                else {
-                    if ( archiveFile->justInTimeforEachAtom(name, handler) ) {
-                        if ( _options.traceArchives() || _options.traceEmitJSON())
-                            logArchive(archiveFile);
-                        _options.snapshot().recordArchive(archiveFile->path());
-                        // found definition in static library, done
-                        return true;
-                    }
-                }
-            }
-        }
-    }
+	ld::StringViewMap<SearchIndexChain>* indexPtr = &index;
+	return file->forEachSearchableName(^(const char* symbolName) {
+		const uint32_t entry = (uint32_t)_searchIndexEntries.size();
+		const auto pos = indexPtr->find(symbolName);
+		if ( pos == indexPtr->end() ) {
+			(*indexPtr)[symbolName] = { entry, entry };
+			_searchIndexEntries.push_back({ library, kSearchIndexEnd });
+			return;
+		}
+		// libraries are added in search order, so append to end of chain
+		SearchIndexChain& chain = pos->second;
+		// a dylib can reach the same name through more than one re-export
+		if ( _searchIndexEntries[chain.last].library == library )
+			return;
+		_searchIndexEntries[chain.last].next = entry;
+		chain.last = entry;
+		_searchIndexEntries.push_back({ library, kSearchIndexEnd });
+	});
+}
 
-	// search indirect dylibs
-	if ( searchDylibs ) {
-		for (InstallNameToDylib::const_iterator it=_installPathToDylibs.begin(); it != _installPathToDylibs.end(); ++it) {
-			ld::dylib::File* dylibFile = it->second;
-			bool searchThisDylib = false;
-			if ( _options.nameSpace() == Options::kTwoLevelNameSpace ) {
-				// for two level namesapce, just check all implicitly linked dylibs
-				searchThisDylib = dylibFile->implicitlyLinked() && !dylibFile->explicitlyLinked();
+
+bool InputFiles::addToIndirectIndex(ld::dylib::File* dylib) const
+{
+	const uint32_t library = (uint32_t)_indirectDylibs.size();
+	return dylib->forEachSearchableName(^(const char* symbolName) {
+		const uint32_t entry = (uint32_t)_searchIndexEntries.size();
+		const auto pos = _indirectDylibsIndex.find(symbolName);
+		if ( pos == _indirectDylibsIndex.end() ) {
+			_indirectDylibsIndex[symbolName] = { entry, entry };
+			_searchIndexEntries.push_back({ library, kSearchIndexEnd });
+			return;
+		}
+		// keep the chain in install path order, dylibs are indexed mostly in that order so this is usually an append
+		SearchIndexChain& chain = pos->second;
+		if ( _searchIndexEntries[chain.last].library == library )
+			return;
+		if ( !installPathLess(dylib, _indirectDylibs[_searchIndexEntries[chain.last].library]) ) {
+			_searchIndexEntries[chain.last].next = entry;
+			chain.last = entry;
+			_searchIndexEntries.push_back({ library, kSearchIndexEnd });
+		}
+		else if ( installPathLess(dylib, _indirectDylibs[_searchIndexEntries[chain.first].library]) ) {
+			_searchIndexEntries.push_back({ library, chain.first });
+			chain.first = entry;
+		}
+		else {
+			uint32_t prev = chain.first;
+			while ( !installPathLess(dylib, _indirectDylibs[_searchIndexEntries[_searchIndexEntries[prev].next].library]) )
+				prev = _searchIndexEntries[prev].next;
+			if ( _searchIndexEntries[prev].library == library )
+				return;
+			_searchIndexEntries.push_back({ library, _searchIndexEntries[prev].next });
+			_searchIndexEntries[prev].next = entry;
+		}
+	});
+}
+
+
+void InputFiles::updateSearchIndex() const
+{
+	// keep a running count of dylibs so -print_statistics can tell how many probes the index saved
+	if ( _searchLibrariesDylibCount.empty() )
+		_searchLibrariesDylibCount.push_back(0);
+	while ( _searchLibrariesDylibCount.size() <= _searchLibraries.size() ) {
+		const LibraryInfo& lib = _searchLibraries[_searchLibrariesDylibCount.size()-1];
+		_searchLibrariesDylibCount.push_back(_searchLibrariesDylibCount.back() + (lib.isDylib() ? 1 : 0));
+	}
+
+	// Index libraries added since last time.  A dylib can't list its names until its re-exports
+	// are bound, so stop there and let searchLibraries() probe the rest of the list in order.
+	// Libraries that can't list their names at all (e.g. dylibs with lazy exports) are always probed.
+	while ( _searchLibrariesIndexed < _searchLibraries.size() ) {
+		const LibraryInfo& lib = _searchLibraries[_searchLibrariesIndexed];
+		const ld::File* file = lib.archive();
+		if ( lib.isDylib() ) {
+			if ( !lib.dylib()->indirectLibrariesProcessed() )
+				break;
+			file = lib.dylib();
+		}
+		if ( !this->addToSearchIndex(_searchLibrariesIndex, file, _searchLibrariesIndexed) )
+			_unindexedSearchLibraries.push_back(_searchLibrariesIndexed);
+		++_searchLibrariesIndexed;
+	}
+
+	// index new indirect dylibs, every dylib in _installPathToDylibs is also in _allDylibs
+	// the dylib lists are kept in install path order, so searchLibraries() can merge them without sorting
+	if ( _seenDylibs.size() != _allDylibs.size() ) {
+		for (ld::dylib::File* dylib : _allDylibs) {
+			if ( _seenDylibs.insert(dylib).second )
+				insertByInstallPath(_pendingIndirectDylibs, dylib);
+		}
+	}
+	if ( !_pendingIndirectDylibs.empty() ) {
+		std::vector<ld::dylib::File*> stillPending;
+		for (ld::dylib::File* dylib : _pendingIndirectDylibs) {
+			if ( !dylib->indirectLibrariesProcessed() )
+				stillPending.push_back(dylib);
+			else if ( this->addToIndirectIndex(dylib) )
+				_indirectDylibs.push_back(dylib);
+			else
+				insertByInstallPath(_unindexedIndirectDylibs, dylib);
+		}
+		_pendingIndirectDylibs.swap(stillPending);
+	}
+}
+
+
+bool InputFiles::searchLibrary(const LibraryInfo& lib, const char* name, bool searchDylibs, bool searchArchives, bool dataSymbolOnly, ld::File::AtomHandler& handler) const
+{
+	if (lib.isDylib()) {
+		if (searchDylibs) {
+			ld::dylib::File *dylibFile = lib.dylib();
+			++_librarySearchProbes;
+			//fprintf(stderr, "searchLibraries(%s), looking in linked %s\n", name, dylibFile->path() );
+			if ( dylibFile->justInTimeforEachAtom(name, handler) ) {
+				// we found a definition in this dylib
+				// done, unless it is a weak definition in which case we keep searching
+				_options.snapshot().recordDylibSymbol(dylibFile, name);
+				if ( !dylibFile->hasWeakExternals() || !dylibFile->hasWeakDefinition(name)) {
+					return true;
+				}
+				// else continue search for a non-weak definition
 			}
-			else {
-				// for flat namespace, check all indirect dylibs
-				searchThisDylib = ! dylibFile->explicitlyLinked();
+		}
+	} else {
+		if (searchArchives) {
+			ld::archive::File *archiveFile = lib.archive();
+			++_librarySearchProbes;
+			if ( dataSymbolOnly ) {
+				if ( archiveFile->justInTimeDataOnlyforEachAtom(name, handler) ) {
+					if ( _options.traceArchives() || _options.traceEmitJSON())
+						logArchive(archiveFile);
+					_options.snapshot().recordArchive(archiveFile->path());
+					// DALLAS _state.archives.push_back(archiveFile);
+					// found data definition in static library, done
+					return true;
+				}
 			}
-			if ( searchThisDylib ) {
-				//fprintf(stderr, "searchLibraries(%s), looking in implicitly linked %s\n", name, dylibFile->path() );
-				if ( dylibFile->justInTimeforEachAtom(name, handler) ) {
-					// we found a definition in this dylib
-					// done, unless it is a weak definition in which case we keep searching
-                    _options.snapshot().recordDylibSymbol(dylibFile, name);
-					if ( !dylibFile->hasWeakExternals() || !dylibFile->hasWeakDefinition(name)) {
-						return true;
-                    }
-					// else continue search for a non-weak definition
+			else {
+				if ( archiveFile->justInTimeforEachAtom(name, handler) ) {
+					if ( _options.traceArchives() || _options.traceEmitJSON())
+						logArchive(archiveFile);
+					_options.snapshot().recordArchive(archiveFile->path());
+					// found definition in static library, done
+					return true;
 				}
-			}			
+			}
+		}
+	}
+	return false;
+}
+
+
+bool InputFiles::searchIndirectDylib(ld::dylib::File* dylibFile, const char* name, ld::File::AtomHandler& handler) const
+{
+	bool searchThisDylib = false;
+	if ( _options.nameSpace() == Options::kTwoLevelNameSpace ) {
+		// for two level namesapce, just check all implicitly linked dylibs
+		searchThisDylib = dylibFile->implicitlyLinked() && !dylibFile->explicitlyLinked();
+	}
+	else {
+		// for flat namespace, check all indirect dylibs
+		searchThisDylib = ! dylibFile->explicitlyLinked();
+	}
+	if ( searchThisDylib ) {
+		//fprintf(stderr, "searchLibraries(%s), looking in implicitly linked %s\n", name, dylibFile->path() );
+		++_librarySearchProbes;
+		if ( dylibFile->justInTimeforEachAtom(name, handler) ) {
+			// we found a definition in this dylib
+			// done, unless it is a weak definition in which case we keep searching
+			_options.snapshot().recordDylibSymbol(dylibFile, name);
+			if ( !dylibFile->hasWeakExternals() || !dylibFile->hasWeakDefinition(name)) {
+				return true;
+			}
+			// else continue search for a non-weak definition
+		}
+	}
+	return false;
+}
+
+
+bool InputFiles::searchLibraries(const char* name, bool searchDylibs, bool searchArchives, bool dataSymbolOnly, ld::File::AtomHandler& handler) const
+{
+	this->updateSearchIndex();
+
+	// Check each input library that might define name, in command line order.  That is the
+	// libraries the index lists for name, merged with the ones that could not be indexed,
+	// followed by any not yet indexed.
+	const uint64_t probesAtStart = _librarySearchProbes;
+	uint32_t searched = (uint32_t)_searchLibraries.size();
+	bool found = false;
+	uint32_t entry = kSearchIndexEnd;
+	const auto indexPos = _searchLibrariesIndex.find(name);
+	if ( indexPos != _searchLibrariesIndex.end() )
+		entry = indexPos->second.first;
+	auto unindexed = _unindexedSearchLibraries.begin();
+	while ( !found ) {
+		uint32_t slot;
+		if ( (entry != kSearchIndexEnd) && ((unindexed == _unindexedSearchLibraries.end()) || (_searchIndexEntries[entry].library < *unindexed)) ) {
+			slot = _searchIndexEntries[entry].library;
+			entry = _searchIndexEntries[entry].next;
+		}
+		else if ( unindexed != _unindexedSearchLibraries.end() ) {
+			slot = *unindexed++;
+		}
+		else {
+			break;
+		}
+		if ( this->searchLibrary(_searchLibraries[slot], name, searchDylibs, searchArchives, dataSymbolOnly, handler) ) {
+			found = true;
+			searched = slot+1;
+		}
+	}
+	for (uint32_t slot=_searchLibrariesIndexed; !found && (slot < _searchLibraries.size()); ++slot) {
+		if ( this->searchLibrary(_searchLibraries[slot], name, searchDylibs, searchArchives, dataSymbolOnly, handler) ) {
+			found = true;
+			searched = slot+1;
+		}
+	}
+	// a linear search would have probed every matching library up to where the search stopped
+	const uint32_t dylibsSearched = _searchLibrariesDylibCount[searched];
+	const uint64_t linearProbes = (searchDylibs ? dylibsSearched : 0) + (searchArchives ? (searched - dylibsSearched) : 0);
+	_librarySearchProbesAvoided += linearProbes - (_librarySearchProbes - probesAtStart);
+	if ( found )
+		return true;
+
+	// search indirect dylibs
+	if ( searchDylibs ) {
+		// Merge the dylibs the index lists for name with the ones that can't be indexed (yet).  All
+		// three are in install path order, which is the order of _installPathToDylibs.
+		entry = kSearchIndexEnd;
+		const auto pos = _indirectDylibsIndex.find(name);
+		if ( pos != _indirectDylibsIndex.end() )
+			entry = pos->second.first;
+		auto unindexedDylib = _unindexedIndirectDylibs.cbegin();
+		auto pendingDylib = _pendingIndirectDylibs.cbegin();
+		const uint64_t indirectProbesAtStart = _librarySearchProbes;
+		while ( true ) {
+			ld::dylib::File* dylibFile = (entry != kSearchIndexEnd) ? _indirectDylibs[_searchIndexEntries[entry].library] : NULL;
+			if ( (unindexedDylib != _unindexedIndirectDylibs.cend()) && ((dylibFile == NULL) || installPathLess(*unindexedDylib, dylibFile)) )
+				dylibFile = *unindexedDylib;
+			if ( (pendingDylib != _pendingIndirectDylibs.cend()) && ((dylibFile == NULL) || installPathLess(*pendingDylib, dylibFile)) )
+				dylibFile = *pendingDylib;
+			if ( dylibFile == NULL )
+				break;
+			if ( (unindexedDylib != _unindexedIndirectDylibs.cend()) && (*unindexedDylib == dylibFile) )
+				++unindexedDylib;
+			else if ( (pendingDylib != _pendingIndirectDylibs.cend()) && (*pendingDylib == dylibFile) )
+				++pendingDylib;
+			else
+				entry = _searchIndexEntries[entry].next;
+			// only search dylibs currently in _installPathToDylibs
+			if ( dylibFile->installPath() == NULL )
+				continue;
+			InstallNameToDylib::const_iterator mapPos = _installPathToDylibs.find(dylibFile->installPath());
+			if ( (mapPos == _installPathToDylibs.end()) || (mapPos->second != dylibFile) )
+				continue;
+			if ( this->searchIndirectDylib(dylibFile, name, handler) )
+				return true;
 		}
+		// only misses are counted, a linear search would have probed (at most) every dylib in the map
+		_librarySearchProbesAvoided += _installPathToDylibs.size() - (_librarySearchProbes - indirectProbesAtStart);
 	}
 
 	return false;
@@ -49,10 +49,13 @@
 
 #include "Options.h"
 #include "ld.hpp"
+#include "macho_relocatable_file.h"
 
 namespace ld {
 namespace tool {
 
+class Incremental;
+
 class InputFiles : public ld::dylib::File::DylibHandler
 {
 public:
@@ -76,17 +79,25 @@ public:
 	void						createIndirectDylibs();
 	size_t						count() const { return _inputFiles.size(); }
 
+	// parser settings for object files, shared with -incremental which re-parses changed object files
+	static mach_o::relocatable::ParserOptions	objectParserOptions(const Options& options);
+	// -incremental records the atoms of command line object files before they are resolved
+	void						setIncremental(Incremental* incremental) { _incremental = incremental; }
+
 	// for -print_statistics
 	volatile int64_t			_totalObjectSize;
 	volatile int64_t			_totalArchiveSize;
 	volatile int32_t			_totalObjectLoaded;
 	volatile int32_t			_totalArchivesLoaded;
 	         int32_t			_totalDylibsLoaded;
+	mutable uint64_t			_librarySearchProbes;
+	mutable uint64_t			_librarySearchProbesAvoided;
 	
 	
 private:
 	void						inferArchitecture(Options& opts, const char** archName);
 	const char* 				extractFileInfo(const uint8_t* p, unsigned len, const char* path, ld::Platform& platform);
+	void						prefetchInputFiles() const;
 	ld::File*					makeFile(const Options::FileInfo& info, bool indirectDylib);
 	ld::File*					addDylib(ld::dylib::File* f,        const Options::FileInfo& info);
 	void						logTraceInfo (const char* format, ...) const;
@@ -118,6 +129,7 @@ private:
 	std::set<ld::dylib::File*>	_allDylibs;
 	uint64_t					_numProcessedIndirectDylibs = 0;
 	ld::dylib::File*			_bundleLoader;
+	Incremental*				_incremental = nullptr;
     struct strcompclass {
         bool operator() (const char *a, const char *b) const { return ::strcmp(a, b) < 0; }
     };
@@ -151,6 +163,31 @@ private:
         ld::archive::File *archive() const { return (ld::archive::File*)_lib; }
     };
     std::vector<LibraryInfo>  _searchLibraries;
+
+	// Index from symbol name to the libraries that might define it, so searchLibraries() probes
+	// just those libraries instead of all of them.  Each name maps to the first entry of a chain
+	// in _searchIndexEntries, and keeps the last entry so appending is constant time.  The index is
+	// extended as libraries get added.
+	struct SearchIndexEntry { uint32_t library; uint32_t next; };
+	struct SearchIndexChain { uint32_t first; uint32_t last; };
+
+	bool						searchLibrary(const LibraryInfo& lib, const char* name, bool searchDylibs, bool searchArchives,
+											  bool dataSymbolOnly, ld::File::AtomHandler&) const;
+	bool						searchIndirectDylib(ld::dylib::File* dylibFile, const char* name, ld::File::AtomHandler&) const;
+	void						updateSearchIndex() const;
+	bool						addToSearchIndex(ld::StringViewMap<SearchIndexChain>& index, const ld::File* file, uint32_t library) const;
+	bool						addToIndirectIndex(ld::dylib::File* dylib) const;
+
+	mutable ld::StringViewMap<SearchIndexChain>	_searchLibrariesIndex;		// name -> slots in _searchLibraries
+	mutable ld::StringViewMap<SearchIndexChain>	_indirectDylibsIndex;		// name -> slots in _indirectDylibs
+	mutable std::vector<SearchIndexEntry>	_searchIndexEntries;
+	mutable uint32_t						_searchLibrariesIndexed = 0;	// slots before this are in the index
+	mutable std::vector<uint32_t>			_unindexedSearchLibraries;	// slots that can't list their names
+	mutable std::vector<uint32_t>			_searchLibrariesDylibCount;	// number of dylibs before each slot
+	mutable ld::Set<ld::dylib::File*>		_seenDylibs;
+	mutable std::vector<ld::dylib::File*>	_indirectDylibs;
+	mutable std::vector<ld::dylib::File*>	_unindexedIndirectDylibs;	// can't list their names, in install path order
+	mutable std::vector<ld::dylib::File*>	_pendingIndirectDylibs;		// re-exports not processed yet, in install path order
 };
 
 } // namespace tool 
@@ -0,0 +1,578 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <mach-o/dyld.h>
+#include <mach-o/loader.h>
+#include <mach-o/stab.h>
+
+#include <vector>
+#include <string>
+#include <set>
+#include <algorithm>
+
+#include "LinkCache.h"
+#include "TaskPool.h"
+#include "ld.hpp"
+#include "sha256_mb.h" // ld64-port
+
+extern const char ld_classicVersionString[];
+extern char** environ;
+
+namespace ld {
+namespace tool {
+
+// change when anything saved in an entry changes
+static const char kEntryMagic[8] = "ldlc01";
+static const char kEntrySuffix[] = ".ldcache";
+
+
+//
+// Entries are only read back by the same linker on the same machine, so values are saved in
+// host byte order.
+//
+class EntryWriter
+{
+public:
+	void		u8(uint8_t value)			{ _bytes.push_back(value); }
+	void		u32(uint32_t value)			{ _bytes.insert(_bytes.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value)); }
+	void		u64(uint64_t value)			{ _bytes.insert(_bytes.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value)); }
+	void		bytes(const void* p, size_t len) { _bytes.insert(_bytes.end(), (const uint8_t*)p, (const uint8_t*)p + len); }
+	void		str(const std::string& s)	{ u32((uint32_t)s.size()); bytes(s.data(), s.size()); }
+	const std::vector<uint8_t>& content() const { return _bytes; }
+
+private:
+	std::vector<uint8_t>	_bytes;
+};
+
+class EntryReader
+{
+public:
+				EntryReader(const uint8_t* start, const uint8_t* end) : _p(start), _end(end), _ok(true) { }
+
+	bool		ok() const					{ return _ok; }
+	const uint8_t* position() const			{ return _p; }
+	uint8_t		u8()						{ uint8_t v = 0;  read(&v, sizeof(v)); return v; }
+	uint32_t	u32()						{ uint32_t v = 0; read(&v, sizeof(v)); return v; }
+	uint64_t	u64()						{ uint64_t v = 0; read(&v, sizeof(v)); return v; }
+	void		read(void* value, size_t len) {
+					if ( !_ok || (len > (size_t)(_end - _p)) ) {
+						_ok = false;
+						return;
+					}
+					memcpy(value, _p, len);
+					_p += len;
+				}
+	const uint8_t* skip(uint64_t len) {
+					if ( !_ok || (len > (uint64_t)(_end - _p)) ) {
+						_ok = false;
+						return NULL;
+					}
+					const uint8_t* result = _p;
+					_p += len;
+					return result;
+				}
+	std::string	str() {
+					uint32_t len = u32();
+					const uint8_t* s = skip(len);
+					if ( s == NULL )
+						return std::string();
+					return std::string((const char*)s, len);
+				}
+
+private:
+	const uint8_t*	_p;
+	const uint8_t*	_end;
+	bool			_ok;
+};
+
+
+
+// SHA-256 of the file's content, and whether it is a mach-o object file
+static bool digestFile(const char* path, uint64_t size, uint8_t digest[SHA256_DIGEST_SIZE], bool& isObjectFile)
+{
+	isObjectFile = false;
+	static const uint8_t empty = 0;
+	const uint8_t* content = &empty;
+	if ( size != 0 ) {
+		int fd = ::open(path, O_RDONLY, 0);
+		if ( fd == -1 )
+			return false;
+		void* p = ::mmap(NULL, size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if ( p == MAP_FAILED )
+			return false;
+		content = (const uint8_t*)p;
+		ld::utils::adviseWillNeed(content, size);
+	}
+	size_t length = size;
+	SHA256_Multi(&content, &length, 1, (uint8_t (*)[SHA256_DIGEST_SIZE])digest);
+	if ( size >= sizeof(mach_header) ) {
+		const mach_header* mh = (const mach_header*)content;
+		isObjectFile = ((mh->magic == MH_MAGIC) || (mh->magic == MH_MAGIC_64)) && (mh->filetype == MH_OBJECT);
+	}
+	if ( size != 0 )
+		::munmap((void*)content, size);
+	return true;
+}
+
+
+static void hashString(SHA256_CTX* ctx, const char* s)
+{
+	SHA256_Update(ctx, (const uint8_t*)s, strlen(s)+1);
+}
+
+
+// environment variables the linker reads, besides -threads, change what it writes
+static bool outputDependsOn(const char* variable)
+{
+	if ( strncmp(variable, "LD_THREADS=", 11) == 0 )
+		return false;
+	if ( (strncmp(variable, "LD_", 3) == 0) || (strncmp(variable, "RC_", 3) == 0) )
+		return true;
+	if ( (strncmp(variable, "ZERO_AR_DATE=", 13) == 0) || (strncmp(variable, "SDKROOT=", 8) == 0) )
+		return true;
+	const char* equals = strchr(variable, '=');
+	return (equals != NULL) && (equals - variable > 18) && (strncmp(equals-18, "_DEPLOYMENT_TARGET", 18) == 0);
+}
+
+
+LinkCache::LinkCache(const Options& opts, int argc, const char* argv[])
+	: _options(opts), _argc(argc), _argv(argv), _usable(false), _hit(false), _saved(false),
+	  _warningsAtStart(opts.warningCount()), _inputBytesHashed(0)
+{
+	bzero(_argumentsDigest, sizeof(_argumentsDigest));
+	_outputs.push_back(_options.outputFilePath());
+	if ( _options.generatedMapPath() != NULL )
+		_outputs.push_back(_options.generatedMapPath());
+	if ( _options.dumpDependencyInfo() )
+		_outputs.push_back(_options.dependencyInfoPath());
+
+	// an entry only holds the output files, so links that write or print anything else are not cached
+	if ( _options.whyLoad() || _options.printWhyLive() || _options.logAllFiles() || _options.traceArchives()
+		|| _options.traceDylibs() || _options.printOrderFileStatistics() || _options.traceSymbolLayout() )
+		_reason = "the link prints what it loads";
+	else if ( _options.bundleBitcode() || (_options.reverseSymbolMapPath() != NULL) || (_options.tempLtoObjectPath() != NULL) || _options.saveTempFiles() )
+		_reason = "the link writes files besides the output file, map file and dependency info";
+	else if ( _options.UUIDMode() == Options::kUUIDRandom )
+		_reason = "the output has a random UUID";
+	else {
+		for (const char* path : _outputs) {
+			struct stat statBuffer;
+			if ( (::stat(path, &statBuffer) == 0) && !S_ISREG(statBuffer.st_mode) ) {
+				_reason = std::string(path) + " is not a regular file";
+				break;
+			}
+		}
+	}
+	_usable = _reason.empty();
+	if ( _usable )
+		this->hashArguments();
+}
+
+
+void LinkCache::hashArguments()
+{
+	SHA256_CTX ctx;
+	SHA256_Init(&ctx);
+	hashString(&ctx, kEntryMagic);
+	hashString(&ctx, ld_classicVersionString);
+
+	// a rebuilt linker may link differently even if its version is unchanged
+	char linkerPath[PATH_MAX];
+	uint32_t bufSize = PATH_MAX;
+	struct stat statBuffer;
+	if ( (_NSGetExecutablePath(linkerPath, &bufSize) != -1) && (::stat(linkerPath, &statBuffer) == 0) ) {
+		uint64_t stamp[2] = { (uint64_t)statBuffer.st_size, ld::utils::modTimeNanoseconds(statBuffer) };
+		SHA256_Update(&ctx, (const uint8_t*)stamp, sizeof(stamp));
+	}
+
+	// relative paths on the command line depend on the current directory
+	char cwd[MAXPATHLEN];
+	if ( ::getcwd(cwd, sizeof(cwd)) != NULL )
+		hashString(&ctx, cwd);
+	for (int i=1; i < _argc; ++i) {
+		hashString(&ctx, _argv[i]);
+		// response files are expanded by Options, so their content is part of the arguments
+		if ( _argv[i][0] == '@' ) {
+			if ( (::stat(&_argv[i][1], &statBuffer) == 0) && S_ISREG(statBuffer.st_mode) ) {
+				uint8_t digest[SHA256_DIGEST_SIZE];
+				bool isObjectFile;
+				if ( digestFile(&_argv[i][1], statBuffer.st_size, digest, isObjectFile) )
+					SHA256_Update(&ctx, digest, sizeof(digest));
+			}
+		}
+	}
+
+	std::vector<std::string> variables;
+	for (char** e = environ; (e != NULL) && (*e != NULL); ++e) {
+		if ( outputDependsOn(*e) )
+			variables.push_back(*e);
+	}
+	std::sort(variables.begin(), variables.end());
+	for (const std::string& variable : variables)
+		hashString(&ctx, variable.c_str());
+
+	SHA256_Final(&ctx, _argumentsDigest);
+}
+
+
+std::string LinkCache::entryPath() const
+{
+	char leafName[64];
+	char* p = leafName;
+	*p++ = '/';
+	for (int i=0; i < 16; ++i)
+		p += snprintf(p, 3, "%02x", _argumentsDigest[i]);
+	*p = '\0';
+	return std::string(_options.linkCachePath()) + leafName + kEntrySuffix;
+}
+
+
+bool LinkCache::miss(const char* format, ...)
+{
+	char* reason;
+	va_list	list;
+	va_start(list, format);
+	vasprintf(&reason, format, list);
+	va_end(list);
+	_reason = reason;
+	free(reason);
+	return false;
+}
+
+
+bool LinkCache::checkInputs(const std::vector<Input>& inputs)
+{
+	// everything that can be checked without reading file content is checked first
+	for (const Input& input : inputs) {
+		struct stat statBuffer;
+		bool exists = (::stat(input.path.c_str(), &statBuffer) == 0);
+		if ( exists != input.exists )
+			return miss("%s %s", input.path.c_str(), exists ? "now exists" : "no longer exists");
+		if ( !exists )
+			continue;
+		if ( (uint64_t)statBuffer.st_size != input.size )
+			return miss("%s changed", input.path.c_str());
+		if ( (input.modTime != 0) && (ld::utils::modTimeNanoseconds(statBuffer) != input.modTime) )
+			return miss("%s changed", input.path.c_str());
+	}
+
+	std::vector<uint8_t> same(inputs.size(), false);
+	uint8_t* sameArray = same.data();
+	const Input* inputArray = inputs.data();
+	ld::parallelFor(inputs.size(), ^(size_t index) {
+		const Input& input = inputArray[index];
+		if ( !input.exists ) {
+			sameArray[index] = true;
+			return;
+		}
+		uint8_t digest[SHA256_DIGEST_SIZE];
+		bool isObjectFile;
+		if ( digestFile(input.path.c_str(), input.size, digest, isObjectFile) )
+			sameArray[index] = (memcmp(digest, input.digest, sizeof(digest)) == 0);
+	});
+	for (size_t i=0; i < inputs.size(); ++i) {
+		_inputBytesHashed += inputs[i].size;
+		if ( !same[i] )
+			return miss("%s changed", inputs[i].path.c_str());
+	}
+	return true;
+}
+
+
+bool LinkCache::restoreOutputs(const uint8_t* start, const uint8_t* end)
+{
+	EntryReader reader(start, end);
+	uint32_t count = reader.u32();
+	if ( !reader.ok() || (count != _outputs.size()) )
+		return miss("cache entry is for other output files");
+	std::vector<std::pair<const uint8_t*, uint64_t>> contents;
+	std::vector<uint32_t> modes;
+	for (uint32_t i=0; i < count; ++i) {
+		std::string path = reader.str();
+		uint32_t mode = reader.u32();
+		uint64_t size = reader.u64();
+		const uint8_t* content = reader.skip(size);
+		if ( !reader.ok() )
+			return miss("cache entry is damaged");
+		if ( path != _outputs[i] )
+			return miss("cache entry is for other output files");
+		contents.push_back(std::make_pair(content, size));
+		modes.push_back(mode);
+	}
+
+	for (uint32_t i=0; i < count; ++i) {
+		const std::pair<const uint8_t*, uint64_t>& content = contents[i];
+		const bool written = ld::utils::writeFileAtomically(_outputs[i], modes[i], false, [&content](int fd) {
+			return (ld::utils::write64(fd, content.first, content.second) == (ssize_t)content.second);
+		});
+		if ( !written )
+			throwf("can't write output file: %s, errno=%d", _outputs[i], errno);
+	}
+	return true;
+}
+
+
+bool LinkCache::restore()
+{
+	if ( !_usable )
+		return false;
+
+	std::string path = entryPath();
+	int fd = ::open(path.c_str(), O_RDONLY, 0);
+	if ( fd == -1 )
+		return miss("no cache entry for these arguments");
+	struct stat statBuffer;
+	if ( (::fstat(fd, &statBuffer) != 0) || (statBuffer.st_size < (off_t)sizeof(kEntryMagic)) ) {
+		::close(fd);
+		return miss("cache entry is damaged");
+	}
+	const uint64_t entrySize = statBuffer.st_size;
+	void* p = ::mmap(NULL, entrySize, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if ( p == MAP_FAILED )
+		return miss("can't map cache entry");
+	const uint8_t* start = (const uint8_t*)p;
+
+	bool result = false;
+	EntryReader reader(start, start+entrySize);
+	char magic[sizeof(kEntryMagic)];
+	uint8_t argumentsDigest[SHA256_DIGEST_SIZE];
+	reader.read(magic, sizeof(magic));
+	reader.read(argumentsDigest, sizeof(argumentsDigest));
+	uint32_t inputCount = reader.u32();
+	if ( !reader.ok() || (memcmp(magic, kEntryMagic, sizeof(magic)) != 0) )
+		miss("cache entry is damaged or from another linker");
+	else if ( memcmp(argumentsDigest, _argumentsDigest, sizeof(argumentsDigest)) != 0 )
+		miss("no cache entry for these arguments");
+	else if ( inputCount > entrySize/16 )
+		miss("cache entry is damaged");
+	else {
+		std::vector<Input> inputs(inputCount);
+		for (Input& input : inputs) {
+			input.opcode	= reader.u8();
+			input.path		= reader.str();
+			input.exists	= reader.u8();
+			input.size		= reader.u64();
+			input.modTime	= reader.u64();
+			reader.read(input.digest, sizeof(input.digest));
+		}
+		if ( !reader.ok() )
+			miss("cache entry is damaged");
+		else if ( checkInputs(inputs) && restoreOutputs(reader.position(), start+entrySize) ) {
+			// an entry's modification time is when it was last used, which is what pruning goes by
+			::utimes(path.c_str(), NULL);
+			_hit = true;
+			result = true;
+		}
+	}
+	::munmap(p, entrySize);
+	return result;
+}
+
+
+void LinkCache::collectInputs(const ld::Internal& state, std::vector<Input>& inputs) const
+{
+	// if the debug map records object file modification times, those have to match too
+	bool debugMapTimes = false;
+	for (const ld::relocatable::File::Stab& stab : state.stabs) {
+		if ( (stab.type == N_OSO) && (stab.value != 0) ) {
+			debugMapTimes = true;
+			break;
+		}
+	}
+
+	__block std::set<std::pair<uint8_t, std::string>> seen;
+	std::vector<Input>* result = &inputs;
+	_options.forEachDependency(^(uint8_t opcode, const char* depPath) {
+		if ( opcode == Options::depOutputFile )
+			return;
+		if ( !seen.insert(std::make_pair(opcode, std::string(depPath))).second )
+			return;
+		Input input;
+		input.opcode	= opcode;
+		input.path		= depPath;
+		input.exists	= false;
+		input.size		= 0;
+		input.modTime	= 0;
+		bzero(input.digest, sizeof(input.digest));
+		result->push_back(input);
+	});
+
+	Input* inputArray = inputs.data();
+	ld::parallelFor(inputs.size(), ^(size_t index) {
+		Input& input = inputArray[index];
+		struct stat statBuffer;
+		if ( ::stat(input.path.c_str(), &statBuffer) != 0 )
+			return;
+		bool isObjectFile;
+		if ( !digestFile(input.path.c_str(), statBuffer.st_size, input.digest, isObjectFile) )
+			return;
+		input.exists	= true;
+		input.size		= statBuffer.st_size;
+		input.modTime	= (debugMapTimes && isObjectFile) ? ld::utils::modTimeNanoseconds(statBuffer) : 0;
+	});
+}
+
+
+void LinkCache::save(const ld::Internal& state)
+{
+	if ( !_usable )
+		return;
+	// warnings printed during the link would be lost when the entry is used
+	if ( _options.warningCount() != _warningsAtStart ) {
+		_notSavedReason = "the link printed warnings";
+		return;
+	}
+
+	std::vector<Input> inputs;
+	this->collectInputs(state, inputs);
+	EntryWriter writer;
+	writer.bytes(kEntryMagic, sizeof(kEntryMagic));
+	writer.bytes(_argumentsDigest, sizeof(_argumentsDigest));
+	writer.u32((uint32_t)inputs.size());
+	for (const Input& input : inputs) {
+		writer.u8(input.opcode);
+		writer.str(input.path);
+		writer.u8(input.exists);
+		writer.u64(input.size);
+		writer.u64(input.modTime);
+		writer.bytes(input.digest, sizeof(input.digest));
+	}
+	writer.u32((uint32_t)_outputs.size());
+
+	const bool written = ld::utils::writeFileAtomically(entryPath(), 0600, true, [&](int fd) {
+		if ( ld::utils::write64(fd, writer.content().data(), writer.content().size()) != (ssize_t)writer.content().size() )
+			return false;
+		for (const char* outputPath : _outputs) {
+			bool outputWritten = false;
+			int outputFd = ::open(outputPath, O_RDONLY, 0);
+			if ( outputFd == -1 )
+				return false;
+			struct stat statBuffer;
+			if ( ::fstat(outputFd, &statBuffer) == 0 ) {
+				EntryWriter header;
+				header.str(outputPath);
+				header.u32(statBuffer.st_mode & 07777);
+				header.u64(statBuffer.st_size);
+				const uint64_t size = statBuffer.st_size;
+				void* content = (size == 0) ? NULL : ::mmap(NULL, size, PROT_READ, MAP_FILE | MAP_PRIVATE, outputFd, 0);
+				if ( content != MAP_FAILED ) {
+					outputWritten = (ld::utils::write64(fd, header.content().data(), header.content().size()) == (ssize_t)header.content().size())
+									&& ((size == 0) || (ld::utils::write64(fd, content, size) == (ssize_t)size));
+					if ( content != NULL )
+						::munmap(content, size);
+				}
+			}
+			::close(outputFd);
+			if ( !outputWritten )
+				return false;
+		}
+		return true;
+	});
+	if ( !written ) {
+		_notSavedReason = "unable to write link cache entry";
+		return;
+	}
+	_saved = true;
+	this->prune();
+}
+
+
+void LinkCache::prune() const
+{
+	struct CacheFile {
+		std::string		path;
+		uint64_t		size;
+		uint64_t		used;
+	};
+	const char* cacheDir = _options.linkCachePath();
+	DIR* dir = ::opendir(cacheDir);
+	if ( dir == NULL )
+		return;
+	std::vector<CacheFile> entries;
+	uint64_t totalSize = 0;
+	const time_t now = ::time(NULL);
+	while ( struct dirent* dp = ::readdir(dir) ) {
+		const char* suffix = strstr(dp->d_name, kEntrySuffix);
+		if ( suffix == NULL )
+			continue;
+		std::string path = std::string(cacheDir) + "/" + dp->d_name;
+		struct stat statBuffer;
+		if ( (::lstat(path.c_str(), &statBuffer) != 0) || !S_ISREG(statBuffer.st_mode) )
+			continue;
+		// this also removes temporary files left behind by links that did not finish saving
+		if ( (_options.linkCacheMaxAge() != 0) && (now - statBuffer.st_mtime > (time_t)_options.linkCacheMaxAge()) ) {
+			::unlink(path.c_str());
+			continue;
+		}
+		// temporary files of links that are saving right now are left alone
+		if ( strcmp(suffix, kEntrySuffix) != 0 )
+			continue;
+		entries.push_back({ path, (uint64_t)statBuffer.st_size, ld::utils::modTimeNanoseconds(statBuffer) });
+		totalSize += statBuffer.st_size;
+	}
+	::closedir(dir);
+
+	// remove the least recently used entries until the cache is small enough
+	const uint64_t maxSize = _options.linkCacheMaxSize() * 1024 * 1024;
+	std::sort(entries.begin(), entries.end(), [](const CacheFile& a, const CacheFile& b) {
+		return (a.used < b.used);
+	});
+	for (const CacheFile& entry : entries) {
+		if ( totalSize <= maxSize )
+			break;
+		::unlink(entry.path.c_str());
+		totalSize -= entry.size;
+	}
+}
+
+
+void LinkCache::printStatistics() const
+{
+	if ( !_usable )
+		fprintf(stderr, "link cache not used: %s\n", _reason.c_str());
+	else if ( _hit )
+		fprintf(stderr, "link cache hit, checked %llu bytes of input files\n", (unsigned long long)_inputBytesHashed);
+	else if ( _saved )
+		fprintf(stderr, "link cache miss: %s, saved output files\n", _reason.c_str());
+	else
+		fprintf(stderr, "link cache miss: %s, not saved: %s\n", _reason.c_str(), _notSavedReason.c_str());
+}
+
+
+} // namespace tool
+} // namespace ld
@@ -0,0 +1,97 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __LINK_CACHE_H__
+#define __LINK_CACHE_H__
+
+#include <stdint.h>
+
+#include <vector>
+#include <string>
+
+#include "Options.h"
+#include "ld.hpp"
+
+namespace ld {
+namespace tool {
+
+//
+// -link_cache_path keeps the output files of links in a cache directory, one entry per set of
+// arguments.  The entry is named after a SHA-256 of the linker, the current directory, the
+// arguments and the environment variables the linker reads.  It holds every dependency of the
+// link (the files -dependency_info lists, including library search paths that were probed and
+// not found) with a SHA-256 of its content, followed by the output file, the map file and the
+// dependency info file.
+//
+// restore() is called before any input file is parsed.  If the entry for these arguments has
+// the same dependencies with the same content, its files are copied into place and the link is
+// done.  Otherwise the link runs and save() replaces the entry once the output files are
+// written.  Entries not used for -link_cache_max_age seconds, and the least recently used
+// entries beyond -link_cache_max_size megabytes, are removed after each save().
+//
+class LinkCache
+{
+public:
+							LinkCache(const Options& opts, int argc, const char* argv[]);
+
+	// returns true if the output files of an earlier link were copied into place, and no link is needed
+	bool					restore();
+	// called once all output files are written
+	void					save(const ld::Internal& state);
+	void					printStatistics() const;
+
+private:
+	struct Input {
+		uint8_t				opcode;
+		std::string			path;
+		bool				exists;
+		uint64_t			size;
+		uint64_t			modTime;			// only recorded for object files if the debug map has their times
+		uint8_t				digest[32];
+	};
+
+	void					hashArguments();
+	std::string				entryPath() const;
+	bool					miss(const char* format, ...) __attribute__((format(printf, 2, 3)));
+	bool					checkInputs(const std::vector<Input>& inputs);
+	bool					restoreOutputs(const uint8_t* start, const uint8_t* end);
+	void					collectInputs(const ld::Internal& state, std::vector<Input>& inputs) const;
+	void					prune() const;
+
+	const Options&				_options;
+	int							_argc;
+	const char**				_argv;
+	uint8_t						_argumentsDigest[32];
+	std::vector<const char*>	_outputs;			// output file, then map and dependency info files if any
+	std::string					_reason;			// why the cache can't be used, or why it missed
+	std::string					_notSavedReason;
+	bool						_usable;
+	bool						_hit;
+	bool						_saved;
+	uint32_t					_warningsAtStart;
+	uint64_t					_inputBytesHashed;
+};
+
+} // namespace tool
+} // namespace ld
+
+#endif // __LINK_CACHE_H__
@@ -2198,6 +2198,8 @@ public:
 	virtual void								encode() const;
 
 			void								hash(uint8_t* wholeFileBuffer) const;
+	// sets the hash types, identifier, flags, and exec segment, also used when -incremental re-signs an output
+	static	void								configure(const Options& opts, libcd* sigRef, uint64_t textSize);
 
 private:
 	const Options& 				_opts;
@@ -2219,10 +2221,25 @@ void CodeSignatureAtom::encode() const
 	// create code signing object
 	_sigRef = libcd_create(inBbufferSize);
 
+	configure(_opts, _sigRef, OutputFile::codeSignatureTextSize(_state));
+
+	// allocate space for code-signature (never used, sign is written directly to output buffer in hash())
+	this->_encodedData.alloc(libcd_superblob_size(_sigRef));
+
+	// align to pointer size
+	this->_encodedData.pad_to_size(8);
+	this->_encoded = true;
+
+	// update section size now that code signature size + padding is known
+	codeSignSect->size = this->_encodedData.size();
+}
+
+void CodeSignatureAtom::configure(const Options& opts, libcd* sigRef, uint64_t textSize)
+{
 	// figure out which hashes to use
 	__block ld::Platform sig_platform = ld::Platform::unknown;
 	__block uint32_t     sig_min_version;
-	_opts.platforms().forEach(^(ld::Platform platform, uint32_t minVersion, uint32_t sdkVersion, bool& stop) {
+	opts.platforms().forEach(^(ld::Platform platform, uint32_t minVersion, uint32_t sdkVersion, bool& stop) {
 		switch ( platform ) {
 		case Platform::unknown:
 		case Platform::freestanding:
@@ -2249,39 +2266,21 @@ void CodeSignatureAtom::encode() const
 			break;
 		}
 	});
-	if ( libcd_set_hash_types_for_platform_version(_sigRef, (int)sig_platform, (int)sig_min_version) != LIBCD_SET_HASH_TYPE_SUCCESS )
+	if ( libcd_set_hash_types_for_platform_version(sigRef, (int)sig_platform, (int)sig_min_version) != LIBCD_SET_HASH_TYPE_SUCCESS )
 		throw "can't determine codesign hash for output platform";
 
 	// set identifier (use installPath() because it returns a stable name)
-	const char* path      = _opts.installPath();
+	const char* path      = opts.installPath();
 	const char* lastSlash = strrchr(path, '/');
 	const char* leafName  = (lastSlash != nullptr) ? lastSlash+1 : path;
-	libcd_set_signing_id(_sigRef, leafName);
+	libcd_set_signing_id(sigRef, leafName);
 
 	// add flags
-	libcd_set_flags(_sigRef, CS_ADHOC | CS_LINKER_SIGNED);
+	libcd_set_flags(sigRef, CS_ADHOC | CS_LINKER_SIGNED);
 
 	// set range of __TEXT
-	uint64_t flags = _opts.linkingMainExecutable() ? CS_EXECSEG_MAIN_BINARY : 0;
-	uint64_t textSize = 0;
-	bool foundText = false;
-	for (const Internal::FinalSection* sect : _state.sections) {
-		if ( strcmp(sect->segmentName(), "__TEXT") == 0 )
-			foundText = true;
-		else if ( foundText && (textSize == 0) ) // find first section after __TEXT
-			textSize = sect->fileOffset;
-	}
-	libcd_set_exec_seg(_sigRef, 0, textSize, flags);
-
-	// allocate space for code-signature (never used, sign is written directly to output buffer in hash())
-	this->_encodedData.alloc(libcd_superblob_size(_sigRef));
-
-	// align to pointer size
-	this->_encodedData.pad_to_size(8);
-	this->_encoded = true;
-
-	// update section size now that code signature size + padding is known
-	codeSignSect->size = this->_encodedData.size();
+	uint64_t flags = opts.linkingMainExecutable() ? CS_EXECSEG_MAIN_BINARY : 0;
+	libcd_set_exec_seg(sigRef, 0, textSize, flags);
 }
 
 void CodeSignatureAtom::hash(uint8_t* wholeFileBuffer) const
@@ -0,0 +1,765 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+#include "LinkServer.h"
+#include "Options.h"
+
+extern char** environ;
+
+namespace ld {
+namespace server {
+
+// change when the request format changes
+static const uint32_t	kRequestMagic = 0x6c647332;		// 'lds2'
+// sent instead of an exit status when the server can't link like the client would
+static const uint32_t	kRequestRefused = 0xFFFFFFFF;
+// the server stops taking blobs once it holds this many bytes
+static const uint64_t	kMaxBlobBytes = 1024ULL*1024*1024;
+
+
+typedef std::unordered_map<std::string, std::vector<uint8_t> > BlobMap;
+
+// blobs the server holds, a child sees them as they were when it was forked
+static BlobMap*					sBlobs = nullptr;
+static uint64_t					sBlobBytes = 0;
+// in a child, where keepBlob() sends blobs to the server
+static int						sBlobFd = -1;
+static std::mutex				sBlobLock;
+static std::atomic<uint32_t>	sBlobsFound(0);
+static std::atomic<uint32_t>	sBlobsKept(0);
+// SIGCHLD wakes up the server's poll() through this pipe
+static int						sChildPipe[2] = { -1, -1 };
+
+
+static bool writeAll(int fd, const void* buffer, size_t size)
+{
+	const uint8_t* p = (const uint8_t*)buffer;
+	while ( size != 0 ) {
+		ssize_t amount = ::write(fd, p, size);
+		if ( amount == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		p += amount;
+		size -= amount;
+	}
+	return true;
+}
+
+static bool readAll(int fd, void* buffer, size_t size)
+{
+	uint8_t* p = (uint8_t*)buffer;
+	while ( size != 0 ) {
+		ssize_t amount = ::read(fd, p, size);
+		if ( amount == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			return false;
+		}
+		if ( amount == 0 )
+			return false;
+		p += amount;
+		size -= amount;
+	}
+	return true;
+}
+
+static void appendUInt32(std::vector<uint8_t>& buffer, uint32_t value)
+{
+	buffer.insert(buffer.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value));
+}
+
+static void appendUInt64(std::vector<uint8_t>& buffer, uint64_t value)
+{
+	buffer.insert(buffer.end(), (uint8_t*)&value, (uint8_t*)&value + sizeof(value));
+}
+
+static void appendString(std::vector<uint8_t>& buffer, const char* str)
+{
+	buffer.insert(buffer.end(), str, str + strlen(str) + 1);
+}
+
+// resource limits a child takes from the client
+static const int kPassedLimits[] = { RLIMIT_CPU, RLIMIT_FSIZE, RLIMIT_DATA, RLIMIT_STACK, RLIMIT_CORE, RLIMIT_AS, RLIMIT_NOFILE };
+
+
+//
+// A request is the magic, argc, the arguments, the current directory, the number of
+// environment variables and the variables, the umask, and the soft and hard value of each
+// of kPassedLimits.  The server and its clients are the same linker on the same machine, so
+// values are in host byte order.
+//
+class RequestReader
+{
+public:
+						RequestReader(const std::vector<uint8_t>& buffer)
+							: _p(buffer.data()), _end(buffer.data() + buffer.size()), _ok(true) { }
+
+	uint32_t			readUInt32() { return read<uint32_t>(); }
+	uint64_t			readUInt64() { return read<uint64_t>(); }
+	const char*			readString() {
+							const uint8_t* nul = (const uint8_t*)memchr(_p, '\0', _end - _p);
+							if ( nul == nullptr ) {
+								_ok = false;
+								return "";
+							}
+							const char* str = (const char*)_p;
+							_p = nul + 1;
+							return str;
+						}
+	bool				ok() const { return _ok; }
+
+private:
+	template <typename T>
+	T					read() {
+							T value = 0;
+							if ( (size_t)(_end - _p) < sizeof(value) ) {
+								_ok = false;
+								return 0;
+							}
+							memcpy(&value, _p, sizeof(value));
+							_p += sizeof(value);
+							return value;
+						}
+
+	const uint8_t*		_p;
+	const uint8_t*		_end;
+	bool				_ok;
+};
+
+
+static int connectTo(const char* socketPath)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if ( strlen(socketPath) >= sizeof(addr.sun_path) )
+		return -1;
+	strcpy(addr.sun_path, socketPath);
+	int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if ( fd == -1 )
+		return -1;
+	if ( ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ) {
+		::close(fd);
+		return -1;
+	}
+	::fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+// stdin, stdout, stderr, and the read and write ends of make's jobserver pipe
+static const int		kMaxPassedFds = 5;
+
+static bool sendFileDescriptors(int sock, const int fds[], int count)
+{
+	char byte = 0;
+	struct iovec iov = { &byte, 1 };
+	union {
+		struct cmsghdr	header;
+		char			buffer[CMSG_SPACE(kMaxPassedFds*sizeof(int))];
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = CMSG_SPACE(count*sizeof(int));
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(count*sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, count*sizeof(int));
+	while ( ::sendmsg(sock, &msg, 0) == -1 ) {
+		if ( errno != EINTR )
+			return false;
+	}
+	return true;
+}
+
+static bool receiveFileDescriptors(int sock, int fds[], int& count)
+{
+	char byte;
+	struct iovec iov = { &byte, 1 };
+	union {
+		struct cmsghdr	header;
+		char			buffer[CMSG_SPACE(kMaxPassedFds*sizeof(int))];
+	} control;
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buffer;
+	msg.msg_controllen = sizeof(control.buffer);
+	ssize_t amount;
+	while ( (amount = ::recvmsg(sock, &msg, 0)) == -1 ) {
+		if ( errno != EINTR )
+			return false;
+	}
+	if ( (amount != 1) || ((msg.msg_flags & MSG_CTRUNC) != 0) )
+		return false;
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+	if ( (cmsg == nullptr) || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) )
+		return false;
+	count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+	if ( (count != 3) && (count != kMaxPassedFds) )
+		return false;
+	memcpy(fds, CMSG_DATA(cmsg), count*sizeof(int));
+	return true;
+}
+
+
+// the value of the jobserver option make uses, the last one if MAKEFLAGS has several
+static const char* jobserverValue(const char* makeFlags)
+{
+	const char* auth = nullptr;
+	for (const char* option : { "--jobserver-auth=", "--jobserver-fds=" }) {
+		for (const char* pos = strstr(makeFlags, option); pos != nullptr; pos = strstr(pos+1, option)) {
+			const char* value = pos + strlen(option);
+			if ( (auth == nullptr) || (value > auth) )
+				auth = value;
+		}
+	}
+	return auth;
+}
+
+// the fds of make's jobserver pipe in the value of a jobserver option, if this process has them open
+static bool jobserverPipe(const char* value, int fds[2])
+{
+	int readFd;
+	int writeFd;
+	if ( sscanf(value, "%d,%d", &readFd, &writeFd) != 2 )
+		return false;
+	for (int fd : { readFd, writeFd }) {
+		struct stat info;
+		if ( (fd < 0) || (::fstat(fd, &info) != 0) || !S_ISFIFO(info.st_mode) )
+			return false;
+	}
+	fds[0] = readFd;
+	fds[1] = writeFd;
+	return true;
+}
+
+
+//
+// With LD_LINK_SERVER set, hands the link to the server and exits with its status.  Returns if
+// no server is listening, so ld links by itself.
+//
+static void forwardToServer(const char* socketPath, int argc, const char* argv[])
+{
+	int sock = connectTo(socketPath);
+	if ( sock == -1 )
+		return;
+
+	std::vector<uint8_t> request;
+	appendUInt32(request, kRequestMagic);
+	appendUInt32(request, argc);
+	for (int i=0; i < argc; ++i)
+		appendString(request, argv[i]);
+	char cwd[PATH_MAX];
+	if ( ::getcwd(cwd, sizeof(cwd)) == nullptr ) {
+		::close(sock);
+		return;
+	}
+	appendString(request, cwd);
+	std::vector<const char*> env;
+	int jobserverFds[2] = { -1, -1 };
+	for (char** e = environ; (e != nullptr) && (*e != nullptr); ++e) {
+		if ( strncmp(*e, "MAKEFLAGS=", 10) == 0 ) {
+			// make's jobserver pipe is passed along with stdin, stdout and stderr.  If this process does
+			// not have the pipe open, the numbers would name unrelated files in the link, so they are dropped.
+			const char* value = jobserverValue(*e + 10);
+			if ( (value != nullptr) && (strncmp(value, "fifo:", 5) != 0) && !jobserverPipe(value, jobserverFds) )
+				continue;
+		}
+		env.push_back(*e);
+	}
+	appendUInt32(request, (uint32_t)env.size());
+	for (const char* e : env)
+		appendString(request, e);
+	mode_t mask = ::umask(0);
+	::umask(mask);
+	appendUInt32(request, mask);
+	for (int resource : kPassedLimits) {
+		struct rlimit limit;
+		if ( ::getrlimit(resource, &limit) == -1 ) {
+			::close(sock);
+			return;
+		}
+		appendUInt64(request, limit.rlim_cur);
+		appendUInt64(request, limit.rlim_max);
+	}
+
+	// the link writes to this process' stdout and stderr, an fd that is closed is passed as /dev/null
+	int fds[kMaxPassedFds];
+	int fdCount = 3;
+	int devNull = -1;
+	for (int fd=0; fd < 3; ++fd) {
+		if ( ::fcntl(fd, F_GETFD) != -1 ) {
+			fds[fd] = fd;
+		}
+		else {
+			if ( devNull == -1 )
+				devNull = ::open("/dev/null", O_RDWR | O_CLOEXEC);
+			fds[fd] = devNull;
+		}
+	}
+	if ( jobserverFds[0] != -1 ) {
+		fds[fdCount++] = jobserverFds[0];
+		fds[fdCount++] = jobserverFds[1];
+	}
+	uint64_t size = request.size();
+	bool sent = (fds[0] != -1) && (fds[1] != -1) && (fds[2] != -1) && sendFileDescriptors(sock, fds, fdCount)
+				&& writeAll(sock, &size, sizeof(size)) && writeAll(sock, request.data(), request.size());
+	if ( devNull != -1 )
+		::close(devNull);
+	if ( !sent ) {
+		::close(sock);
+		return;
+	}
+
+	uint32_t status;
+	if ( !readAll(sock, &status, sizeof(status)) ) {
+		// the link may have written some output, but linking again replaces all of it
+		::close(sock);
+		warning("link server on %s did not finish the link, linking without it", socketPath);
+		return;
+	}
+	::close(sock);
+	if ( status == kRequestRefused )
+		return;
+	::exit(status);
+}
+
+
+//
+// In a child forked by the server: reads the request, and sets up the process like the client.
+//
+static void takeRequest(int conn, int& argc, const char**& argv)
+{
+	int fds[kMaxPassedFds];
+	int fdCount;
+	if ( !receiveFileDescriptors(conn, fds, fdCount) )
+		::_exit(1);
+	for (int fd=0; fd < 3; ++fd) {
+		::dup2(fds[fd], fd);
+	}
+	for (int fd=0; fd < 3; ++fd) {
+		if ( fds[fd] > 2 )
+			::close(fds[fd]);
+	}
+
+	uint64_t size;
+	if ( !readAll(conn, &size, sizeof(size)) || (size > 0x40000000) ) {
+		fprintf(stderr, "ld: bad request from link server client\n");
+		::_exit(1);
+	}
+	std::vector<uint8_t>* buffer = new std::vector<uint8_t>(size);	// argv and environ point into it
+	if ( !readAll(conn, buffer->data(), size) ) {
+		fprintf(stderr, "ld: bad request from link server client\n");
+		::_exit(1);
+	}
+
+	RequestReader reader(*buffer);
+	bool ok = (reader.readUInt32() == kRequestMagic);
+	uint32_t count = reader.readUInt32();
+	const char** args = new const char*[count+1];
+	for (uint32_t i=0; ok && (i < count); ++i)
+		args[i] = reader.readString();
+	args[count] = nullptr;
+	const char* cwd = reader.readString();
+	uint32_t envCount = reader.readUInt32();
+	char** env = new char*[envCount+1];
+	for (uint32_t i=0; ok && (i < envCount); ++i)
+		env[i] = (char*)reader.readString();
+	env[envCount] = nullptr;
+	mode_t mask = (mode_t)reader.readUInt32();
+	struct rlimit limits[sizeof(kPassedLimits)/sizeof(kPassedLimits[0])];
+	for (struct rlimit& limit : limits) {
+		limit.rlim_cur = (rlim_t)reader.readUInt64();
+		limit.rlim_max = (rlim_t)reader.readUInt64();
+	}
+	if ( !ok || !reader.ok() || (count == 0) ) {
+		fprintf(stderr, "ld: bad request from link server client\n");
+		::_exit(1);
+	}
+	for (uint32_t i=0; i < envCount; ++i) {
+		// the jobserver pipe has different numbers in this process
+		if ( strncmp(env[i], "MAKEFLAGS=", 10) != 0 )
+			continue;
+		const char* value = jobserverValue(env[i] + 10);
+		if ( (value == nullptr) || (strncmp(value, "fifo:", 5) == 0) )
+			continue;
+		if ( fdCount != kMaxPassedFds ) {
+			fprintf(stderr, "ld: bad request from link server client\n");
+			::_exit(1);
+		}
+		std::string makeFlags(env[i], value - env[i]);
+		makeFlags += std::to_string(fds[3]) + "," + std::to_string(fds[4]);
+		makeFlags += value + strcspn(value, " ");
+		env[i] = strdup(makeFlags.c_str());
+	}
+	// a client with a limit above the server's hard limit links by itself
+	for (size_t i=0; i < sizeof(kPassedLimits)/sizeof(kPassedLimits[0]); ++i) {
+		if ( ::setrlimit(kPassedLimits[i], &limits[i]) == -1 ) {
+			uint32_t refused = kRequestRefused;
+			writeAll(conn, &refused, sizeof(refused));
+			::_exit(1);
+		}
+	}
+	// output files get their permissions from the umask
+	::umask(mask);
+	if ( ::chdir(cwd) == -1 ) {
+		fprintf(stderr, "ld: can't change to directory %s: %s\n", cwd, strerror(errno));
+		::_exit(1);
+	}
+	environ = env;
+	argc = count;
+	argv = args;
+
+	// the client sends nothing more, so the connection only becomes readable when the client goes
+	// away.  Then the link is stopped like an interrupted ld, which removes its partial output.
+	std::thread([conn]() {
+		char byte;
+		while ( (::read(conn, &byte, 1) == -1) && (errno == EINTR) )
+			;
+		::kill(::getpid(), SIGINT);
+	}).detach();
+}
+
+
+struct Child
+{
+	int						conn;			// to the client, gets the exit status
+	int						blobFd;			// blobs from the child, -1 once at end of file
+	std::vector<uint8_t>	pending;		// part of a blob message
+};
+
+static void keepServerBlob(std::string&& name, std::vector<uint8_t>&& content)
+{
+	auto pos = sBlobs->find(name);
+	if ( pos != sBlobs->end() ) {
+		sBlobBytes -= pos->second.size();
+		sBlobs->erase(pos);
+	}
+	if ( sBlobBytes + content.size() > kMaxBlobBytes )
+		return;
+	sBlobBytes += content.size();
+	(*sBlobs)[std::move(name)] = std::move(content);
+}
+
+// takes every complete blob message (name length, name, size, content) out of pending
+static void takeBlobs(std::vector<uint8_t>& pending)
+{
+	size_t used = 0;
+	for (;;) {
+		const uint8_t* p = pending.data() + used;
+		size_t left = pending.size() - used;
+		uint32_t nameLength;
+		uint64_t size;
+		if ( left < sizeof(nameLength) )
+			break;
+		memcpy(&nameLength, p, sizeof(nameLength));
+		if ( left < sizeof(nameLength) + nameLength + sizeof(size) )
+			break;
+		memcpy(&size, p + sizeof(nameLength) + nameLength, sizeof(size));
+		size_t messageSize = sizeof(nameLength) + nameLength + sizeof(size) + size;
+		if ( left < messageSize )
+			break;
+		const uint8_t* content = p + sizeof(nameLength) + nameLength + sizeof(size);
+		keepServerBlob(std::string((const char*)p + sizeof(nameLength), nameLength), std::vector<uint8_t>(content, content + size));
+		used += messageSize;
+	}
+	pending.erase(pending.begin(), pending.begin() + used);
+}
+
+// returns false if nothing was read
+static bool readBlobs(Child& child)
+{
+	uint8_t buffer[64*1024];
+	ssize_t amount = ::read(child.blobFd, buffer, sizeof(buffer));
+	if ( (amount == -1) && ((errno == EINTR) || (errno == EAGAIN)) )
+		return false;
+	if ( amount <= 0 ) {
+		::close(child.blobFd);
+		child.blobFd = -1;
+		child.pending.clear();
+		return false;
+	}
+	child.pending.insert(child.pending.end(), buffer, buffer + amount);
+	takeBlobs(child.pending);
+	return true;
+}
+
+static void childExited(int)
+{
+	int savedErrno = errno;
+	char byte = 0;
+	(void)::write(sChildPipe[1], &byte, 1);
+	errno = savedErrno;
+}
+
+// links run with the privileges of the server, so only take them from the same user
+static bool fromSameUser(int conn)
+{
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+	uid_t uid;
+	gid_t gid;
+	if ( ::getpeereid(conn, &uid, &gid) == -1 )
+		return false;
+#elif defined(SO_PEERCRED)
+	struct ucred cred;
+	socklen_t length = sizeof(cred);
+	if ( ::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &length) == -1 )
+		return false;
+	uid_t uid = cred.uid;
+#else
+	uid_t uid = (uid_t)-1;
+#endif
+	return (uid == ::geteuid());
+}
+
+static void serve(const char* socketPath, int& argc, const char**& argv)
+{
+	int other = connectTo(socketPath);
+	if ( other != -1 ) {
+		fprintf(stderr, "ld: a link server is already listening on %s\n", socketPath);
+		::exit(1);
+	}
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if ( strlen(socketPath) >= sizeof(addr.sun_path) ) {
+		fprintf(stderr, "ld: -link_server socket path too long: %s\n", socketPath);
+		::exit(1);
+	}
+	strcpy(addr.sun_path, socketPath);
+	::unlink(socketPath);
+	// the socket is created with no access for others, so there is no window before the chmod()
+	mode_t oldMask = ::umask(0077);
+	int listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	bool listening = (listenFd != -1) && (::bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0)
+					&& (::chmod(socketPath, 0600) == 0) && (::listen(listenFd, 64) == 0);
+	int listenErrno = errno;
+	::umask(oldMask);
+	if ( !listening ) {
+		fprintf(stderr, "ld: can't listen on %s: %s\n", socketPath, strerror(listenErrno));
+		::exit(1);
+	}
+	if ( ::pipe(sChildPipe) == -1 ) {
+		fprintf(stderr, "ld: can't create pipe: %s\n", strerror(errno));
+		::exit(1);
+	}
+	::fcntl(sChildPipe[0], F_SETFL, O_NONBLOCK);
+	::fcntl(sChildPipe[1], F_SETFL, O_NONBLOCK);
+	::signal(SIGPIPE, SIG_IGN);
+	::signal(SIGCHLD, &childExited);
+	sBlobs = new BlobMap();
+
+	std::map<pid_t, Child> children;
+	std::vector<struct pollfd> pollFds;
+	for (;;) {
+		pollFds.clear();
+		pollFds.push_back({ listenFd, POLLIN, 0 });
+		pollFds.push_back({ sChildPipe[0], POLLIN, 0 });
+		for (auto& entry : children) {
+			if ( entry.second.blobFd != -1 )
+				pollFds.push_back({ entry.second.blobFd, POLLIN, 0 });
+		}
+		if ( ::poll(pollFds.data(), pollFds.size(), -1) == -1 ) {
+			if ( errno == EINTR )
+				continue;
+			fprintf(stderr, "ld: link server poll failed: %s\n", strerror(errno));
+			::exit(1);
+		}
+
+		for (auto& entry : children) {
+			Child& child = entry.second;
+			for (size_t i=2; i < pollFds.size(); ++i) {
+				if ( (pollFds[i].fd == child.blobFd) && (pollFds[i].revents != 0) )
+					readBlobs(child);
+			}
+		}
+
+		if ( pollFds[1].revents != 0 ) {
+			char drain[64];
+			while ( ::read(sChildPipe[0], drain, sizeof(drain)) > 0 )
+				;
+			int status;
+			pid_t pid;
+			while ( (pid = ::waitpid(-1, &status, WNOHANG)) > 0 ) {
+				auto pos = children.find(pid);
+				if ( pos == children.end() )
+					continue;
+				Child& child = pos->second;
+				// the child is gone, so everything it sent is in the pipe
+				while ( (child.blobFd != -1) && readBlobs(child) )
+					;
+				if ( child.blobFd != -1 )
+					::close(child.blobFd);
+				uint32_t exitStatus = 1;
+				if ( WIFEXITED(status) )
+					exitStatus = WEXITSTATUS(status);
+				else if ( WIFSIGNALED(status) )
+					exitStatus = 128 + WTERMSIG(status);
+				writeAll(child.conn, &exitStatus, sizeof(exitStatus));
+				::close(child.conn);
+				children.erase(pos);
+			}
+		}
+
+		if ( pollFds[0].revents != 0 ) {
+			int conn = ::accept(listenFd, nullptr, nullptr);
+			if ( conn == -1 )
+				continue;
+			::fcntl(conn, F_SETFD, FD_CLOEXEC);
+			if ( !fromSameUser(conn) ) {
+				fprintf(stderr, "ld: link server refused a connection from another user\n");
+				::close(conn);
+				continue;
+			}
+			int blobPipe[2];
+			if ( ::pipe(blobPipe) == -1 ) {
+				::close(conn);
+				continue;
+			}
+			::fcntl(blobPipe[0], F_SETFD, FD_CLOEXEC);
+			::fcntl(blobPipe[1], F_SETFD, FD_CLOEXEC);
+			pid_t pid = ::fork();
+			if ( pid == 0 ) {
+				::signal(SIGCHLD, SIG_DFL);
+				::signal(SIGPIPE, SIG_DFL);
+				// SIGINT stops a link whose client went away, even if the server was started ignoring it
+				::signal(SIGINT, SIG_DFL);
+				::close(listenFd);
+				::close(sChildPipe[0]);
+				::close(sChildPipe[1]);
+				for (auto& entry : children) {
+					::close(entry.second.conn);
+					if ( entry.second.blobFd != -1 )
+						::close(entry.second.blobFd);
+				}
+				::close(blobPipe[0]);
+				sBlobFd = blobPipe[1];
+				takeRequest(conn, argc, argv);
+				return;
+			}
+			::close(blobPipe[1]);
+			if ( pid == -1 ) {
+				uint32_t exitStatus = 1;
+				writeAll(conn, &exitStatus, sizeof(exitStatus));
+				::close(conn);
+				::close(blobPipe[0]);
+				continue;
+			}
+			::fcntl(blobPipe[0], F_SETFL, O_NONBLOCK);
+			children[pid] = { conn, blobPipe[0], std::vector<uint8_t>() };
+		}
+	}
+}
+
+
+void start(int& argc, const char**& argv)
+{
+	if ( (argc == 3) && (strcmp(argv[1], "-link_server") == 0) ) {
+		serve(argv[2], argc, argv);
+		return;
+	}
+	for (int i=1; i < argc; ++i) {
+		if ( strcmp(argv[i], "-link_server") == 0 ) {
+			fprintf(stderr, "ld: -link_server takes a socket path and no other options\n");
+			::exit(1);
+		}
+	}
+	const char* socketPath = getenv("LD_LINK_SERVER");
+	if ( (socketPath != nullptr) && (socketPath[0] != '\0') )
+		forwardToServer(socketPath, argc, argv);
+}
+
+bool keepsBlobs()
+{
+	return (sBlobFd != -1);
+}
+
+const uint8_t* findBlob(const std::string& name, uint64_t& size)
+{
+	if ( sBlobs == nullptr )
+		return nullptr;
+	auto pos = sBlobs->find(name);
+	if ( pos == sBlobs->end() )
+		return nullptr;
+	++sBlobsFound;
+	size = pos->second.size();
+	return pos->second.data();
+}
+
+void keepBlob(const std::string& name, const void* content, uint64_t size)
+{
+	std::lock_guard<std::mutex> lock(sBlobLock);
+	if ( sBlobFd == -1 )
+		return;
+	uint32_t nameLength = (uint32_t)name.size();
+	if ( !writeAll(sBlobFd, &nameLength, sizeof(nameLength)) || !writeAll(sBlobFd, name.data(), nameLength)
+		|| !writeAll(sBlobFd, &size, sizeof(size)) || !writeAll(sBlobFd, content, size) ) {
+		// the server is gone, the link goes on without it
+		::close(sBlobFd);
+		sBlobFd = -1;
+		return;
+	}
+	++sBlobsKept;
+}
+
+void printStatistics()
+{
+	if ( sBlobs == nullptr )
+		return;
+	fprintf(stderr, "link server: %u blobs reused, %u handed to the server\n", sBlobsFound.load(), sBlobsKept.load());
+}
+
+} // namespace server
+} // namespace ld
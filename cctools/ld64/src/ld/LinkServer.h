@@ -0,0 +1,65 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __LINK_SERVER_H__
+#define __LINK_SERVER_H__
+
+#include <stdint.h>
+
+#include <string>
+
+namespace ld {
+namespace server {
+
+//
+// `ld -link_server <socket>` listens on a unix domain socket.  When LD_LINK_SERVER names that
+// socket, ld sends its arguments, current directory, environment, umask, resource limits and
+// stdin/stdout/stderr to the server, waits, and exits with the status of the link.  If no server
+// is listening, or the server can't take on those limits, ld links by itself.
+//
+// The server forks a child for each link, which links just like ld would, and interrupts the
+// child if the client goes away.  Parsers hand what they build from an input file and could use
+// again (the interfaces of .tbd files, the table of contents index of archives) to the server
+// with keepBlob().  The server keeps those blobs in memory, so every child it forks later finds
+// them with findBlob() instead of parsing the files again.  A blob is named by the parser, and
+// the parser checks that it still matches the file before using it.
+//
+// The server process never links and never starts threads, so forking it is always safe.
+//
+
+// Called first thing in main().  Returns in a process that should link with argc and argv,
+// which are replaced by the arguments of the request in a child forked by the server.
+void				start(int& argc, const char**& argv);
+
+// true in a child of the link server
+bool				keepsBlobs();
+// the blob the link server has with this name, or nullptr
+const uint8_t*		findBlob(const std::string& name, uint64_t& size);
+// hands a blob to the link server, so later links can use it
+void				keepBlob(const std::string& name, const void* content, uint64_t size);
+
+void				printStatistics();
+
+} // namespace server
+} // namespace ld
+
+#endif // __LINK_SERVER_H__
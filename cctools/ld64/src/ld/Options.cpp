@@ -35,6 +35,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <dirent.h>
 #ifndef __ANDROID__ // ld64-port
 #include <spawn.h>
 #endif
@@ -49,6 +50,9 @@
 #include <vector>
 #include <map>
 #include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "ld.hpp"
 #include "Options.h"
@@ -165,6 +169,109 @@ std::vector<std::string> Options::FileInfo::lib_cli_argument() const
 	}
 }
 
+//
+// Library and framework searches probe every search path for several names, and most of
+// those paths do not exist.  Each directory probed is read once, and probes for names not
+// in it fail without a stat().  Directories on case insensitive file systems are not
+// cached, because their listing can not answer whether a differently cased name exists.
+//
+class DirectoryCache
+{
+public:
+	static DirectoryCache&	shared();
+	// returns false if path is known not to exist
+	bool					mayExist(const char* path);
+
+private:
+	struct Listing {
+		bool							exists;		// directory could be opened
+		bool							usable;		// probes can be answered from names
+		std::unordered_set<std::string>	names;
+	};
+	const Listing&			listing(const std::string& dir);
+	static bool				splitPath(const std::string& path, std::string& dir, std::string& name);
+
+	std::mutex									_lock;
+	std::unordered_map<std::string, Listing>	_listings;
+};
+
+DirectoryCache& DirectoryCache::shared()
+{
+	static DirectoryCache cache;
+	return cache;
+}
+
+bool DirectoryCache::splitPath(const std::string& path, std::string& dir, std::string& name)
+{
+	std::string::size_type lastSlash = path.find_last_of('/');
+	if ( lastSlash == std::string::npos ) {
+		dir  = ".";
+		name = path;
+	}
+	else {
+		dir  = (lastSlash == 0) ? std::string("/") : path.substr(0, lastSlash);
+		name = path.substr(lastSlash+1);
+	}
+	// "." and ".." are not looked up, neither are paths ending in a slash
+	return !name.empty() && (name != ".") && (name != "..");
+}
+
+const DirectoryCache::Listing& DirectoryCache::listing(const std::string& dir)
+{
+	auto pos = _listings.find(dir);
+	if ( pos != _listings.end() )
+		return pos->second;
+
+	Listing result = { false, true, {} };
+	std::string parentDir;
+	std::string name;
+	bool inParent = true;
+	if ( (dir != "/") && (dir != ".") && splitPath(dir, parentDir, name) ) {
+		// most search paths probed for frameworks do not exist, avoid the opendir() if the parent says so
+		const Listing& parent = listing(parentDir);
+		if ( parent.usable && (!parent.exists || (parent.names.count(name) == 0)) )
+			inParent = false;
+	}
+	if ( inParent ) {
+		if ( DIR* dirp = ::opendir(dir.c_str()) ) {
+			result.exists = true;
+			while ( struct dirent* entry = ::readdir(dirp) )
+				result.names.insert(entry->d_name);
+			::closedir(dirp);
+			// if a name with its letters' case flipped also exists, the file system ignores case
+			for (const std::string& entryName : result.names) {
+				std::string flipped = entryName;
+				for (char& c : flipped)
+					c = isupper(c) ? tolower(c) : toupper(c);
+				if ( flipped == entryName )
+					continue;
+				struct stat statBuffer;
+				if ( (result.names.count(flipped) == 0) && (::stat((dir + "/" + flipped).c_str(), &statBuffer) == 0) )
+					result.usable = false;
+				break;
+			}
+		}
+		else {
+			// permission problems and such are left to stat()
+			result.usable = (errno == ENOENT) || (errno == ENOTDIR);
+		}
+	}
+	return _listings.emplace(dir, std::move(result)).first->second;
+}
+
+bool DirectoryCache::mayExist(const char* path)
+{
+	std::string dir;
+	std::string name;
+	if ( !splitPath(path, dir, name) )
+		return true;
+	std::lock_guard<std::mutex> guard(_lock);
+	const Listing& dirListing = listing(dir);
+	if ( !dirListing.usable )
+		return true;
+	return dirListing.exists && (dirListing.names.count(name) != 0);
+}
+
 bool Options::FileInfo::checkFileExists(const Options& options, const char *p)
 {
 	if (isInlined) {
@@ -174,7 +281,7 @@ bool Options::FileInfo::checkFileExists(const Options& options, const char *p)
 	struct stat statBuffer;
 	if (p == NULL) 
 	  p = path;
-	if ( stat(p, &statBuffer) == 0 ) {
+	if ( DirectoryCache::shared().mayExist(p) && (stat(p, &statBuffer) == 0) ) {
 		if (p != path) path = strdup(p);
 		modTime = statBuffer.st_mtime;
 		return true;
@@ -200,14 +307,14 @@ Options::Options(int argc, const char* argv[])
 	  fClientName(NULL),
 	  fUmbrellaName(NULL), fInitFunctionName(NULL), fDotOutputFile(NULL), fExecutablePath(NULL),
 	  fBundleLoader(NULL), fDtraceScriptName(NULL), fMapPath(NULL),
-	  fDyldInstallPath("/usr/lib/dyld"), fLtoCachePath(NULL), fTempLtoObjectPath(NULL), fOverridePathlibLTO(NULL), fLtoCpu(NULL),
+	  fDyldInstallPath("/usr/lib/dyld"), fLtoCachePath(NULL), fTBDCachePath(NULL), fArchiveIndexCachePath(NULL), fTempLtoObjectPath(NULL), fOverridePathlibLTO(NULL), fLtoCpu(NULL),
 	  fToolchainPath(NULL),fOrderFilePath(NULL),
 	  fZeroPageSize(ULLONG_MAX), fStackSize(0), fStackAddr(0), fSourceVersion(0), fSDKVersion(0), fImplicitPageZero(false), fExecutableStack(false),
 	  fNonExecutableHeap(false), fDisableNonExecutableHeap(false),
 	  fMinimumHeaderPad(32), fSegmentAlignment(LD_PAGE_SIZE), fForceAlignment(false),
-	  fCommonsMode(kCommonsIgnoreDylibs),  fUUIDMode(kUUIDContent), fLocalSymbolHandling(kLocalSymbolsAll), fWarnCommons(false), 
+	  fCommonsMode(kCommonsIgnoreDylibs),  fUUIDMode(kUUIDContent), fUUIDTreeHash(false), fMmapOutput(false), fLocalSymbolHandling(kLocalSymbolsAll), fWarnCommons(false), 
 	  fVerbose(false), fKeepRelocations(false), fWarnStabs(false),
-	  fTraceDylibSearching(false), fPause(false), fStatistics(false), fPrintOptions(false),
+	  fTraceDylibSearching(false), fPause(false), fStatistics(false), fThreadCount(0), fTraceTimelinePath(NULL), fPrintOptions(false),
 	  fSharedRegionEligible(false), fSharedRegionEligibleForceOff(false), fPrintOrderFileStatistics(false),
 	  fReadOnlyx86Stubs(false), fPositionIndependentExecutable(false), fPIEOnCommandLine(false),
 	  fDisablePositionIndependentExecutable(false), fMaxMinimumHeaderPad(false),
@@ -223,7 +330,7 @@ Options::Options(int argc, const char* argv[])
 	  fFullyLoadArchives(false), fLoadAllObjcObjectsFromArchives(false), fFlatNamespace(false),
 	  fLinkingMainExecutable(false), fForFinalLinkedImage(false), fForStatic(false),
 	  fForDyld(false), fMakeTentativeDefinitionsReal(false), fWhyLoad(false), fRootSafe(false),
-	  fSetuidSafe(false), fSearchInSparseFrameworks(false), fImplicitlyLinkPublicDylibs(true), fAddCompactUnwindEncoding(true),
+	  fSetuidSafe(false), fSearchInSparseFrameworks(false), fImplicitlyLinkPublicDylibs(true), fLazyDylibExports(true), fAddCompactUnwindEncoding(true),
 	  fWarnCompactUnwind(false), fRemoveDwarfUnwindIfCompactExists(false),
 	  fAutoOrderInitializers(true), fOptimizeZeroFill(true), fMergeZeroFill(false),
 	  fLogAllFiles(false), fTraceDylibs(false), fTraceIndirectDylibs(false), fTraceArchives(false), fTraceEmitJSON(false),
@@ -248,7 +355,7 @@ Options::Options(int argc, const char* argv[])
 	  fConstSelectorRefs(false), fConstSelectorRefsForceOn(false), fConstSelectorRefsForceOff(false),
       fConstClassRefs(false),
 	  fUseTextExecSegment(false), fBundleBitcode(false), fHideSymbols(false), fVerifyBitcode(false),
-	  fReverseMapUUIDRename(false), fDeDupe(true), fVerboseDeDupe(false), fMakeInitializersIntoOffsets(false),
+	  fReverseMapUUIDRename(false), fDeDupe(true), fVerboseDeDupe(false), fDeDupeData(false), fMakeInitializersIntoOffsets(false),
 	  fUseLinkedListBinding(false),  fMakeChainedFixupsForceOn(false), fMakeChainedFixupsForceOff(false), fMakeChainedFixups(false),
 	  fMakeChainedFixupsSection(false), fMakeRebaseSection(false), fNoLazyBinding(false), fDebugVariant(false),
 	  fReverseMapPath(NULL), fLTOCodegenOnly(false),
@@ -260,7 +367,7 @@ Options::Options(int argc, const char* argv[])
 	  fPlatformMismatchesAreWarning(false),
 	  fForceObjCRelativeMethodListsOn(false), fForceObjCRelativeMethodListsOff(false), fUseObjCRelativeMethodLists(false), fObjcSmallStubs(false), fRunHugePass(true),
 	  fSaveTempFiles(false), fLinkSnapshot(this), fSnapshotRequested(false), fPipelineFifo(NULL),
-	  fDependencyInfoPath(NULL), fBuildContextName(NULL), fTraceFileDescriptor(-1), fMaxDefaultCommonAlign(0),
+	  fDependencyInfoPath(NULL), fIncremental(false), fLinkCachePath(NULL), fLinkCacheMaxSize(4096), fLinkCacheMaxAge(7*24*60*60), fBuildContextName(NULL), fTraceFileDescriptor(-1), fMaxDefaultCommonAlign(0),
 	  fUnalignedPointerTreatment(kUnalignedPointerIgnore),
 #ifdef TAPI_SUPPORT // ld64-port
 	  fPreferTAPIFile(false),
@@ -291,6 +398,11 @@ bool Options::errorBecauseOfWarnings() const
 	return (sFatalWarnings && (sWarningsCount > 0));
 }
 
+uint32_t Options::warningCount() const
+{
+	return sWarningsCount;
+}
+
 
 const char*	Options::installPath() const
 {
@@ -2720,6 +2832,16 @@ void Options::parse(int argc, const char* argv[])
 				if ( fLtoCachePath == NULL )
 					throw "missing argument to -cache_path_lto";
 			}
+			else if ( strcmp(arg, "-tbd_cache_path") == 0 ) {
+				fTBDCachePath = argv[++i];
+				if ( fTBDCachePath == NULL )
+					throw "missing argument to -tbd_cache_path";
+			}
+			else if ( strcmp(arg, "-archive_index_cache_path") == 0 ) {
+				fArchiveIndexCachePath = argv[++i];
+				if ( fArchiveIndexCachePath == NULL )
+					throw "missing argument to -archive_index_cache_path";
+			}
 			else if ( strcmp(arg, "-prune_interval_lto") == 0 ) {
 				const char* value = argv[++i];
 				if ( value == NULL )
@@ -2750,6 +2872,29 @@ void Options::parse(int argc, const char* argv[])
 				if (fLtoMaxCacheSize > 100)
 					throw "Expect a value between 0 and 100 for -max_relative_cache_size_lto";
 			}
+			else if ( strcmp(arg, "-link_cache_path") == 0 ) {
+				fLinkCachePath = argv[++i];
+				if ( fLinkCachePath == NULL )
+					throw "-link_cache_path missing <path>";
+			}
+			else if ( strcmp(arg, "-link_cache_max_size") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -link_cache_max_size";
+				char* endptr;
+				fLinkCacheMaxSize = strtoull(value, &endptr, 10);
+				if ( *endptr != '\0' )
+					throw "invalid argument for -link_cache_max_size";
+			}
+			else if ( strcmp(arg, "-link_cache_max_age") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -link_cache_max_age";
+				char* endptr;
+				fLinkCacheMaxAge = (uint32_t)strtoul(value, &endptr, 10);
+				if ( *endptr != '\0' )
+					throw "invalid argument for -link_cache_max_age";
+			}
 			else if ( (arg[1] == 'l') && (strncmp(arg,"-lazy_",6) != 0)  && (strcmp(arg,"-load_hidden") != 0) ) {
                 snapshotArgCount = 0;
                 try {
@@ -3596,6 +3741,20 @@ void Options::parse(int argc, const char* argv[])
 			else if ( strcmp(arg, "-print_statistics") == 0 ) {
 				fStatistics = true;
 			}
+			else if ( strcmp(arg, "-trace_timeline") == 0 ) {
+				fTraceTimelinePath = argv[++i];
+				if ( fTraceTimelinePath == NULL )
+					throw "missing argument to -trace_timeline";
+			}
+			else if ( strcmp(arg, "-threads") == 0 ) {
+				const char* value = argv[++i];
+				if ( value == NULL )
+					throw "missing argument to -threads";
+				char* endptr;
+				fThreadCount = (unsigned)strtoul(value, &endptr, 10);
+				if ( (*endptr != '\0') || (fThreadCount == 0) )
+					throw "invalid argument for -threads, must be a positive number";
+			}
 			else if ( strcmp(arg, "-d") == 0 ) {
 				fMakeTentativeDefinitionsReal = true;
 			}
@@ -3622,6 +3781,12 @@ void Options::parse(int argc, const char* argv[])
 				fUUIDMode = kUUIDRandom;
 				cannotBeUsedWithBitcode(arg);
 			}
+			else if ( strcmp(arg, "-uuid_tree_hash") == 0 ) {
+				fUUIDTreeHash = true;
+			}
+			else if ( strcmp(arg, "-mmap_output") == 0 ) {
+				fMmapOutput = true;
+			}
 			else if ( strcmp(arg, "-dtrace") == 0 ) {
                 snapshotFileArgIndex = 1;
 				const char* name = argv[++i];
@@ -3769,6 +3934,9 @@ void Options::parse(int argc, const char* argv[])
 			else if ( strcmp(arg, "-no_implicit_dylibs") == 0 ) {
 				fImplicitlyLinkPublicDylibs = false;
 			}
+			else if ( strcmp(arg, "-no_lazy_dylib_exports") == 0 ) {
+				fLazyDylibExports = false;
+			}
 			else if ( strcmp(arg, "-new_linker") == 0 ) {
 				// ignore
 			}
@@ -4013,6 +4181,9 @@ void Options::parse(int argc, const char* argv[])
 				++i;
 				// previously handled by buildSearchPaths()
 			}
+			else if ( strcmp(arg, "-incremental") == 0 ) {
+				fIncremental = true;
+			}
 			else if ( strcmp(arg, "-export_dynamic") == 0 ) {
 				fExportDynamic = true;
 			}
@@ -4223,6 +4394,9 @@ void Options::parse(int argc, const char* argv[])
 			else if ( strcmp(arg, "-verbose_deduplicate") == 0 ) {
 				fVerboseDeDupe = true;
 			}
+			else if ( strcmp(arg, "-deduplicate_data") == 0 ) {
+				fDeDupeData = true;
+			}
 			else if ( strcmp(arg, "-max_default_common_align") == 0 ) {
 				const char* alignStr = argv[++i];
 				if ( alignStr == NULL )
@@ -4708,6 +4882,15 @@ void Options::buildSearchPaths(int argc, const char* argv[])
 // this is run before the command line is parsed
 void Options::parsePreCommandLineEnvironmentSettings()
 {
+	if ( const char* threads = getenv("LD_THREADS") ) {
+		char* endptr;
+		fThreadCount = (unsigned)strtoul(threads, &endptr, 10);
+		if ( (*endptr != '\0') || (fThreadCount == 0) ) {
+			warning("ignoring LD_THREADS=%s, must be a positive number", threads);
+			fThreadCount = 0;
+		}
+	}
+
 	if (getenv("LD_FORCE_LEGACY_VERSION_LOAD_CMDS") != NULL) {
 		fForceLegacyVersionLoadCommands = true;
 	}
@@ -6871,6 +7054,30 @@ void Options::checkIllegalOptionCombinations()
 		}
 	}
 
+	// -incremental only knows how to patch images dyld loads
+	if ( fIncremental ) {
+		switch ( fOutputKind ) {
+			case Options::kDynamicExecutable:
+			case Options::kDynamicLibrary:
+			case Options::kDynamicBundle:
+				break;
+			default:
+				warning("-incremental ignored, it is only supported for dynamic executables, dylibs, and bundles");
+				fIncremental = false;
+				break;
+		}
+	}
+
+	// deduplication folds identical functions, so a content change could change which are folded
+	if ( fIncremental )
+		fDeDupe = false;
+
+	// -incremental patches the previous output in place, which a cached link would replace
+	if ( fIncremental && (fLinkCachePath != NULL) ) {
+		warning("-link_cache_path ignored with -incremental");
+		fLinkCachePath = NULL;
+	}
+
 	for (const char* sdkPath : fSDKPaths) {
 		std::string possiblePath = std::string(sdkPath) + "/AppleInternal/";
 		struct stat statBuffer;
@@ -7036,7 +7243,8 @@ void Options::writeDependencyInfo() const
 
 void Options::addDependency(uint8_t opcode, const char* path) const
 {
-	if ( !this->dumpDependencyInfo() ) 
+	// -incremental and -link_cache_path use the dependency list to find out what changed since the last link
+	if ( !this->dumpDependencyInfo() && !fIncremental && (fLinkCachePath == NULL) )
 		return;
 
 	char realPath[PATH_MAX];
@@ -7053,6 +7261,13 @@ void Options::addDependency(uint8_t opcode, const char* path) const
 }
 
 
+void Options::forEachDependency(void (^handler)(uint8_t opcode, const char* path)) const
+{
+	for (const auto& entry: fDependencies)
+		handler(entry.opcode, entry.path.c_str());
+}
+
+
 void Options::writeToTraceFile(const char* buffer, size_t len) const
 {
 	// one time open() of custom LD_TRACE_FILE
@@ -388,9 +388,13 @@ public:
 	tapi::LinkerInterfaceFile*	findTAPIFile(const std::string &path) const;
 #endif
 	UUIDMode					UUIDMode() const { return fUUIDMode; }
+	bool						UUIDTreeHash() const { return fUUIDTreeHash; }
+	bool						mmapOutput() const { return fMmapOutput; }
 	bool						warnStabs();
 	bool						pauseAtEnd() { return fPause; }
 	bool						printStatistics() const { return fStatistics; }
+	unsigned					threadCount() const { return fThreadCount; }
+	const char*					traceTimelinePath() const { return fTraceTimelinePath; }
 	bool						printArchPrefix() const { return fMessagesPrefixedWithArchitecture; }
 	void						gotoPrimeLinker(int argc, const char* argv[]);
 	bool						sharedRegionEligible() const { return fSharedRegionEligible; }
@@ -452,6 +456,7 @@ public:
 	bool						flatNamespace() const { return fFlatNamespace; }
 	bool						linkingMainExecutable() const { return fLinkingMainExecutable; }
 	bool						implicitlyLinkIndirectPublicDylibs() const { return fImplicitlyLinkPublicDylibs; }
+	bool						lazyDylibExports() const { return fLazyDylibExports; }
 	bool						whyLoad() const { return fWhyLoad; }
 	const char*					traceOutputFile() const { return fTraceOutputFile; }
 	bool						outputSlidable() const { return fOutputSlidable; }
@@ -469,6 +474,8 @@ public:
 	bool						addDataInCodeInfo() const { return fDataInCodeInfoLoadCommand; }
 	bool						canReExportSymbols() const { return fCanReExportSymbols; }
 	const char*					ltoCachePath() const { return fLtoCachePath; }
+	const char*					tbdCachePath() const { return fTBDCachePath; }
+	const char*					archiveIndexCachePath() const { return fArchiveIndexCachePath; }
 	bool						ltoPruneIntervalOverwrite() const { return fLtoPruneIntervalOverwrite; }
 	int							ltoPruneInterval() const { return fLtoPruneInterval; }
 	int							ltoPruneAfter() const { return fLtoPruneAfter; }
@@ -493,6 +500,7 @@ public:
 	bool						renameReverseSymbolMap() const { return fReverseMapUUIDRename; }
 	bool						deduplicateFunctions() const { return fDeDupe; }
 	bool						verboseDeduplicate() const { return fVerboseDeDupe; }
+	bool						deduplicateData() const { return fDeDupeData; }
 	bool						makeInitializersIntoOffsets() const { return fMakeInitializersIntoOffsets; }
 	bool						useLinkedListBinding() const { return fUseLinkedListBinding; }
 	bool						makeChainedFixups() const { return fMakeChainedFixups; }
@@ -527,6 +535,7 @@ public:
 	bool						forceCoalesce(const char* symbolName) const;
     Snapshot&                   snapshot() const { return fLinkSnapshot; }
 	bool						errorBecauseOfWarnings() const;
+	uint32_t					warningCount() const;
 	bool						needsThreadLoadCommand() const { return fNeedsThreadLoadCommand; }
 	bool						needsEntryPointLoadCommand() const { return fEntryPointLoadCommand; }
 	bool						needsSourceVersionLoadCommand() const { return fSourceVersionLoadCommand; }
@@ -539,6 +548,11 @@ public:
     const char*					pipelineFifo() const { return fPipelineFifo; }
 	bool						dumpDependencyInfo() const { return (fDependencyInfoPath != NULL); }
 	const char*					dependencyInfoPath() const { return fDependencyInfoPath; }
+	void						forEachDependency(void (^handler)(uint8_t opcode, const char* path)) const;
+	bool						incremental() const { return fIncremental; }
+	const char*					linkCachePath() const { return fLinkCachePath; }
+	uint64_t					linkCacheMaxSize() const { return fLinkCacheMaxSize; }		// megabytes
+	uint32_t					linkCacheMaxAge() const { return fLinkCacheMaxAge; }		// seconds, zero if unlimited
 	bool						targetIOSSimulator() const { return platforms().contains(ld::simulatorPlatforms); }
 	ld::relocatable::File::LinkerOptionsList&
 								linkerOptions() const { return fLinkerOptions; }
@@ -720,6 +734,8 @@ private:
 	const char*							fMapPath;
 	const char*							fDyldInstallPath;
 	const char*							fLtoCachePath;
+	const char*							fTBDCachePath;
+	const char*							fArchiveIndexCachePath;
 	bool								fLtoPruneIntervalOverwrite;
 	int									fLtoPruneInterval;
 	int									fLtoPruneAfter;
@@ -743,6 +759,8 @@ private:
 	bool								fForceAlignment;
 	CommonsMode							fCommonsMode;
 	enum UUIDMode						fUUIDMode;
+	bool								fUUIDTreeHash;
+	bool								fMmapOutput;
 	SetWithWildcards					fLocalSymbolsIncluded;
 	SetWithWildcards					fLocalSymbolsExcluded;
 	LocalSymbolHandling					fLocalSymbolHandling;
@@ -753,6 +771,8 @@ private:
 	bool								fTraceDylibSearching;
 	bool								fPause;
 	bool								fStatistics;
+	unsigned							fThreadCount;
+	const char*							fTraceTimelinePath;
 	bool								fPrintOptions;
 	bool								fSharedRegionEligible;
 	bool								fSharedRegionEligibleForceOff;
@@ -797,6 +817,7 @@ private:
 	bool								fSetuidSafe;
 	bool								fSearchInSparseFrameworks;
 	bool								fImplicitlyLinkPublicDylibs;
+	bool								fLazyDylibExports;
 	bool								fAddCompactUnwindEncoding;
 	bool								fWarnCompactUnwind;
 	bool								fRemoveDwarfUnwindIfCompactExists;
@@ -861,6 +882,7 @@ private:
 	bool								fReverseMapUUIDRename;
 	bool								fDeDupe;
 	bool								fVerboseDeDupe;
+	bool								fDeDupeData;
 	bool								fMakeInitializersIntoOffsets;
 	bool								fUseLinkedListBinding;
 	bool								fMakeChainedFixupsForceOn;
@@ -937,6 +959,10 @@ private:
     bool								fSnapshotRequested;
     const char*							fPipelineFifo;
 	const char*							fDependencyInfoPath;
+	bool								fIncremental;
+	const char*							fLinkCachePath;
+	uint64_t							fLinkCacheMaxSize;
+	uint32_t							fLinkCacheMaxAge;
 	const char*							fBuildContextName;
 	mutable int							fTraceFileDescriptor;
 	uint8_t								fMaxDefaultCommonAlign;
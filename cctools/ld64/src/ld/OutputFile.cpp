@@ -44,7 +44,6 @@
 #include <dlfcn.h>
 #include <mach-o/dyld.h>
 #include <mach-o/fat.h>
-#include <dispatch/dispatch.h>
 #include <os/lock_private.h>
 #if defined(__APPLE__) && __has_include(<corecrypto/ccsha2.h>) // ld64-port
 extern "C" {
@@ -59,6 +58,7 @@ extern "C" {
 #include <list>
 #include <algorithm>
 #include <utility>
+#include <memory>
 #include <iostream>
 #include <fstream>
 
@@ -79,6 +79,8 @@ extern "C" {
 #include "LinkEditClassic.hpp"
 #include "generic_dylib_file.hpp"
 #include "Containers.h"
+#include "TaskPool.h"
+#include "Timeline.h"
 
 namespace ld {
 namespace tool {
@@ -166,19 +168,55 @@ void OutputFile::dumpAtomsBySection(ld::Internal& state, bool printAtoms)
 
 void OutputFile::write(ld::Internal& state)
 {
-	this->buildDylibOrdinalMapping(state);
-	this->addLoadCommands(state);
-	this->addLinkEdit(state);
-	state.setSectionSizesAndAlignments();
-	this->setLoadCommandsPadding(state);
-	_fileSize = state.assignFileOffsets();
-	this->assignAtomAddresses(state);
-	this->buildLINKEDITContent(state);
-	this->updateLINKEDITAddresses(state);
+	{
+		ld::timeline::Span span("buildDylibOrdinalMapping", "output");
+		this->buildDylibOrdinalMapping(state);
+	}
+	{
+		ld::timeline::Span span("addLoadCommands", "output");
+		this->addLoadCommands(state);
+	}
+	{
+		ld::timeline::Span span("addLinkEdit", "output");
+		this->addLinkEdit(state);
+	}
+	{
+		ld::timeline::Span span("setSectionSizesAndAlignments", "output");
+		state.setSectionSizesAndAlignments();
+	}
+	{
+		ld::timeline::Span span("setLoadCommandsPadding", "output");
+		this->setLoadCommandsPadding(state);
+	}
+	{
+		ld::timeline::Span span("assignFileOffsets", "output");
+		_fileSize = state.assignFileOffsets();
+	}
+	{
+		ld::timeline::Span span("assignAtomAddresses", "output");
+		this->assignAtomAddresses(state);
+	}
+	{
+		ld::timeline::Span span("buildLINKEDITContent", "output");
+		this->buildLINKEDITContent(state);
+	}
+	{
+		ld::timeline::Span span("updateLINKEDITAddresses", "output");
+		this->updateLINKEDITAddresses(state);
+	}
 	//this->dumpAtomsBySection(state, false);
-	this->writeOutputFile(state);
-	this->writeMapFile(state);
-	this->writeJSONEntry(state);
+	{
+		ld::timeline::Span span("writeOutputFile", "output");
+		this->writeOutputFile(state);
+	}
+	{
+		ld::timeline::Span span("writeMapFile", "output");
+		this->writeMapFile(state);
+	}
+	{
+		ld::timeline::Span span("writeJSONEntry", "output");
+		this->writeJSONEntry(state);
+	}
 }
 
 bool OutputFile::findSegment(ld::Internal& state, uint64_t addr, uint64_t* start, uint64_t* end, uint32_t* index)
@@ -1323,11 +1361,7 @@ void OutputFile::rangeCheckRISCVBranch20(int64_t displacement, ld::Internal& sta
 #endif
 
 
-#if SUPPORT_ARCH_arm64e
-static os_lock_unfair_s  sAuthenticatedFixupDataLock = OS_LOCK_UNFAIR_INIT; // to serialize building of _authenticatedFixupData
-#endif
-
-void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom* atom, uint8_t* buffer)
+void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom* atom, uint8_t* buffer, AtomChunk& chunk)
 {
 	//fprintf(stderr, "applyFixUps() on %s\n", atom->name());
 	int64_t accumulator = 0;
@@ -1699,11 +1733,8 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 					}
 					else {
 						auto fixupOffset = (uintptr_t)(fixUpLocation - mhAddress);
-						os_lock_lock(&sAuthenticatedFixupDataLock);
-							assert(_authenticatedFixupData.find(fixupOffset) == _authenticatedFixupData.end());
-							auto authneticatedData = std::make_pair(authData, accumulator);
-							_authenticatedFixupData[fixupOffset] = authneticatedData;
-						os_lock_unlock(&sAuthenticatedFixupDataLock);
+						auto authneticatedData = std::make_pair(authData, accumulator);
+						chunk.authenticatedFixupData.push_back(std::make_pair(fixupOffset, authneticatedData));
 						// Zero out this entry which we will expect later.
 						set64LE(fixUpLocation, 0);
 					}
@@ -1730,11 +1761,8 @@ void OutputFile::applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::
 					}
 					else {
 						auto fixupOffset = (uintptr_t)(fixUpLocation - mhAddress);
-						os_lock_lock(&sAuthenticatedFixupDataLock);
-							assert(_authenticatedFixupData.find(fixupOffset) == _authenticatedFixupData.end());
-							auto authneticatedData = std::make_pair(authData, accumulator);
-							_authenticatedFixupData[fixupOffset] = authneticatedData;
-						os_lock_unlock(&sAuthenticatedFixupDataLock);
+						auto authneticatedData = std::make_pair(authData, accumulator);
+						chunk.authenticatedFixupData.push_back(std::make_pair(fixupOffset, authneticatedData));
 						// Zero out this entry which we will expect later.
 						set64LE(fixUpLocation, 0);
 					}
@@ -3274,17 +3302,43 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 		if ( (sect->type() == ld::Section::typeMachHeader) && (_options.outputKind() != Options::kPreload) )
 			baseAddress = sect->address;
 	}
-	__block const char* exception = nullptr;
-	dispatch_apply(state.sections.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
-		ld::Internal::FinalSection* sect = state.sections[index];
+	// Split sections into ranges of atoms, so one big section, like __text, does not end up written by one thread.
+	const size_t atomsPerChunk = 1024;
+	std::vector<AtomChunk> chunks;
+	for (ld::Internal::FinalSection* sect : state.sections ) {
 		if ( takesNoDiskSpace(sect) )
-			return;
+			continue;
+		for (size_t start=0; start < sect->atoms.size(); start += atomsPerChunk) {
+			AtomChunk chunk;
+			chunk.sect		= sect;
+			chunk.atomStart	= start;
+			chunk.atomEnd	= std::min(start + atomsPerChunk, sect->atoms.size());
+			chunks.push_back(chunk);
+		}
+	}
+
+	__block const char* exception = nullptr;
+	AtomChunk* allChunks = chunks.data();
+	ld::parallelFor(chunks.size(), ^(size_t index) {
+		AtomChunk& chunk = allChunks[index];
+		ld::Internal::FinalSection* sect = chunk.sect;
 		const bool sectionUsesNops = (sect->type() == ld::Section::typeCode);
 		//fprintf(stderr, "file offset=0x%08llX, section %s, atomCount=%lu\n", sect->fileOffset, sect->sectionName(), sect->atoms.size());
 		bool 		lastAtomWasThumb 		  = false;
 		bool 		lastAtomUsesNoOps 		  = false;
 		uint64_t 	fileOffsetOfEndOfLastAtom = sect->fileOffset;
-		for (const ld::Atom* atom : sect->atoms) {
+		// padding in front of the first atom of the chunk is filled based on the atom before it
+		for (size_t prev=chunk.atomStart; prev > 0; --prev) {
+			const ld::Atom* prevAtom = sect->atoms[prev-1];
+			if ( prevAtom->definition() == ld::Atom::definitionProxy )
+				continue;
+			fileOffsetOfEndOfLastAtom = prevAtom->finalAddress() - sect->address + sect->fileOffset + prevAtom->size();
+			lastAtomUsesNoOps = sectionUsesNops;
+			lastAtomWasThumb = prevAtom->isThumb();
+			break;
+		}
+		for (size_t atomIndex=chunk.atomStart; atomIndex < chunk.atomEnd; ++atomIndex) {
+			const ld::Atom* atom = sect->atoms[atomIndex];
 			if ( atom->definition() == ld::Atom::definitionProxy )
 				continue;
 			try {
@@ -3297,7 +3351,7 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 				// copy atom content
 				atom->copyRawContent(atomBufferLoc);
 				// apply fix ups
-				this->applyFixUps(state, baseAddress, atom, atomBufferLoc);
+				this->applyFixUps(state, baseAddress, atom, atomBufferLoc, chunk);
 				fileOffsetOfEndOfLastAtom = fileOffset+atom->size();
 				lastAtomUsesNoOps = sectionUsesNops;
 				lastAtomWasThumb = atom->isThumb();
@@ -3314,6 +3368,15 @@ void OutputFile::writeAtoms(ld::Internal& state, uint8_t* wholeBuffer)
 	if ( exception != nullptr )
 		throw exception;
 
+#if SUPPORT_ARCH_arm64e
+	for (const AtomChunk& chunk : chunks) {
+		for (const auto& entry : chunk.authenticatedFixupData) {
+			assert(_authenticatedFixupData.find(entry.first) == _authenticatedFixupData.end());
+			_authenticatedFixupData[entry.first] = entry.second;
+		}
+	}
+#endif
+
 	if ( _options.verboseOptimizationHints() ) {
 		//fprintf(stderr, "ADRP optimized away:   %d\n", sAdrpNA);
 		//fprintf(stderr, "ADRPs changed to NOPs: %d\n", sAdrpNoped);
@@ -3837,141 +3900,209 @@ void OutputFile::chain32bitPointers(dyld_chained_ptr_32_rebase* prevLoc, dyld_ch
 }
 
 
-void OutputFile::computeContentUUID(ld::Internal& state, uint8_t* wholeBuffer)
+void OutputFile::uuidExcludedRanges(ld::Internal& state, FileRanges& excludeRegions)
 {
 	const bool log = false;
-	if ( (_options.outputKind() != Options::kObjectFile) || state.someObjectFileHasDwarf ) {
-		uint8_t digest[CCSHA256_OUTPUT_SIZE];
-		std::vector<std::pair<uint64_t, uint64_t>> excludeRegions;
-		uint64_t bitcodeCmdOffset;
-		uint64_t bitcodeCmdEnd;
-		uint64_t bitcodeSectOffset;
-		uint64_t bitcodePaddingEnd;
-		if ( _headersAndLoadCommandAtom->bitcodeBundleCommand(bitcodeCmdOffset, bitcodeCmdEnd,
-															  bitcodeSectOffset, bitcodePaddingEnd) ) {
-			// Exclude embedded bitcode bundle section which contains timestamps in XAR header
-			// Note the timestamp is in the compressed XML header which means it might change the size of
-			// bitcode section. The load command which include the size of the section and the padding after
-			// the bitcode section should also be excluded in the UUID computation.
-			// Bitcode section should appears before LINKEDIT
-			// Exclude section cmd
-			if ( log ) fprintf(stderr, "bundle cmd start=0x%08llX, bundle cmd end=0x%08llX\n",
-							   bitcodeCmdOffset, bitcodeCmdEnd);
-			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(bitcodeCmdOffset, bitcodeCmdEnd));
-			// Exclude section content
-			if ( log ) fprintf(stderr, "bundle start=0x%08llX, bundle end=0x%08llX\n",
-							   bitcodeSectOffset, bitcodePaddingEnd);
-			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(bitcodeSectOffset, bitcodePaddingEnd));
+	uint64_t bitcodeCmdOffset;
+	uint64_t bitcodeCmdEnd;
+	uint64_t bitcodeSectOffset;
+	uint64_t bitcodePaddingEnd;
+	if ( _headersAndLoadCommandAtom->bitcodeBundleCommand(bitcodeCmdOffset, bitcodeCmdEnd,
+														  bitcodeSectOffset, bitcodePaddingEnd) ) {
+		// Exclude embedded bitcode bundle section which contains timestamps in XAR header
+		// Note the timestamp is in the compressed XML header which means it might change the size of
+		// bitcode section. The load command which include the size of the section and the padding after
+		// the bitcode section should also be excluded in the UUID computation.
+		// Bitcode section should appears before LINKEDIT
+		// Exclude section cmd
+		if ( log ) fprintf(stderr, "bundle cmd start=0x%08llX, bundle cmd end=0x%08llX\n",
+						   bitcodeCmdOffset, bitcodeCmdEnd);
+		excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(bitcodeCmdOffset, bitcodeCmdEnd));
+		// Exclude section content
+		if ( log ) fprintf(stderr, "bundle start=0x%08llX, bundle end=0x%08llX\n",
+						   bitcodeSectOffset, bitcodePaddingEnd);
+		excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(bitcodeSectOffset, bitcodePaddingEnd));
+	}
+	const uint64_t pointerSize = (_options.architecture() & CPU_ARCH_ABI64) ? 8 : 4;
+	uint32_t	stabsStringsOffsetStart;
+	uint32_t	tabsStringsOffsetEnd;
+	uint32_t	stabsOffsetStart;
+	uint32_t	stabsOffsetEnd;
+	if ( _symbolTableAtom->hasStabs(stabsStringsOffsetStart, tabsStringsOffsetEnd, stabsOffsetStart, stabsOffsetEnd) ) {
+		// find two areas of file that are stabs info and should not contribute to checksum
+		uint64_t stringPoolFileOffset  = 0;
+		uint64_t stringPoolFileSize    = 0;
+		uint64_t symbolTableFileOffset = 0;
+		for (std::vector<ld::Internal::FinalSection*>::iterator sit = state.sections.begin(); sit != state.sections.end(); ++sit) {
+			ld::Internal::FinalSection* sect = *sit;
+			if ( sect->type() == ld::Section::typeLinkEdit ) {
+				if ( strcmp(sect->sectionName(), "__string_pool") == 0 ) {
+					stringPoolFileOffset = sect->fileOffset;
+					stringPoolFileSize   = sect->size;
+				}
+				else if ( strcmp(sect->sectionName(), "__symbol_table") == 0 )
+					symbolTableFileOffset = sect->fileOffset;
+			}
 		}
-		const uint64_t pointerSize = (_options.architecture() & CPU_ARCH_ABI64) ? 8 : 4;
-		uint32_t	stabsStringsOffsetStart;
-		uint32_t	tabsStringsOffsetEnd;
-		uint32_t	stabsOffsetStart;
-		uint32_t	stabsOffsetEnd;
-		if ( _symbolTableAtom->hasStabs(stabsStringsOffsetStart, tabsStringsOffsetEnd, stabsOffsetStart, stabsOffsetEnd) ) {
-			// find two areas of file that are stabs info and should not contribute to checksum
-			uint64_t stringPoolFileOffset  = 0;
-			uint64_t stringPoolFileSize    = 0;
-			uint64_t symbolTableFileOffset = 0;
-			for (std::vector<ld::Internal::FinalSection*>::iterator sit = state.sections.begin(); sit != state.sections.end(); ++sit) {
-				ld::Internal::FinalSection* sect = *sit;
-				if ( sect->type() == ld::Section::typeLinkEdit ) {
-					if ( strcmp(sect->sectionName(), "__string_pool") == 0 ) {
-						stringPoolFileOffset = sect->fileOffset;
-						stringPoolFileSize   = sect->size;
-					}
-					else if ( strcmp(sect->sectionName(), "__symbol_table") == 0 )
-						symbolTableFileOffset = sect->fileOffset;
-				}
-			}
-			uint64_t firstStabNlistFileOffset  = symbolTableFileOffset + stabsOffsetStart;
-			uint64_t lastStabNlistFileOffset   = symbolTableFileOffset + stabsOffsetEnd;
-			uint64_t firstStabStringFileOffset = stringPoolFileOffset  + stabsStringsOffsetStart;
-			uint64_t lastStabStringFileOffset  = stringPoolFileOffset  + tabsStringsOffsetEnd;
-			if ( log ) fprintf(stderr, "stabNlist offset=0x%08llX, size=0x%08llX\n", firstStabNlistFileOffset, lastStabNlistFileOffset-firstStabNlistFileOffset);
-			if ( log ) fprintf(stderr, "stabString offset=0x%08llX, size=0x%08llX\n", firstStabStringFileOffset, lastStabStringFileOffset-firstStabStringFileOffset);
-			assert(firstStabNlistFileOffset <= firstStabStringFileOffset);
-			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabNlistFileOffset, lastStabNlistFileOffset));
-			// <rdar://problem/50666172> don't MD5 the zero padding at the end of the string pool, after the stabs strings
-			if ( (stringPoolFileSize - tabsStringsOffsetEnd) < pointerSize )
-				excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabStringFileOffset, stringPoolFileOffset + stringPoolFileSize));
-			else
-				excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabStringFileOffset, lastStabStringFileOffset));
-			// exclude LINKEDIT LC_SEGMENT (size field depends on stabs size)
-			uint64_t linkeditSegCmdOffset;
-			uint64_t linkeditSegCmdSize;
-			_headersAndLoadCommandAtom->linkeditCmdInfo(linkeditSegCmdOffset, linkeditSegCmdSize);
-			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(linkeditSegCmdOffset, linkeditSegCmdOffset+linkeditSegCmdSize));
-			if ( log ) fprintf(stderr, "linkedit SegCmdOffset=0x%08llX, size=0x%08llX\n", linkeditSegCmdOffset, linkeditSegCmdSize);
-			uint64_t symbolTableCmdOffset;
-			uint64_t symbolTableCmdSize;
-			_headersAndLoadCommandAtom->symbolTableCmdInfo(symbolTableCmdOffset, symbolTableCmdSize);
-			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(symbolTableCmdOffset, symbolTableCmdOffset+symbolTableCmdSize));
-			if ( log ) fprintf(stderr, "linkedit SegCmdOffset=0x%08llX, size=0x%08llX\n", symbolTableCmdOffset, symbolTableCmdSize);
+		uint64_t firstStabNlistFileOffset  = symbolTableFileOffset + stabsOffsetStart;
+		uint64_t lastStabNlistFileOffset   = symbolTableFileOffset + stabsOffsetEnd;
+		uint64_t firstStabStringFileOffset = stringPoolFileOffset  + stabsStringsOffsetStart;
+		uint64_t lastStabStringFileOffset  = stringPoolFileOffset  + tabsStringsOffsetEnd;
+		if ( log ) fprintf(stderr, "stabNlist offset=0x%08llX, size=0x%08llX\n", firstStabNlistFileOffset, lastStabNlistFileOffset-firstStabNlistFileOffset);
+		if ( log ) fprintf(stderr, "stabString offset=0x%08llX, size=0x%08llX\n", firstStabStringFileOffset, lastStabStringFileOffset-firstStabStringFileOffset);
+		assert(firstStabNlistFileOffset <= firstStabStringFileOffset);
+		excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabNlistFileOffset, lastStabNlistFileOffset));
+		// <rdar://problem/50666172> don't MD5 the zero padding at the end of the string pool, after the stabs strings
+		if ( (stringPoolFileSize - tabsStringsOffsetEnd) < pointerSize )
+			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabStringFileOffset, stringPoolFileOffset + stringPoolFileSize));
+		else
+			excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(firstStabStringFileOffset, lastStabStringFileOffset));
+		// exclude LINKEDIT LC_SEGMENT (size field depends on stabs size)
+		uint64_t linkeditSegCmdOffset;
+		uint64_t linkeditSegCmdSize;
+		_headersAndLoadCommandAtom->linkeditCmdInfo(linkeditSegCmdOffset, linkeditSegCmdSize);
+		excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(linkeditSegCmdOffset, linkeditSegCmdOffset+linkeditSegCmdSize));
+		if ( log ) fprintf(stderr, "linkedit SegCmdOffset=0x%08llX, size=0x%08llX\n", linkeditSegCmdOffset, linkeditSegCmdSize);
+		uint64_t symbolTableCmdOffset;
+		uint64_t symbolTableCmdSize;
+		_headersAndLoadCommandAtom->symbolTableCmdInfo(symbolTableCmdOffset, symbolTableCmdSize);
+		excludeRegions.emplace_back(std::pair<uint64_t, uint64_t>(symbolTableCmdOffset, symbolTableCmdOffset+symbolTableCmdSize));
+		if ( log ) fprintf(stderr, "linkedit SegCmdOffset=0x%08llX, size=0x%08llX\n", symbolTableCmdOffset, symbolTableCmdSize);
+	}
+}
+
+void OutputFile::contentUUID(const Options& opts, const uint8_t* wholeBuffer, uint64_t fileSize,
+							 FileRanges excludeRegions, uint8_t uuid[16])
+{
+	const bool log = false;
+	uint8_t digest[CCSHA256_OUTPUT_SIZE];
+	const ccdigest_info* di = ccsha256_di();
+	ccdigest_di_decl(di, ctx);
+	ccdigest_init(di, ctx);
+	// rdar://problem/19487042 include the output leaf file name in the hash
+	const char* lastSlash = strrchr(opts.outputFilePath(), '/');
+	if ( lastSlash !=  NULL ) {
+		ccdigest_update(di, ctx, strlen(lastSlash), lastSlash);
+	}
+	// <rdar://problem/38679559> use train name when calculating a binary's UUID
+	const char* buildName = opts.buildContextName();
+	if ( buildName != NULL ) {
+		ccdigest_update(di, ctx, strlen(buildName), buildName);
+	}
+
+	if ( opts.UUIDTreeHash() ) {
+		// -uuid_tree_hash: split the measured ranges in fixed size chunks, hash them in parallel,
+		// then hash the list of chunk hashes.  The chunks only depend on the file layout, so the
+		// result does not depend on how many threads did the work.
+		const uint64_t chunkSize = 1024*1024;
+		std::sort(excludeRegions.begin(), excludeRegions.end());
+		std::vector<std::pair<uint64_t, uint64_t>> chunks;
+		uint64_t checksumStart = 0;
+		for ( auto& region : excludeRegions ) {
+			assert(checksumStart <= region.first && region.first <= region.second && "Region overlapped");
+			for (uint64_t start=checksumStart; start < region.first; start += chunkSize)
+				chunks.emplace_back(start, std::min(chunkSize, region.first - start));
+			checksumStart = region.second;
 		}
-		const ccdigest_info* di = ccsha256_di();
-		ccdigest_di_decl(di, ctx);
-		ccdigest_init(di, ctx);
-		// rdar://problem/19487042 include the output leaf file name in the hash
-		const char* lastSlash = strrchr(_options.outputFilePath(), '/');
-		if ( lastSlash !=  NULL ) {
-			ccdigest_update(di, ctx, strlen(lastSlash), lastSlash);
+		for (uint64_t start=checksumStart; start < fileSize; start += chunkSize)
+			chunks.emplace_back(start, std::min(chunkSize, fileSize - start));
+
+		struct Digest
+		{
+			uint8_t digest[CCSHA256_OUTPUT_SIZE];
+		};
+		__block std::vector<Digest> digests(chunks.size());
+		ld::parallelFor(chunks.size(), ^(size_t index) {
+			CCDigest(kCCDigestSHA256, &wholeBuffer[chunks[index].first], chunks[index].second, digests[index].digest);
+		});
+		ccdigest_update(di, ctx, digests.size() * sizeof(Digest), digests.data());
+	}
+	else if ( !excludeRegions.empty() ) {
+		// Work out which ranges of the file to measure, ignoring the exluded regions
+		std::sort(excludeRegions.begin(), excludeRegions.end());
+		std::vector<std::pair<uint64_t, uint64_t>> regionsToMeasure;
+		uint64_t checksumStart = 0;
+		for ( auto& region : excludeRegions ) {
+			uint64_t regionStart = region.first;
+			uint64_t regionEnd = region.second;
+			assert(checksumStart <= regionStart && regionStart <= regionEnd && "Region overlapped");
+			if ( log ) fprintf(stderr, "checksum 0x%08llX -> 0x%08llX\n", checksumStart, regionStart);
+			regionsToMeasure.emplace_back(checksumStart, regionStart - checksumStart);
+			checksumStart = regionEnd;
 		}
-		// <rdar://problem/38679559> use train name when calculating a binary's UUID
-		const char* buildName = _options.buildContextName();
-		if ( buildName != NULL ) {
-			ccdigest_update(di, ctx, strlen(buildName), buildName);
+		if ( checksumStart < fileSize ) {
+			if ( log ) fprintf(stderr, "checksum 0x%08llX -> 0x%08llX\n", checksumStart, fileSize);
+			regionsToMeasure.emplace_back(checksumStart, fileSize-checksumStart);
 		}
 
-		if ( !excludeRegions.empty() ) {
-			// Work out which ranges of the file to measure, ignoring the exluded regions
-			std::sort(excludeRegions.begin(), excludeRegions.end());
-			std::vector<std::pair<uint64_t, uint64_t>> regionsToMeasure;
-			uint64_t checksumStart = 0;
-			for ( auto& region : excludeRegions ) {
-				uint64_t regionStart = region.first;
-				uint64_t regionEnd = region.second;
-				assert(checksumStart <= regionStart && regionStart <= regionEnd && "Region overlapped");
-				if ( log ) fprintf(stderr, "checksum 0x%08llX -> 0x%08llX\n", checksumStart, regionStart);
-				regionsToMeasure.emplace_back(checksumStart, regionStart - checksumStart);
-				checksumStart = regionEnd;
-			}
-			if ( checksumStart < _fileSize ) {
-				if ( log ) fprintf(stderr, "checksum 0x%08llX -> 0x%08llX\n", checksumStart, _fileSize);
-				regionsToMeasure.emplace_back(checksumStart, _fileSize-checksumStart);
-			}
-
-			// Measure the ranges we want in parallel
-			struct Digest
-			{
-				uint8_t digest[CCSHA256_OUTPUT_SIZE];
-			};
-			__block std::vector<Digest> digests(regionsToMeasure.size());
-			dispatch_apply(regionsToMeasure.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
-				uint64_t startOffset = regionsToMeasure[index].first;
-				uint64_t size = regionsToMeasure[index].second;
-				CCDigest(kCCDigestSHA256, &wholeBuffer[startOffset], size, digests[index].digest);
-			});
+		// Measure the ranges we want in parallel
+		struct Digest
+		{
+			uint8_t digest[CCSHA256_OUTPUT_SIZE];
+		};
+		__block std::vector<Digest> digests(regionsToMeasure.size());
+		ld::parallelFor(regionsToMeasure.size(), ^(size_t index) {
+			uint64_t startOffset = regionsToMeasure[index].first;
+			uint64_t size = regionsToMeasure[index].second;
+			CCDigest(kCCDigestSHA256, &wholeBuffer[startOffset], size, digests[index].digest);
+		});
 
-			// Merge the resuls in serial
-			ccdigest_update(di, ctx, digests.size() * sizeof(Digest), digests.data());
-		} else {
-			ccdigest_update(di, ctx, _fileSize, wholeBuffer);
-		}
+		// Merge the resuls in serial
+		ccdigest_update(di, ctx, digests.size() * sizeof(Digest), digests.data());
+	} else {
+		ccdigest_update(di, ctx, fileSize, wholeBuffer);
+	}
+
+	ccdigest_final(di, ctx, digest);
+	if ( log ) fprintf(stderr, "uuid=%02X, %02X, %02X, %02X, %02X, %02X, %02X, %02X\n", digest[0], digest[1], digest[2],
+						 digest[3], digest[4], digest[5], digest[6],  digest[7]);
 
-		ccdigest_final(di, ctx, digest);
-		if ( log ) fprintf(stderr, "uuid=%02X, %02X, %02X, %02X, %02X, %02X, %02X, %02X\n", digest[0], digest[1], digest[2],
-							 digest[3], digest[4], digest[5], digest[6],  digest[7]);
+	// <rdar://problem/6723729> LC_UUID uuids should conform to RFC 4122 UUID version 4 & UUID version 5 formats
+	digest[6] = ( digest[6] & 0x0F ) | ( 3 << 4 );
+	digest[8] = ( digest[8] & 0x3F ) | 0x80;
+	memcpy(uuid, digest, 16);
+}
 
-		// <rdar://problem/6723729> LC_UUID uuids should conform to RFC 4122 UUID version 4 & UUID version 5 formats
-		digest[6] = ( digest[6] & 0x0F ) | ( 3 << 4 );
-		digest[8] = ( digest[8] & 0x3F ) | 0x80;
+void OutputFile::computeContentUUID(ld::Internal& state, uint8_t* wholeBuffer)
+{
+	if ( (_options.outputKind() != Options::kObjectFile) || state.someObjectFileHasDwarf ) {
+		FileRanges excludeRegions;
+		uuidExcludedRanges(state, excludeRegions);
+		uint8_t uuid[16];
+		contentUUID(_options, wholeBuffer, _fileSize, excludeRegions, uuid);
 		// update buffer with new UUID
-		_headersAndLoadCommandAtom->setUUID(digest);
+		_headersAndLoadCommandAtom->setUUID(uuid);
 		_headersAndLoadCommandAtom->recopyUUIDCommand();
 	}
 }
 
+uint64_t OutputFile::codeSignatureTextSize(const ld::Internal& state)
+{
+	// code signature exec segment is the range of __TEXT
+	uint64_t textSize = 0;
+	bool foundText = false;
+	for (const ld::Internal::FinalSection* sect : state.sections) {
+		if ( strcmp(sect->segmentName(), "__TEXT") == 0 )
+			foundText = true;
+		else if ( foundText && (textSize == 0) ) // find first section after __TEXT
+			textSize = sect->fileOffset;
+	}
+	return textSize;
+}
+
+void OutputFile::adHocSign(const Options& opts, uint8_t* wholeBuffer, uint64_t codeSignatureOffset,
+						   uint64_t codeSignatureSize, uint64_t textSize)
+{
+	std::unique_ptr<libcd, void (*)(libcd*)> sigRef(libcd_create(codeSignatureOffset), &libcd_free);
+	CodeSignatureAtom::configure(opts, sigRef.get(), textSize);
+	if ( libcd_superblob_size(sigRef.get()) > codeSignatureSize )
+		throw "code signature does not fit";
+	libcd_set_input_mem(sigRef.get(), wholeBuffer);
+	libcd_set_output_mem(sigRef.get(), &wholeBuffer[codeSignatureOffset], codeSignatureSize);
+	if ( libcd_serialize(sigRef.get()) != 0 )
+		throw "error code signing";
+}
+
 static int sDescriptorOfPathToRemove = -1;
 static void removePathAndExit(int sig)
 {
@@ -4025,7 +4156,7 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 	// assume mappable by default
 	bool outputIsMappableFile = true;
 
-#if __arm64__
+#if defined(__APPLE__) && __arm64__ // ld64-port
 	// <rdar://problem/66598213> work around VM limitation on Apple Silicon and use write() instead of mmap() to produce output file
 	outputIsMappableFile = false;
 #elif __x86_64__
@@ -4048,7 +4179,7 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 
 	// rdar://106830469 (ld should make fewer statfs syscalls)
 	// do a statfs call only if LD_FORCE_PWRITE_FILE isn't set
-	if ( outputIsRegularFile && outputIsMappableFile ) {
+	if ( outputIsRegularFile && outputIsMappableFile && !_options.mmapOutput() ) {
 		// clear mappable file state, it will be set if fs is supported
 		outputIsMappableFile = false;
 
@@ -4094,7 +4225,15 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 		}
 		if ( fd == -1 ) 
 			throwf("can't open output file for writing '%s', errno=%d", tmpOutput, errno);
-		if ( ftruncate(fd, _fileSize) == -1 ) {
+#ifdef __linux__ // ld64-port
+		// reserve all blocks up front so that faulting in the mapping does not allocate them one page at a time
+		int growResult = ::fallocate(fd, 0, 0, _fileSize);
+		if ( (growResult == -1) && (errno == EOPNOTSUPP) )
+			growResult = ftruncate(fd, _fileSize);
+#else
+		int growResult = ftruncate(fd, _fileSize);
+#endif
+		if ( growResult == -1 ) {
 			int err = errno;
 			unlink(tmpOutput);
 			if ( err == ENOSPC )
@@ -4103,9 +4242,22 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 				throwf("can't grow file for writing '%s', errno=%d", _options.outputFilePath(), err);
 		}
 		
-		wholeBuffer = (uint8_t *)mmap(NULL, _fileSize, PROT_WRITE|PROT_READ, MAP_SHARED, fd, 0);
+		int mapFlags = MAP_SHARED;
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE) // ld64-port
+		mapFlags |= MAP_POPULATE;
+#endif
+		wholeBuffer = (uint8_t *)mmap(NULL, _fileSize, PROT_WRITE|PROT_READ, mapFlags, fd, 0);
 		if ( wholeBuffer == MAP_FAILED )
 			throwf("can't create buffer of %llu bytes for output", _fileSize);
+#ifdef __linux__ // ld64-port
+		// large outputs can use transparent huge pages where the file system supports them,
+		// then fault in every page for writing now instead of while the atoms are copied
+		if ( _fileSize >= 2*1024*1024 )
+			(void)::madvise(wholeBuffer, _fileSize, MADV_HUGEPAGE);
+#ifdef MADV_POPULATE_WRITE
+		(void)::madvise(wholeBuffer, _fileSize, MADV_POPULATE_WRITE);
+#endif
+#endif
 	} 
 	else {
 		if ( outputIsRegularFile )
@@ -4130,17 +4282,71 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 #endif
 	}
 
-	writeAtoms(state, wholeBuffer);
+	{
+		ld::timeline::Span span("writeAtoms", "output");
+		writeAtoms(state, wholeBuffer);
+	}
 	
-	// compute UUID 
-	if ( _options.UUIDMode() == Options::kUUIDContent )
-		computeContentUUID(state, wholeBuffer);
-
-	// now that file output buffer is complete, if codesigned, compute each page's hash
-	if ( _hasCodeSignature )
-		_codeSignatureAtom->hash(wholeBuffer);
+	void (^finishContent)(void) = ^{
+		// compute UUID 
+		if ( _options.UUIDMode() == Options::kUUIDContent ) {
+			ld::timeline::Span span("computeContentUUID", "output");
+			computeContentUUID(state, wholeBuffer);
+		}
 
-	if ( outputIsRegularFile && outputIsMappableFile ) {
+		// now that file output buffer is complete, if codesigned, compute each page's hash
+		if ( _hasCodeSignature ) {
+			ld::timeline::Span span("codeSignatureHash", "output");
+			_codeSignatureAtom->hash(wholeBuffer);
+		}
+	};
+
+	// When the output is assembled in a heap buffer, the UUID and code signature only change the
+	// mach header and the code signature.  When the signature is the last thing in the file,
+	// everything in between is final, so it is written out in page aligned blocks while the
+	// complete buffer is hashed.  The whole image is still built in memory before any of it is written.
+	const bool signatureIsLast = !_hasCodeSignature
+								|| ((codeSignatureSection != NULL) && (codeSignatureSection == state.sections.back()));
+	if ( outputIsRegularFile && !outputIsMappableFile && signatureIsLast ) {
+		uint64_t headerEnd = 0;
+		for (ld::Internal::FinalSection* sect : state.sections) {
+			if ( sect->type() == ld::Section::typeMachHeader )
+				headerEnd = std::max(headerEnd, sect->fileOffset + sect->size);
+		}
+		uint64_t tailStart = _hasCodeSignature ? codeSignatureSection->fileOffset : _fileSize;
+		tailStart = std::min(tailStart, _fileSize);
+		headerEnd = std::min(pageAlign(headerEnd), tailStart);
+		__block int writeErrno = 0;
+		ld::parallelFor(2, ^(size_t index) {
+			if ( index == 0 ) {
+				ld::timeline::Span span("writeOutputBody", "output");
+				const uint64_t blockSize = 4*1024*1024;
+				for (uint64_t offset=headerEnd; offset < tailStart; offset += blockSize) {
+					size_t size = (size_t)std::min(blockSize, tailStart - offset);
+					if ( ld::utils::pwrite64(fd, &wholeBuffer[offset], size, offset) == -1 ) {
+						writeErrno = errno;
+						break;
+					}
+				}
+			}
+			else {
+				finishContent();
+			}
+		});
+		if ( (writeErrno == 0) && (ld::utils::pwrite64(fd, wholeBuffer, (size_t)headerEnd, 0) == -1) )
+			writeErrno = errno;
+		if ( (writeErrno == 0) && (ld::utils::pwrite64(fd, &wholeBuffer[tailStart], (size_t)(_fileSize - tailStart), tailStart) == -1) )
+			writeErrno = errno;
+		if ( writeErrno != 0 )
+			throwf("can't write to output file: %s, errno=%d", _options.outputFilePath(), writeErrno);
+		sDescriptorOfPathToRemove = -1;
+		::close(fd);
+		// <rdar://problem/13118223> NFS: iOS incremental builds in Xcode 4.6 fail with codesign error
+		// NFS seems to pad the end of the file sometimes.  Calling trunc seems to correct it...
+		::truncate(_options.outputFilePath(), _fileSize);
+	}
+	else if ( outputIsRegularFile && outputIsMappableFile ) {
+		finishContent();
 		::close(fd);
 		if ( ::chmod(tmpOutput, permissions) == -1 ) {
 			unlink(tmpOutput);
@@ -4152,6 +4358,7 @@ void OutputFile::writeOutputFile(ld::Internal& state)
 		}
 	} 
 	else {
+		finishContent();
 		if ( ld::utils::write64(fd, wholeBuffer, _fileSize) == -1 ) {
 			throwf("can't write to output file: %s, errno=%d", _options.outputFilePath(), errno);
 		}
@@ -7967,13 +8174,11 @@ void OutputFile::synthesizeDebugNotes(ld::Internal& state)
 
 void OutputFile::buildLINKEDITContent(ld::Internal& state)
 {
-	dispatch_group_t 		group = dispatch_group_create();
-	// ld64-port: QOS_CLASS_USER_INITIATED -> DISPATCH_QUEUE_PRIORITY_HIGH
-	dispatch_queue_global_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0);
+	ld::TaskGroup			group;
 
 	// phase 1: build state.stabs and _importedAtoms, _exportedAtoms, _localAtoms in parallel
 	__block const char* exceptionMsg = nullptr;
-	dispatch_group_async(group, queue, ^{
+	group.async(^{
 		try {
 			this->synthesizeDebugNotes(state);	// needs state.section.atoms, updates: state.stabs
 		}
@@ -7981,7 +8186,7 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 				exceptionMsg = msg;
 		}
 	});
-	dispatch_group_async(group, queue, ^{
+	group.async(^{
 		try {
 			this->partitionSymbolTable(state);	// needs state.section.atoms, updates: _importedAtoms, _exportedAtoms, _localAtoms, `Atom::_outputSymbolIndex`
 		}
@@ -7989,7 +8194,7 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 				exceptionMsg = msg;
 		}
 	});
-	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	group.wait();
 	if ( exceptionMsg != nullptr )
 		throw exceptionMsg;
 
@@ -7998,7 +8203,7 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 
 	// phase 3: build linkedit parts in parallel that depend on results of phase 1
 	if ( _hasDyldInfo || _hasSectionRelocations || _hasLocalRelocations || _hasExternalRelocations || _hasThreadedPageStarts ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			try {
 				this->buildLinkEditOpcodes(state);	// needs state.section.atoms, `Atom::_outputSymbolIndex`, updates: _rebasingInfoAtom, _bindingInfoAtom, _weakBindingInfoAtom, _weakBindingInfoAtom, _sectionsRelocationsAtom
 			}
@@ -8008,7 +8213,7 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 		});
 	}
 	else if ( _hasChainedFixups ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			try {
 				this->buildChainedFixupInfo(state);  // needs state.section.atoms, updates: _chainedFixupSegments, _importedSymbolsCount, _chainedInfoAtom
 			}
@@ -8018,13 +8223,13 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 		});
 	}
 	if ( _options.sharedRegionEligible() ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			this->makeSplitSegInfo(state);	 // needs state.section.atoms, updates: _splitSegInfoAtom
 			_splitSegInfoAtom->encode();
 		});
 	}
 	if ( _exportInfoAtom != nullptr ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 				try {
 					_exportInfoAtom->encode(); 		// needs _exportedAtoms, updates: _exportInfoAtom
 				} catch ( const char* msg ) {
@@ -8032,7 +8237,7 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 				}
 		});
 	}
-	dispatch_group_async(group, queue, ^{
+	group.async(^{
 		try {
 			_symbolTableAtom->encode();			// needs _importedAtoms, _exportedAtoms, _localAtoms, state.stabs, updates: _symbolTableAtom
 			_indirectSymbolTableAtom->encode(); // needs state.section.atoms, `Atom::_outputSymbolIndex`, updates:  _indirectSymbolTableAtom
@@ -8042,23 +8247,21 @@ void OutputFile::buildLINKEDITContent(ld::Internal& state)
 		}
 	});
 	if ( _functionStartsAtom != nullptr ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			_functionStartsAtom->encode();	// needs state.section.atoms
 		});
 	}
 	if ( _dataInCodeAtom != nullptr ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			_dataInCodeAtom->encode();		// needs state.section.atoms
 		});
 	}
 	if ( _optimizationHintsAtom != nullptr ) {
-		dispatch_group_async(group, queue, ^{
+		group.async(^{
 			_optimizationHintsAtom->encode(); // needs state.section.atoms
 		});
 	}
-	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-
-	dispatch_release(group);
+	group.wait();
 
 	if ( exceptionMsg != nullptr )
 		throw exceptionMsg;
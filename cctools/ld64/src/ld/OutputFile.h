@@ -65,6 +65,16 @@ public:
 	uint32_t					encryptedTextEndOffset()	{ return _encryptedTEXTendOffset; }
 	int							compressedOrdinalForAtom(const ld::Atom* target) const;
 	uint64_t					fileSize() const { return _fileSize; }
+	const char* 				canonicalOSOPath(const char* path);
+
+	// -incremental uses these to bring the UUID and code signature of a patched output up to date
+	typedef std::vector<std::pair<uint64_t, uint64_t>>	FileRanges;
+	void						uuidExcludedRanges(ld::Internal& state, FileRanges& excludeRanges);
+	static void					contentUUID(const Options& opts, const uint8_t* wholeBuffer, uint64_t fileSize,
+											FileRanges excludeRanges, uint8_t uuid[16]);
+	static uint64_t				codeSignatureTextSize(const ld::Internal& state);
+	static void					adHocSign(const Options& opts, uint8_t* wholeBuffer, uint64_t codeSignatureOffset,
+										  uint64_t codeSignatureSize, uint64_t textSize);
 
 	bool						targetNeedsNoFixup(const ld::Atom* toTarget);
 	bool						needsBind(const ld::Atom*& toTarget, bool authPtr, uint64_t* accumulator = nullptr,
@@ -178,6 +188,18 @@ public:
 	};
 
 private:
+	// writeAtoms() splits big sections into ranges of atoms that are written in parallel
+	struct AtomChunk
+	{
+		ld::Internal::FinalSection*		sect;
+		size_t							atomStart;
+		size_t							atomEnd;
+#if SUPPORT_ARCH_arm64e
+		// authenticated pointers found by applyFixUps(), merged into _authenticatedFixupData once all chunks are done
+		std::vector<std::pair<uintptr_t, std::pair<Fixup::AuthData, uint64_t>>>	authenticatedFixupData;
+#endif
+	};
+
 	void						writeAtoms(ld::Internal& state, uint8_t* wholeBuffer);
 	void						computeContentUUID(ld::Internal& state, uint8_t* wholeBuffer);
 	void						buildDylibOrdinalMapping(ld::Internal&);
@@ -232,7 +254,7 @@ private:
 	void						updateLINKEDITAddresses(ld::Internal& state);
 	void						encodeLINKEDIT(ld::Internal& state);
 	void						buildLINKEDITContent(ld::Internal& state);
-	void						applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom*  atom, uint8_t* buffer);
+	void						applyFixUps(ld::Internal& state, uint64_t mhAddress, const ld::Atom*  atom, uint8_t* buffer, AtomChunk& chunk);
 	uint64_t					addressOf(const ld::Internal& state, const ld::Fixup* fixup, const ld::Atom** target);
 	uint64_t					addressAndTarget(const ld::Internal& state, const ld::Fixup* fixup, const ld::Atom** target);
 	bool						targetIsThumb(ld::Internal& state, const ld::Fixup* fixup);
@@ -292,7 +314,6 @@ private:
 	uint64_t					tlvTemplateOffsetOf(const ld::Internal& state, const ld::Fixup* fixup);
 	void						synthesizeDebugNotes(ld::Internal& state);
 	const char*					assureFullPath(const char* path);
-	const char* 				canonicalOSOPath(const char* path);
 	void						noteTextReloc(const ld::Atom* atom, const ld::Atom* target);
 	void 						setFixup64(uint8_t* fixUpLocation, uint64_t accumulator, const ld::Atom* toTarget);
 	void 						setFixup32(uint8_t* fixUpLocation, uint64_t accumulator, const ld::Atom* toTarget);
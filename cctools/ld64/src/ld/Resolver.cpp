@@ -38,7 +38,6 @@
 #include <dlfcn.h>
 #include <mach-o/dyld.h>
 #include <mach-o/fat.h>
-#include <dispatch/dispatch.h>
 
 #include <string>
 #include <sstream>
@@ -57,6 +56,8 @@
 #include "InputFiles.h"
 #include "Mangling.h"
 #include "SymbolTable.h"
+#include "TaskPool.h"
+#include "Timeline.h"
 #include "Resolver.h"
 #include "parsers/lto_file.h"
 
@@ -1090,117 +1091,217 @@ void Resolver::resolveAllUndefines()
 }
 
 
-void Resolver::markLive(const ld::Atom& atom, WhyLiveBackChain* previous)
+//
+// Walks a graph with work lists instead of recursion, so long chains don't need deep stacks.
+// The walk runs in rounds.  Each round splits pending into slices of sliceItems, which run in
+// parallel.  A slice walks depth first on its own stack: visit(item, stack) pushes the items it
+// claims onto stack, and returns false if item has to be finished on the calling thread.  After
+// sliceBudget items a slice hands the rest of its stack to the next round, so a few deep chains
+// are spread over all threads again.  At the end of a round, finish(item, pending) is called on
+// the calling thread for each item visit() returned false for.  With serial, or with only one
+// thread, each round is one slice without a budget: slices walk scattered parts of the graph, which
+// costs cache misses that only pay off when other threads share the work.
+//
+template <typename T, typename Visit, typename Finish>
+static void walkInRounds(std::vector<T>& pending, bool serial, size_t sliceItems, size_t sliceBudget,
+						 const Visit& visit, const Finish& finish)
 {
-	//fprintf(stderr, "markLive(%p) %s\n", &atom, atom.name());
-	// if -why_live cares about this symbol, then dump chain
-	if ( _printWhyLive ) {
-		[[unlikely]]
-		if ( (previous->referer != NULL) && _options.printWhyLive(atom.name()) ) {
-			fprintf(stderr, "%s from %s\n", atom.name(), atom.safeFilePath());
-			int depth = 1;
-			for(WhyLiveBackChain* p = previous; p != NULL; p = p->previous, ++depth) {
-				for(int i=depth; i > 0; --i)
-					fprintf(stderr, "  ");
-				fprintf(stderr, "%s from %s\n", p->referer->name(), p->referer->safeFilePath());
+	if ( ld::threadCount() == 1 )
+		serial = true;
+	while ( !pending.empty() ) {
+		const size_t sliceCount = serial ? 1 : (pending.size() + sliceItems - 1) / sliceItems;
+		std::vector<std::vector<T>> sliceStacks(sliceCount);
+		std::vector<std::vector<T>> sliceUnfinished(sliceCount);
+		std::vector<T>* stacks = sliceStacks.data();
+		std::vector<T>* unfinished = sliceUnfinished.data();
+		const T* pendingItems = pending.data();
+		const size_t pendingCount = pending.size();
+		const Visit* visitPtr = &visit;
+		ld::parallelFor(sliceCount, ^(size_t slice) {
+			std::vector<T>& stack = stacks[slice];
+			const size_t begin = serial ? 0 : slice * sliceItems;
+			const size_t end = serial ? pendingCount : std::min(begin + sliceItems, pendingCount);
+			stack.assign(&pendingItems[begin], &pendingItems[end]);
+			for (size_t budget = (serial ? SIZE_MAX : sliceBudget); !stack.empty() && (budget > 0); --budget) {
+				T item = stack.back();
+				stack.pop_back();
+				if ( !(*visitPtr)(item, stack) )
+					unfinished[slice].push_back(item);
 			}
+		});
+
+		// what the slices did not get to is the next round's work
+		pending.clear();
+		for (const std::vector<T>& stack : sliceStacks)
+			pending.insert(pending.end(), stack.begin(), stack.end());
+		for (const std::vector<T>& items : sliceUnfinished) {
+			for (T item : items)
+				finish(item, pending);
 		}
 	}
+}
 
-	// if already marked live, then done (stop recursion)
-	if ( atom.live() )
-		return;
-		
-	// mark this atom is live
-	(const_cast<ld::Atom*>(&atom))->setLive();
-	
-	// mark all atoms it references as live
-	WhyLiveBackChain thisChain;
-	thisChain.previous = previous;
-	thisChain.referer = &atom;
-	for (ld::Fixup::iterator fit = atom.fixupsBegin(), end=atom.fixupsEnd(); fit != end; ++fit) {
-		const ld::Atom* target;
-		switch ( fit->kind ) {
-			case ld::Fixup::kindNone:
-			case ld::Fixup::kindNoneFollowOn:
-			case ld::Fixup::kindNoneGroupSubordinate:
-			case ld::Fixup::kindNoneGroupSubordinateFDE:
-			case ld::Fixup::kindNoneGroupSubordinateLSDA:
-			case ld::Fixup::kindNoneGroupSubordinatePersonality:
-			case ld::Fixup::kindSetTargetAddress:
-			case ld::Fixup::kindSubtractTargetAddress:
-			case ld::Fixup::kindStoreTargetAddressLittleEndian32:
-			case ld::Fixup::kindStoreTargetAddressLittleEndian64:
+//
+// Dead stripping marks atoms live with walkInRounds().  Each atom is claimed with
+// Atom::claimLive(), so only one thread walks its fixups.  Atoms with references that still have
+// to be bound through the symbol table are set aside, because the symbol table is not thread safe,
+// and are finished by the calling thread at the end of each round.
+//
+static const size_t kLiveSliceAtoms		= 256;
+static const size_t kLiveSliceBudget	= 16384;
+
+static bool fixupMakesTargetLive(ld::Fixup::Kind kind)
+{
+	switch ( kind ) {
+		case ld::Fixup::kindNone:
+		case ld::Fixup::kindNoneFollowOn:
+		case ld::Fixup::kindNoneGroupSubordinate:
+		case ld::Fixup::kindNoneGroupSubordinateFDE:
+		case ld::Fixup::kindNoneGroupSubordinateLSDA:
+		case ld::Fixup::kindNoneGroupSubordinatePersonality:
+		case ld::Fixup::kindSetTargetAddress:
+		case ld::Fixup::kindSubtractTargetAddress:
+		case ld::Fixup::kindStoreTargetAddressLittleEndian32:
+		case ld::Fixup::kindStoreTargetAddressLittleEndian64:
 #if SUPPORT_ARCH_arm64e
-			case ld::Fixup::kindStoreTargetAddressLittleEndianAuth64:
+		case ld::Fixup::kindStoreTargetAddressLittleEndianAuth64:
 #endif
-			case ld::Fixup::kindStoreTargetAddressBigEndian32:
-			case ld::Fixup::kindStoreTargetAddressBigEndian64:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32:
-			case ld::Fixup::kindStoreTargetAddressX86BranchPCRel32:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoad:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoad:
-			case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoad:
-			case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoadNowLEA:
-			case ld::Fixup::kindStoreTargetAddressARMBranch24:
-			case ld::Fixup::kindStoreTargetAddressThumbBranch22:
+		case ld::Fixup::kindStoreTargetAddressBigEndian32:
+		case ld::Fixup::kindStoreTargetAddressBigEndian64:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32:
+		case ld::Fixup::kindStoreTargetAddressX86BranchPCRel32:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoad:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32GOTLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoad:
+		case ld::Fixup::kindStoreTargetAddressX86PCRel32TLVLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoad:
+		case ld::Fixup::kindStoreTargetAddressX86Abs32TLVLoadNowLEA:
+		case ld::Fixup::kindStoreTargetAddressARMBranch24:
+		case ld::Fixup::kindStoreTargetAddressThumbBranch22:
 #if SUPPORT_ARCH_arm64
-			case ld::Fixup::kindStoreTargetAddressARM64Branch26:
-			case ld::Fixup::kindStoreTargetAddressARM64Page21:
-			case ld::Fixup::kindStoreTargetAddressARM64GOTLoadPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64GOTLeaPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPage21:
-			case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64Branch26:
+		case ld::Fixup::kindStoreTargetAddressARM64Page21:
+		case ld::Fixup::kindStoreTargetAddressARM64GOTLoadPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64GOTLeaPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadPage21:
+		case ld::Fixup::kindStoreTargetAddressARM64TLVPLoadNowLeaPage21:
 #endif
-				if ( fit->binding == ld::Fixup::bindingByContentBound ) {
-					// normally this was done in convertReferencesToIndirect()
-					// but a archive loaded .o file may have a forward reference
-					SymbolTable::IndirectBindingSlot slot;
-					const ld::Atom* dummy;
-					switch ( fit->u.target->combine() ) {
-						case ld::Atom::combineNever:
-						case ld::Atom::combineByName:
-							assert(0 && "wrong combine type for bind by content");
-							break;
-						case ld::Atom::combineByNameAndContent:
-							slot = _symbolTable.findSlotForContent(fit->u.target, &dummy);
-							fit->binding = ld::Fixup::bindingsIndirectlyBound;
-							fit->u.bindingIndex = slot;
-							break;
-						case ld::Atom::combineByNameAndReferences:
-							slot = _symbolTable.findSlotForReferences(fit->u.target, &dummy);
-							fit->binding = ld::Fixup::bindingsIndirectlyBound;
-							fit->u.bindingIndex = slot;
-							break;
-					}
-				}
-				switch ( fit->binding ) {
-					case ld::Fixup::bindingDirectlyBound:
-						markLive(*(fit->u.target), &thisChain);
+			return true;
+		default:
+			return false;
+	}
+}
+
+void Resolver::printWhyLive(const ld::Atom& atom)
+{
+	// if -why_live cares about this symbol, then dump chain
+	if ( !_options.printWhyLive(atom.name()) )
+		return;
+	fprintf(stderr, "%s from %s\n", atom.name(), atom.safeFilePath());
+	int depth = 1;
+	for (const ld::Atom* p = _whyLiveReferer[&atom]; p != NULL; p = _whyLiveReferer[p], ++depth) {
+		for(int i=depth; i > 0; --i)
+			fprintf(stderr, "  ");
+		fprintf(stderr, "%s from %s\n", p->name(), p->safeFilePath());
+	}
+}
+
+// Claims the targets of a newly live atom and adds them to work.  Returns false if some references
+// still need the symbol table, bindLiveReferences() must be called for them and the atom walked again.
+bool Resolver::markLiveTargets(const ld::Atom& atom, std::vector<const ld::Atom*>& work)
+{
+	bool allBound = true;
+	for (ld::Fixup::iterator fit = atom.fixupsBegin(), end=atom.fixupsEnd(); fit != end; ++fit) {
+		if ( !fixupMakesTargetLive(fit->kind) )
+			continue;
+		const ld::Atom* target = NULL;
+		switch ( fit->binding ) {
+			case ld::Fixup::bindingDirectlyBound:
+				target = fit->u.target;
+				break;
+			case ld::Fixup::bindingsIndirectlyBound:
+				target = _internal.indirectBindingTable[fit->u.bindingIndex];
+				break;
+			case ld::Fixup::bindingByContentBound:
+			case ld::Fixup::bindingByNameUnbound:
+				allBound = false;
+				break;
+			default:
+				assert(0 && "bad binding during dead stripping");
+		}
+		if ( (target != NULL) && (const_cast<ld::Atom*>(target))->claimLive() ) {
+			if ( _printWhyLive ) {
+				_whyLiveReferer[target] = &atom;
+				printWhyLive(*target);
+			}
+			work.push_back(target);
+		}
+	}
+	return allBound;
+}
+
+void Resolver::bindLiveReferences(const ld::Atom& atom)
+{
+	for (ld::Fixup::iterator fit = atom.fixupsBegin(), end=atom.fixupsEnd(); fit != end; ++fit) {
+		if ( !fixupMakesTargetLive(fit->kind) )
+			continue;
+		SymbolTable::IndirectBindingSlot slot;
+		const ld::Atom* dummy;
+		switch ( fit->binding ) {
+			case ld::Fixup::bindingByContentBound:
+				// normally this was done in convertReferencesToIndirect()
+				// but a archive loaded .o file may have a forward reference
+				switch ( fit->u.target->combine() ) {
+					case ld::Atom::combineNever:
+					case ld::Atom::combineByName:
+						assert(0 && "wrong combine type for bind by content");
 						break;
-					case ld::Fixup::bindingByNameUnbound:
-						// doAtom() did not convert to indirect in dead-strip mode, so that now
-						fit->u.bindingIndex = _symbolTable.findSlotForName(fit->u.name);
+					case ld::Atom::combineByNameAndContent:
+						slot = _symbolTable.findSlotForContent(fit->u.target, &dummy);
 						fit->binding = ld::Fixup::bindingsIndirectlyBound;
-						// fall into next case
-						[[clang::fallthrough]];
-					case ld::Fixup::bindingsIndirectlyBound:
-						target = _internal.indirectBindingTable[fit->u.bindingIndex];
-						if ( target != NULL ) {
-							this->markLive(*target, &thisChain);
-						}
+						fit->u.bindingIndex = slot;
+						break;
+					case ld::Atom::combineByNameAndReferences:
+						slot = _symbolTable.findSlotForReferences(fit->u.target, &dummy);
+						fit->binding = ld::Fixup::bindingsIndirectlyBound;
+						fit->u.bindingIndex = slot;
 						break;
-					default:
-						assert(0 && "bad binding during dead stripping");
 				}
 				break;
-            default:
-                break;    
+			case ld::Fixup::bindingByNameUnbound:
+				// doAtom() did not convert to indirect in dead-strip mode, so that now
+				fit->u.bindingIndex = _symbolTable.findSlotForName(fit->u.name);
+				fit->binding = ld::Fixup::bindingsIndirectlyBound;
+				break;
+			default:
+				break;
 		}
 	}
+}
+
+void Resolver::markLiveRoot(const ld::Atom& atom, std::vector<const ld::Atom*>& pending)
+{
+	if ( !(const_cast<ld::Atom*>(&atom))->claimLive() )
+		return;
+	if ( _printWhyLive ) {
+		_whyLiveReferer[&atom] = NULL;
+		printWhyLive(atom);
+	}
+	pending.push_back(&atom);
+}
 
+// marks everything reachable from the pending atoms, which are already live
+void Resolver::markLive(std::vector<const ld::Atom*>& pending)
+{
+	// -why_live prints chains as atoms are reached, so keep that to one thread
+	walkInRounds(pending, _printWhyLive, kLiveSliceAtoms, kLiveSliceBudget,
+		[this](const ld::Atom* atom, std::vector<const ld::Atom*>& stack) {
+			return this->markLiveTargets(*atom, stack);
+		},
+		[this](const ld::Atom* atom, std::vector<const ld::Atom*>& work) {
+			this->bindLiveReferences(*atom);
+			this->markLiveTargets(*atom, work);
+		});
 }
 
 class LiveLTO {
@@ -1341,19 +1442,19 @@ void Resolver::deadStripOptimize(bool force)
 	std::vector<const ld::Atom*> dontDeadStripIfReferencesLive;
 
 	if ( force ) {
-		// We're in a second run of dead stripping, unset liveness so markLive() will recurse
+		// We're in a second run of dead stripping, unset liveness so markLive() will walk again
 		for (const ld::Atom* atom : _atoms) {
 			(const_cast<ld::Atom*>(atom))->setLive(false);
 		}
+		_whyLiveReferer.clear();
 	}
 
 	// mark all roots as live, and all atoms they reference
-	forEachDeadStripRoot(dontDeadStripIfReferencesLive, force, [this](const ld::Atom * atom) {
-		WhyLiveBackChain rootChain;
-		rootChain.previous = NULL;
-		rootChain.referer = atom;
-		this->markLive(*atom, &rootChain);
+	std::vector<const ld::Atom*> pending;
+	forEachDeadStripRoot(dontDeadStripIfReferencesLive, force, [this, &pending](const ld::Atom * atom) {
+		this->markLiveRoot(*atom, pending);
 	});
+	this->markLive(pending);
 	
 	// special case atoms that need to be live if they reference something live
 	for (const Atom* liveIfRefLiveAtom : dontDeadStripIfReferencesLive) {
@@ -1362,10 +1463,8 @@ void Resolver::deadStripOptimize(bool force)
 			continue;
 
 		if ( atomHasLiveRef(_internal, liveIfRefLiveAtom) ) {
-			WhyLiveBackChain rootChain;
-			rootChain.previous = NULL;
-			rootChain.referer = liveIfRefLiveAtom;
-			this->markLive(*liveIfRefLiveAtom, &rootChain);
+			this->markLiveRoot(*liveIfRefLiveAtom, pending);
+			this->markLive(pending);
 		}
 	}
 
@@ -1779,7 +1878,7 @@ void Resolver::checkDylibSymbolCollisions()
 		}
 	}
 
-	dispatch_apply(weakDefDylibs.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
+	ld::parallelFor(weakDefDylibs.size(), ^(size_t index) {
 			ld::dylib::File* dylib = weakDefDylibs[index];
 
 			dylib->forEachExportedSymbol(^(const char *symbolName, bool weakDef) {
@@ -2378,24 +2477,78 @@ void Resolver::writeDotOutput()
 }
 void Resolver::resolve()
 {
-	this->initializeState();
-	this->buildAtomList();
-	this->addInitialUndefines();
-	this->fillInHelpersInInternalState();
-	this->resolveAllUndefines();
-	this->deadStripOptimize();
-	this->checkUndefines();
-	this->checkDylibSymbolCollisions();
-	this->syncAliases();
-	this->removeCoalescedAwayAtoms();
-	this->fillInEntryPoint();
-	this->linkTimeOptimize();
-	this->fillInInternalState();
-	this->tweakWeakness();
-    _symbolTable.checkDuplicateSymbols();
-	this->buildArchivesList();
-	this->checkChainedFixupsBounds();
-	this->writeDotOutput();
+	{
+		ld::timeline::Span span("initializeState", "resolve");
+		this->initializeState();
+	}
+	{
+		ld::timeline::Span span("buildAtomList", "resolve");
+		this->buildAtomList();
+	}
+	{
+		ld::timeline::Span span("addInitialUndefines", "resolve");
+		this->addInitialUndefines();
+	}
+	{
+		ld::timeline::Span span("fillInHelpersInInternalState", "resolve");
+		this->fillInHelpersInInternalState();
+	}
+	{
+		ld::timeline::Span span("resolveAllUndefines", "resolve");
+		this->resolveAllUndefines();
+	}
+	{
+		ld::timeline::Span span("deadStripOptimize", "resolve");
+		this->deadStripOptimize();
+	}
+	{
+		ld::timeline::Span span("checkUndefines", "resolve");
+		this->checkUndefines();
+	}
+	{
+		ld::timeline::Span span("checkDylibSymbolCollisions", "resolve");
+		this->checkDylibSymbolCollisions();
+	}
+	{
+		ld::timeline::Span span("syncAliases", "resolve");
+		this->syncAliases();
+	}
+	{
+		ld::timeline::Span span("removeCoalescedAwayAtoms", "resolve");
+		this->removeCoalescedAwayAtoms();
+	}
+	{
+		ld::timeline::Span span("fillInEntryPoint", "resolve");
+		this->fillInEntryPoint();
+	}
+	{
+		ld::timeline::Span span("linkTimeOptimize", "resolve");
+		this->linkTimeOptimize();
+	}
+	{
+		ld::timeline::Span span("fillInInternalState", "resolve");
+		this->fillInInternalState();
+	}
+	{
+		ld::timeline::Span span("tweakWeakness", "resolve");
+		this->tweakWeakness();
+	}
+	{
+		ld::timeline::Span span("checkDuplicateSymbols", "resolve");
+		_symbolTable.checkDuplicateSymbols();
+	}
+	{
+		ld::timeline::Span span("buildArchivesList", "resolve");
+		this->buildArchivesList();
+	}
+	{
+		ld::timeline::Span span("checkChainedFixupsBounds", "resolve");
+		this->checkChainedFixupsBounds();
+	}
+	{
+		ld::timeline::Span span("writeDotOutput", "resolve");
+		this->writeDotOutput();
+	}
 }
 
 
@@ -2404,4 +2557,122 @@ void Resolver::resolve()
 } // namespace ld 
 
 
+#if TESTING
+//
+// dead strip marking micro benchmark, recursion (as Resolver::markLive() used to do) against
+// walkInRounds() on a synthetic deep call graph.  The rest of the resolver is dropped at link time,
+// so with the defines and include paths of the ld build:
+//   c++ <ld flags> -DTESTING -O2 -ffunction-sections -Wl,--gc-sections -o resolver_bench Resolver.cpp TaskPool.cpp \
+//       -lBlocksRuntime -lpthread && ./resolver_bench [atoms] [threads]
+//
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+struct BenchAtom { uint32_t firstFixup; uint32_t fixupCount; bool live; };
+
+static std::vector<BenchAtom>	sAtoms;
+static std::vector<uint32_t>	sFixups;
+
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t liveCount()
+{
+	size_t count = 0;
+	for (BenchAtom& atom : sAtoms) {
+		if ( atom.live )
+			++count;
+		atom.live = false;
+	}
+	return count;
+}
+
+static void markRecursive(uint32_t index)
+{
+	BenchAtom& atom = sAtoms[index];
+	if ( atom.live )
+		return;
+	atom.live = true;
+	for (uint32_t i=0; i < atom.fixupCount; ++i)
+		markRecursive(sFixups[atom.firstFixup+i]);
+}
+
+static void* markRecursiveThread(void*)
+{
+	markRecursive(0);
+	return nullptr;
+}
+
+static void markInRounds(bool serial)
+{
+	std::vector<uint32_t> pending;
+	sAtoms[0].live = true;
+	pending.push_back(0);
+	ld::tool::walkInRounds(pending, serial, 256, 16384,
+		[](uint32_t index, std::vector<uint32_t>& stack) {
+			const BenchAtom& atom = sAtoms[index];
+			for (uint32_t i=0; i < atom.fixupCount; ++i) {
+				uint32_t target = sFixups[atom.firstFixup+i];
+				if ( !__atomic_exchange_n(&sAtoms[target].live, true, __ATOMIC_RELAXED) )
+					stack.push_back(target);
+			}
+			return true;
+		},
+		[](uint32_t, std::vector<uint32_t>&) { });
+}
 
+int main(int argc, const char* argv[])
+{
+	const uint32_t atomCount = (argc > 1) ? (uint32_t)atoi(argv[1]) : 1000000;
+	if ( argc > 2 )
+		ld::setThreadCount(atoi(argv[2]));
+
+	// each function calls the next one, so the graph is one chain as deep as it is big, plus two
+	// calls further down; one atom in eight is never reached
+	srand(1);
+	sAtoms.resize(atomCount);
+	for (uint32_t i=0; i < atomCount; ++i) {
+		sAtoms[i].firstFixup = (uint32_t)sFixups.size();
+		uint32_t next = i + 1;
+		while ( (next < atomCount) && ((next % 8) == 7) )
+			++next;
+		if ( next < atomCount )
+			sFixups.push_back(next);
+		for (int c=0; c < 2; ++c) {
+			uint32_t target = i + 1 + (uint32_t)(rand() % 1000);
+			if ( (target < atomCount) && ((target % 8) != 7) )
+				sFixups.push_back(target);
+		}
+		sAtoms[i].fixupCount = (uint32_t)sFixups.size() - sAtoms[i].firstFixup;
+	}
+	printf("%u atoms, %lu fixups, %u threads\n", atomCount, (unsigned long)sFixups.size(), ld::threadCount());
+
+	// the old recursion needs a stack frame per atom in the chain
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setstacksize(&attr, (size_t)atomCount * 256 + (1 << 20));
+	pthread_t thread;
+	double start = now();
+	pthread_create(&thread, &attr, &markRecursiveThread, nullptr);
+	pthread_join(thread, nullptr);
+	double recursive = now() - start;
+	const size_t expected = liveCount();
+	printf("recursive       %9.2f ms  %6.1f M atoms/s\n", recursive*1000, expected/recursive/1e6);
+
+	for (bool serial : { true, false }) {
+		start = now();
+		markInRounds(serial);
+		double elapsed = now() - start;
+		const size_t live = liveCount();
+		if ( live != expected )
+			printf("live atoms differ: %lu, expected %lu\n", (unsigned long)live, (unsigned long)expected);
+		printf("%-15s %9.2f ms  %6.1f M atoms/s\n", serial ? "rounds serial" : "rounds parallel", elapsed*1000, live/elapsed/1e6);
+	}
+	return 0;
+}
+#endif
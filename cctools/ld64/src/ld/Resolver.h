@@ -77,12 +77,6 @@ public:
 
 
 private:
-	struct WhyLiveBackChain
-	{
-		WhyLiveBackChain*	previous;
-		const ld::Atom*		referer;
-	};
-
 	void					initializeState();
 	void					buildAtomList();
 	void					addInitialUndefines();
@@ -107,7 +101,11 @@ private:
 	void					convertReferencesToIndirect(const ld::Atom& atom);
 	const ld::Atom*			entryPoint(bool searchArchives);
 	bool					diagnoseAtomsWithUnalignedPointers() const;
-	void					markLive(const ld::Atom& atom, WhyLiveBackChain* previous);
+	void					markLive(std::vector<const ld::Atom*>& pending);
+	bool					markLiveTargets(const ld::Atom& atom, std::vector<const ld::Atom*>& work);
+	void					markLiveRoot(const ld::Atom& atom, std::vector<const ld::Atom*>& pending);
+	void					bindLiveReferences(const ld::Atom& atom);
+	void					printWhyLive(const ld::Atom& atom);
 	bool					isDtraceProbe(ld::Fixup::Kind kind);
 	void					liveUndefines(std::vector<std::string_view>&);
 	void					remainingUndefines(std::vector<std::string_view>&);
@@ -138,6 +136,7 @@ private:
 	bool							_haveAliases;
 	bool							_havellvmProfiling;
 	bool							_printWhyLive;
+	ld::Map<const ld::Atom*, const ld::Atom*>	_whyLiveReferer;		// -why_live: atom that first made an atom live
 	bool							_synthesizeObjcMsgSendStubs;
 	bool							_needsObjcMsgSendProxy;
 };
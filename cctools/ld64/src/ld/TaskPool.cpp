@@ -0,0 +1,454 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if !__has_include(<Block.h>) // ld64-port: openSUSE has the header in block/
+#include <block/Block.h>
+#else
+#include <Block.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TaskPool.h"
+
+namespace ld {
+
+namespace {
+
+//
+// Indexes [begin, end) not yet handed out.  Both ends are packed in one word, so the thread
+// working on the range (from the front) and thieves (from the back) can race with a CAS.
+//
+class IndexRange
+{
+public:
+	void		set(uint32_t begin, uint32_t end)	{ _bits.store(pack(begin, end)); }
+	uint32_t	size() const						{ uint64_t bits = _bits.load(); return end(bits) - begin(bits); }
+
+	bool takeFront(uint32_t& index) {
+		uint64_t bits = _bits.load();
+		do {
+			if ( begin(bits) >= end(bits) )
+				return false;
+		} while ( !_bits.compare_exchange_weak(bits, pack(begin(bits)+1, end(bits))) );
+		index = begin(bits);
+		return true;
+	}
+
+	bool stealBack(uint32_t& stolenBegin, uint32_t& stolenEnd) {
+		uint64_t bits = _bits.load();
+		uint32_t middle;
+		do {
+			if ( begin(bits) >= end(bits) )
+				return false;
+			middle = begin(bits) + (end(bits) - begin(bits))/2;
+		} while ( !_bits.compare_exchange_weak(bits, pack(begin(bits), middle)) );
+		stolenBegin = middle;
+		stolenEnd = end(bits);
+		return true;
+	}
+
+private:
+	static uint64_t		pack(uint32_t begin, uint32_t end)	{ return ((uint64_t)end << 32) | begin; }
+	static uint32_t		begin(uint64_t bits)				{ return (uint32_t)bits; }
+	static uint32_t		end(uint64_t bits)					{ return (uint32_t)(bits >> 32); }
+
+	std::atomic<uint64_t>	_bits { 0 };
+};
+
+struct Job
+{
+						Job(size_t count, unsigned slotCount, void (^work)(size_t))
+							: work(work), slots(slotCount), ranges(new IndexRange[slotCount]), remaining(count) { }
+
+	bool				hasWork() const {
+							for (unsigned i=0; i < slots; ++i) {
+								if ( ranges[i].size() != 0 )
+									return true;
+							}
+							return false;
+						}
+
+	void (^work)(size_t);
+	const unsigned					slots;		// slot 0 belongs to the caller, slot N to pool thread N
+	std::unique_ptr<IndexRange[]>	ranges;
+	std::atomic<size_t>				remaining;
+	std::atomic<bool>				failed { false };
+	std::exception_ptr				exception;
+	unsigned						helpers = 0;	// pool threads working on the job, guarded by the pool lock
+};
+
+// never destroyed, pool threads may still be waiting on the condition variables at exit
+struct Pool
+{
+	std::mutex					lock;
+	std::condition_variable		workAvailable;		// pool threads wait here for jobs
+	std::condition_variable		jobFinished;		// parallelFor() waits here for the last index
+	std::vector<Job*>			jobs;
+	unsigned					threadCount = 0;	// zero until set or first used
+	unsigned					startedThreads = 0;
+};
+
+Pool& pool()
+{
+	static Pool* sPool = new Pool();
+	return *sPool;
+}
+
+unsigned defaultThreadCount()
+{
+	unsigned count = std::thread::hardware_concurrency();
+	return (count != 0) ? count : 1;
+}
+
+void runIndex(Job& job, size_t index)
+{
+	if ( !job.failed.load() ) {
+		try {
+			job.work(index);
+		}
+		catch (...) {
+			bool wasFailed = false;
+			if ( job.failed.compare_exchange_strong(wasFailed, true) )
+				job.exception = std::current_exception();
+		}
+	}
+	if ( job.remaining.fetch_sub(1) == 1 ) {
+		std::lock_guard<std::mutex> guard(pool().lock);
+		pool().jobFinished.notify_all();
+	}
+}
+
+// move the back half of the biggest range left into our (empty) slot
+bool steal(Job& job, unsigned slot)
+{
+	for (;;) {
+		unsigned victim = slot;
+		uint32_t victimSize = 0;
+		for (unsigned i=0; i < job.slots; ++i) {
+			uint32_t size = job.ranges[i].size();
+			if ( size > victimSize ) {
+				victim = i;
+				victimSize = size;
+			}
+		}
+		if ( victimSize == 0 )
+			return false;
+		uint32_t begin;
+		uint32_t end;
+		if ( job.ranges[victim].stealBack(begin, end) ) {
+			job.ranges[slot].set(begin, end);
+			return true;
+		}
+	}
+}
+
+void help(Job& job, unsigned slot)
+{
+	for (;;) {
+		uint32_t index;
+		if ( job.ranges[slot].takeFront(index) )
+			runIndex(job, index);
+		else if ( !steal(job, slot) )
+			return;
+	}
+}
+
+void* poolThreadMain(void* arg)
+{
+	const unsigned slot = (unsigned)(uintptr_t)arg;
+	Pool& p = pool();
+	std::unique_lock<std::mutex> guard(p.lock);
+	for (;;) {
+		Job* job = nullptr;
+		for (Job* j : p.jobs) {
+			if ( (slot < j->slots) && j->hasWork() ) {
+				job = j;
+				break;
+			}
+		}
+		if ( job == nullptr ) {
+			p.workAvailable.wait(guard);
+			continue;
+		}
+		++job->helpers;
+		guard.unlock();
+		help(*job, slot);
+		guard.lock();
+		if ( --job->helpers == 0 )
+			p.jobFinished.notify_all();
+	}
+	return nullptr;
+}
+
+// must be called with the pool lock held
+void startThreads(Pool& p)
+{
+	if ( p.threadCount == 0 )
+		p.threadCount = defaultThreadCount();
+	while ( p.startedThreads+1 < p.threadCount ) {
+		pthread_t thread;
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		// same stack size as the input file parsing threads, parsers can recurse deeply
+		pthread_attr_setstacksize(&attr, 16 * 1024 * 1024);
+		const uintptr_t slot = ++p.startedThreads;
+		if ( pthread_create(&thread, &attr, poolThreadMain, (void*)slot) != 0 ) {
+			// run with the threads we have
+			--p.startedThreads;
+			p.threadCount = p.startedThreads+1;
+		}
+		else {
+			pthread_detach(thread);
+		}
+		pthread_attr_destroy(&attr);
+	}
+}
+
+
+//
+// Client side of the GNU make jobserver.  When ld runs under make -jN, MAKEFLAGS names a pipe
+// (--jobserver-auth=R,W or the older --jobserver-fds=R,W) or a named fifo (--jobserver-auth=fifo:PATH)
+// holding one byte per free job slot.  ld owns the implicit slot of the job make started it as, every
+// other thread that works on a parallelFor() needs a byte from the jobserver and gives it back once
+// the parallelFor() is done.
+//
+class Jobserver
+{
+public:
+	static Jobserver&	shared();
+
+	bool				active() const	{ return _active; }
+	// reads up to count tokens without blocking, returns how many were read
+	size_t				tryAcquire(char* tokens, size_t count);
+	void				release(const char* tokens, size_t count);
+
+private:
+						Jobserver();
+
+	bool				_active = false;
+	int					_readFd = -1;		// non-blocking, -1 if tokens cannot be read without blocking
+	int					_writeFd = -1;
+};
+
+Jobserver& Jobserver::shared()
+{
+	static Jobserver* sJobserver = new Jobserver();
+	return *sJobserver;
+}
+
+Jobserver::Jobserver()
+{
+	const char* makeFlags = getenv("MAKEFLAGS");
+	if ( makeFlags == nullptr )
+		return;
+	// make uses the last one if there are several
+	const char* auth = nullptr;
+	for (const char* option : { "--jobserver-auth=", "--jobserver-fds=" }) {
+		for (const char* pos = strstr(makeFlags, option); pos != nullptr; pos = strstr(pos+1, option)) {
+			const char* value = pos + strlen(option);
+			if ( (auth == nullptr) || (value > auth) )
+				auth = value;
+		}
+	}
+	if ( auth == nullptr )
+		return;
+	std::string value(auth, strcspn(auth, " "));
+
+	if ( value.compare(0, 5, "fifo:") == 0 ) {
+		int fd = ::open(value.c_str()+5, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+		if ( fd == -1 )
+			return;
+		_readFd = fd;
+		_writeFd = fd;
+		_active = true;
+		return;
+	}
+
+	int readFd;
+	int writeFd;
+	if ( sscanf(value.c_str(), "%d,%d", &readFd, &writeFd) != 2 )
+		return;
+	// make only passes the pipe to recipes it thinks run make, ld may just have inherited the numbers,
+	// and those fds may since have been reused for unrelated files
+	struct stat readStat;
+	struct stat writeStat;
+	if ( (readFd < 0) || (writeFd < 0) || (fstat(readFd, &readStat) != 0) || (fstat(writeFd, &writeStat) != 0) )
+		return;
+	if ( !S_ISFIFO(readStat.st_mode) || !S_ISFIFO(writeStat.st_mode) )
+		return;
+	_active = true;
+	_writeFd = writeFd;
+	// The pipe is shared with make and every other job, so it cannot be switched to non-blocking.
+	// Opening it again through /proc gives a private open file that can.  Where that does not work,
+	// no tokens are taken and ld runs its parallel work on the calling thread only.
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", readFd);
+	_readFd = ::open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+size_t Jobserver::tryAcquire(char* tokens, size_t count)
+{
+	if ( _readFd == -1 )
+		return 0;
+	ssize_t amount;
+	do {
+		amount = ::read(_readFd, tokens, count);
+	} while ( (amount == -1) && (errno == EINTR) );
+	return (amount > 0) ? (size_t)amount : 0;
+}
+
+void Jobserver::release(const char* tokens, size_t count)
+{
+	while ( count != 0 ) {
+		ssize_t amount = ::write(_writeFd, tokens, count);
+		if ( amount > 0 ) {
+			tokens += amount;
+			count -= amount;
+		}
+		else if ( (amount == -1) && (errno != EINTR) && (errno != EAGAIN) ) {
+			// make is gone
+			return;
+		}
+	}
+}
+
+// jobserver tokens held for the extra threads of one parallelFor()
+class JobserverTokens
+{
+public:
+						JobserverTokens() : _count(0) { }
+						~JobserverTokens() { if ( _count != 0 ) Jobserver::shared().release(_tokens, _count); }
+
+	size_t				acquire(size_t count) {
+							count = std::min(count, sizeof(_tokens) - _count);
+							_count += Jobserver::shared().tryAcquire(&_tokens[_count], count);
+							return _count;
+						}
+
+private:
+	char				_tokens[256];
+	size_t				_count;
+};
+
+} // anonymous namespace
+
+
+void setThreadCount(unsigned count)
+{
+	std::lock_guard<std::mutex> guard(pool().lock);
+	pool().threadCount = (count != 0) ? count : 1;
+}
+
+unsigned threadCount()
+{
+	std::lock_guard<std::mutex> guard(pool().lock);
+	return (pool().threadCount != 0) ? pool().threadCount : defaultThreadCount();
+}
+
+void parallelFor(size_t count, void (^work)(size_t index))
+{
+	if ( count == 0 )
+		return;
+	Pool& p = pool();
+	std::unique_lock<std::mutex> guard(p.lock);
+	startThreads(p);
+	unsigned slotCount = (unsigned)std::min<size_t>(p.threadCount, count);
+	guard.unlock();
+
+	// under make -j, each thread besides this one needs a jobserver token
+	JobserverTokens tokens;
+	if ( (slotCount > 1) && Jobserver::shared().active() )
+		slotCount = 1 + (unsigned)tokens.acquire(slotCount - 1);
+
+	if ( (slotCount == 1) || (count >= UINT32_MAX) ) {
+		for (size_t i=0; i < count; ++i)
+			work(i);
+		return;
+	}
+
+	Job job(count, slotCount, work);
+	for (unsigned i=0; i < slotCount; ++i)
+		job.ranges[i].set((uint32_t)(count*i/slotCount), (uint32_t)(count*(i+1)/slotCount));
+	guard.lock();
+	p.jobs.push_back(&job);
+	p.workAvailable.notify_all();
+	guard.unlock();
+
+	help(job, 0);
+
+	guard.lock();
+	p.jobFinished.wait(guard, [&] { return (job.remaining.load() == 0) && (job.helpers == 0); });
+	p.jobs.erase(std::find(p.jobs.begin(), p.jobs.end(), &job));
+	guard.unlock();
+
+	if ( job.exception )
+		std::rethrow_exception(job.exception);
+}
+
+
+TaskGroup::~TaskGroup()
+{
+	for (void (^task)(void) : _tasks)
+		Block_release(task);
+}
+
+void TaskGroup::async(void (^task)(void))
+{
+	_tasks.push_back(Block_copy(task));
+}
+
+void TaskGroup::wait()
+{
+	void (^*tasks)(void) = _tasks.data();
+	parallelFor(_tasks.size(), ^(size_t index) {
+		tasks[index]();
+	});
+	for (void (^task)(void) : _tasks)
+		Block_release(task);
+	_tasks.clear();
+}
+
+} // namespace ld
+
+
+void ld_parallel_for(size_t count, void (^work)(size_t index))
+{
+	ld::parallelFor(count, work);
+}
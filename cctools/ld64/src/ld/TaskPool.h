@@ -0,0 +1,78 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __TASK_POOL_H__
+#define __TASK_POOL_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ld::parallelFor() for C code (libcodedirectory)
+void ld_parallel_for(size_t count, void (^work)(size_t index));
+
+#ifdef __cplusplus
+}
+
+#include <vector>
+
+namespace ld {
+
+//
+// ld64 runs its parallel work on its own pool of threads instead of libdispatch.
+//
+// parallelFor(count, work) calls work(0) ... work(count-1) and returns once all of them returned.
+// The calling thread does part of the work.  The indexes are split evenly between the caller and
+// the pool threads, and a thread that runs out of indexes steals the upper half of the biggest range
+// left, so uneven work still keeps every thread busy.  Calls can be nested.  If work throws, the
+// remaining indexes are skipped and parallelFor() rethrows the first exception.
+//
+void		parallelFor(size_t count, void (^work)(size_t index));
+
+// number of threads parallelFor() uses, including the calling thread (-threads, LD_THREADS)
+void		setThreadCount(unsigned count);
+unsigned	threadCount();
+
+//
+// A set of unrelated tasks, run in parallel by wait().  This replaces dispatch_group_async() and
+// dispatch_group_wait(), except that tasks only start when wait() is called.
+//
+class TaskGroup
+{
+public:
+					TaskGroup() { }
+					~TaskGroup();
+
+	void			async(void (^task)(void));
+	void			wait();
+
+private:
+	std::vector<void (^)(void)>		_tasks;
+};
+
+} // namespace ld
+
+#endif // __cplusplus
+
+#endif // __TASK_POOL_H__
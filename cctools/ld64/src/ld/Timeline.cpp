@@ -0,0 +1,166 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Timeline.h"
+
+namespace ld {
+namespace timeline {
+
+namespace {
+
+struct Event
+{
+	const char*		name;
+	const char*		category;
+	std::string		detail;
+	uint64_t		start;
+	uint64_t		duration;
+	uint32_t		thread;
+};
+
+struct State
+{
+	std::mutex				lock;
+	std::vector<Event>		events;
+	std::string				path;
+};
+
+// initialized before main() runs, so times are relative to the start of ld
+const std::chrono::steady_clock::time_point	sOrigin = std::chrono::steady_clock::now();
+std::atomic<bool>							sEnabled { false };
+std::atomic<uint32_t>						sThreadCount { 0 };
+
+State& state()
+{
+	// never destroyed, other threads may still record while ld exits
+	static State* sState = new State();
+	return *sState;
+}
+
+// small ids in the order threads first record something, the thread that called enable() is 1
+uint32_t threadID()
+{
+	static thread_local uint32_t sThreadID = 0;
+	if ( sThreadID == 0 )
+		sThreadID = ++sThreadCount;
+	return sThreadID;
+}
+
+void writeString(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (const char* s = str; *s != '\0'; ++s) {
+		unsigned char c = *s;
+		if ( (c == '"') || (c == '\\') )
+			fprintf(file, "\\%c", c);
+		else if ( c < 0x20 )
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+} // anonymous namespace
+
+
+void enable(const char* path)
+{
+	state().path = path;
+	threadID();
+	sEnabled = true;
+}
+
+bool enabled()
+{
+	return sEnabled.load(std::memory_order_relaxed);
+}
+
+uint64_t now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sOrigin).count();
+}
+
+void addSpan(const char* name, const char* category, uint64_t start, const char* detail)
+{
+	if ( !enabled() )
+		return;
+	Event event = { name, category, (detail != nullptr) ? detail : "", start, now() - start, threadID() };
+	std::lock_guard<std::mutex> guard(state().lock);
+	state().events.push_back(std::move(event));
+}
+
+bool write()
+{
+	if ( !enabled() )
+		return true;
+	State& s = state();
+	std::lock_guard<std::mutex> guard(s.lock);
+	FILE* file = fopen(s.path.c_str(), "w");
+	if ( file == nullptr )
+		return false;
+	const int pid = getpid();
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	fprintf(file, "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"tid\":1,\"args\":{\"name\":\"ld\"}}", pid);
+	const uint32_t threads = sThreadCount;
+	for (uint32_t tid=1; tid <= threads; ++tid) {
+		fprintf(file, ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":", pid, tid);
+		if ( tid == 1 ) {
+			writeString(file, "main");
+		}
+		else {
+			char name[32];
+			snprintf(name, sizeof(name), "thread %u", tid);
+			writeString(file, name);
+		}
+		fprintf(file, "}}");
+	}
+	for (const Event& event : s.events) {
+		fprintf(file, ",\n{\"ph\":\"X\",\"name\":");
+		writeString(file, event.name);
+		fprintf(file, ",\"cat\":");
+		writeString(file, event.category);
+		fprintf(file, ",\"pid\":%d,\"tid\":%u,\"ts\":%llu,\"dur\":%llu", pid, event.thread,
+				(unsigned long long)event.start, (unsigned long long)event.duration);
+		if ( !event.detail.empty() ) {
+			fprintf(file, ",\"args\":{\"detail\":");
+			writeString(file, event.detail.c_str());
+			fprintf(file, "}");
+		}
+		fprintf(file, "}");
+	}
+	fprintf(file, "\n]}\n");
+	return (fclose(file) == 0);
+}
+
+} // namespace timeline
+} // namespace ld
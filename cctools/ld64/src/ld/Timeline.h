@@ -0,0 +1,63 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*-*
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+#ifndef __TIMELINE_H__
+#define __TIMELINE_H__
+
+#include <stdint.h>
+
+namespace ld {
+namespace timeline {
+
+//
+// -trace_timeline <file.json> records where the link spends its time, as spans on the threads
+// that did the work, and writes them out in the Chrome trace event format (chrome://tracing,
+// Perfetto).  Recording does nothing until enable() is called.
+//
+void		enable(const char* path);
+bool		enabled();
+// microseconds since ld started
+uint64_t	now();
+// records a span from start (a value of now()) to now, detail is shown as an argument of the span
+void		addSpan(const char* name, const char* category, uint64_t start, const char* detail=nullptr);
+// writes the recorded spans, returns false if the file could not be written
+bool		write();
+
+// a span that lasts as long as the object
+class Span
+{
+public:
+				Span(const char* name, const char* category, const char* detail=nullptr)
+					: _name(name), _category(category), _detail(detail), _start(enabled() ? now() : 0) { }
+				~Span() { if ( enabled() ) addSpan(_name, _category, _start, _detail); }
+
+private:
+	const char*		_name;
+	const char*		_category;
+	const char*		_detail;
+	uint64_t		_start;
+};
+
+} // namespace timeline
+} // namespace ld
+
+#endif // __TIMELINE_H__
@@ -71,6 +71,11 @@
 #include "Resolver.h"
 #include "OutputFile.h"
 #include "Snapshot.h"
+#include "Incremental.h"
+#include "LinkCache.h"
+#include "LinkServer.h"
+#include "TaskPool.h"
+#include "Timeline.h"
 
 #include "passes/stubs/make_stubs.h"
 #include "passes/dtrace_dof.h"
@@ -1495,6 +1500,19 @@ static void printTime(const char* msg, uint64_t partTime, uint64_t totalTime)
 }
 
 
+template <typename P>
+static void runPass(const char* name, P pass, Options& options, ld::Internal& state)
+{
+	ld::timeline::Span span(name, "pass");
+	pass(options, state);
+}
+
+static void writeTimeline(const Options& options)
+{
+	if ( !ld::timeline::write() )
+		warning("can't write -trace_timeline file: %s", options.traceTimelinePath());
+}
+
 static void getVMInfo(vm_statistics_data_t& info)
 {
 	mach_msg_type_number_t count = sizeof(vm_statistics_data_t) / sizeof(natural_t);
@@ -1581,6 +1599,8 @@ void checkWhetherToUseLLD(int argc, const char *argv[]) {
 
 int main(int argc, const char* argv[])
 {
+	// a link handed to a link server returns only in the child of the server that runs it
+	ld::server::start(argc, argv);
 	checkWhetherToUseLLD(argc, argv); // ld64-port
 
 	const char* archName = NULL;
@@ -1592,9 +1612,16 @@ int main(int argc, const char* argv[])
 
 		PerformanceStatistics& statistics = *(new PerformanceStatistics());
 		statistics.startTool = mach_absolute_time();
+		const uint64_t timelineStart = ld::timeline::now();
 		
 		// create object to track command line arguments
 		Options& options = *(new Options(argc, argv));
+		if ( options.traceTimelinePath() != NULL ) {
+			ld::timeline::enable(options.traceTimelinePath());
+			ld::timeline::addSpan("parse options", "ld", timelineStart);
+		}
+		if ( options.threadCount() != 0 )
+			ld::setThreadCount(options.threadCount());
 		InternalState& state = *(new InternalState(options));
 		
 		// allow libLTO to be overridden by command line -lto_library
@@ -1622,58 +1649,119 @@ int main(int argc, const char* argv[])
 		showArch = options.printArchPrefix();
 		archName = options.architectureName();
 		
+		// -incremental can bring the previous output up to date when only object file content changed
+		ld::tool::Incremental* incremental = NULL;
+		if ( options.incremental() ) {
+			incremental = new ld::tool::Incremental(options, argc, argv);
+			if ( incremental->relink() ) {
+				options.writeDependencyInfo();
+				writeTimeline(options);
+				if ( options.printStatistics() ) {
+					uint64_t totalTime = mach_absolute_time() - statistics.startTool;
+					printTime("ld total time", totalTime, totalTime);
+					fprintf(stderr, "incremental link patched %u atoms in %u object files\n",
+								incremental->patchedAtomCount(), incremental->patchedFileCount());
+				}
+				if ( options.errorBecauseOfWarnings() ) {
+					fprintf(stderr, "ld: fatal warning(s) induced error (-fatal_warnings)\n");
+					return 1;
+				}
+				fflush(stdout);
+				exit(0);
+			}
+			if ( options.printStatistics() )
+				fprintf(stderr, "ld: -incremental doing a full link: %s\n", incremental->fullLinkReason());
+		}
+
+		// -link_cache_path can reuse the output files of an earlier link with the same arguments and inputs
+		ld::tool::LinkCache* linkCache = NULL;
+		if ( options.linkCachePath() != NULL ) {
+			linkCache = new ld::tool::LinkCache(options, argc, argv);
+			if ( linkCache->restore() ) {
+				writeTimeline(options);
+				if ( options.printStatistics() ) {
+					uint64_t totalTime = mach_absolute_time() - statistics.startTool;
+					printTime("ld total time", totalTime, totalTime);
+					linkCache->printStatistics();
+				}
+				if ( options.errorBecauseOfWarnings() ) {
+					fprintf(stderr, "ld: fatal warning(s) induced error (-fatal_warnings)\n");
+					return 1;
+				}
+				fflush(stdout);
+				exit(0);
+			}
+		}
+
 		// open and parse input files
 		statistics.startInputFileProcessing = mach_absolute_time();
+		uint64_t timelinePhaseStart = ld::timeline::now();
 		ld::tool::InputFiles& inputFiles = *(new ld::tool::InputFiles(options));
+		if ( incremental != NULL )
+			inputFiles.setIncremental(incremental);
+		ld::timeline::addSpan("parse input files", "ld", timelinePhaseStart);
 		
 		// load and resolve all references
 		statistics.startResolver = mach_absolute_time();
+		timelinePhaseStart = ld::timeline::now();
 		ld::tool::Resolver& resolver = *(new ld::tool::Resolver(options, inputFiles, state));
 		resolver.resolve();
+		ld::timeline::addSpan("resolve symbols", "ld", timelinePhaseStart);
         
 		// add dylibs used
 		statistics.startDylibs = mach_absolute_time();
+		timelinePhaseStart = ld::timeline::now();
 		inputFiles.dylibs(state);
+		ld::timeline::addSpan("add dylibs", "ld", timelinePhaseStart);
 	
 		// do initial section sorting so passes have rough idea of the layout
 		state.sortSections();
 
 		// run passes
 		statistics.startPasses = mach_absolute_time();
-		ld::passes::objc_stubs::doPass(options, state);
-		ld::passes::objc::doPass(options, state);
-		ld::passes::stubs::doPass(options, state);
-		ld::passes::inits::doPass(options, state);
-		ld::passes::huge::doPass(options, state);
-		ld::passes::got::doPass(options, state);
+		timelinePhaseStart = ld::timeline::now();
+		runPass("objc_stubs", ld::passes::objc_stubs::doPass, options, state);
+		runPass("objc", ld::passes::objc::doPass, options, state);
+		runPass("stubs", ld::passes::stubs::doPass, options, state);
+		runPass("inits", ld::passes::inits::doPass, options, state);
+		runPass("huge", ld::passes::huge::doPass, options, state);
+		runPass("got", ld::passes::got::doPass, options, state);
 		//ld::passes::objc_constants::doPass(options, state);
-		ld::passes::tlvp::doPass(options, state);
-		ld::passes::dylibs::doPass(options, state);	// must be after stubs and GOT passes
-		ld::passes::dedup::doPass(options, state);
-		ld::passes::order::doPass(options, state); // must run after code dedup, so that deduplicated aliases are sorted
+		runPass("tlvp", ld::passes::tlvp::doPass, options, state);
+		runPass("dylibs", ld::passes::dylibs::doPass, options, state);	// must be after stubs and GOT passes
+		runPass("dedup", ld::passes::dedup::doPass, options, state);
+		runPass("order", ld::passes::order::doPass, options, state); // must run after code dedup, so that deduplicated aliases are sorted
 		state.markAtomsOrdered();
-		ld::passes::branch_shim::doPass(options, state);	// must be after stubs
-		ld::passes::branch_island::doPass(options, state);	// must be after stubs and order pass
-		ld::passes::dtrace::doPass(options, state);
-		ld::passes::compact_unwind::doPass(options, state);  // must be after order pass
+		runPass("branch_shim", ld::passes::branch_shim::doPass, options, state);	// must be after stubs
+		runPass("branch_island", ld::passes::branch_island::doPass, options, state);	// must be after stubs and order pass
+		runPass("dtrace", ld::passes::dtrace::doPass, options, state);
+		runPass("compact_unwind", ld::passes::compact_unwind::doPass, options, state);  // must be after order pass
 #if defined(HAVE_XAR_XAR_H) && defined(LTO_SUPPORT) // ld64-port
-		ld::passes::bitcode_bundle::doPass(options, state);  // must be after dylib
+		runPass("bitcode_bundle", ld::passes::bitcode_bundle::doPass, options, state);  // must be after dylib
 #endif // HAVE_XAR_XAR_H && LTO_SUPPORT
 
 		// Sort again so that we get the segments in order.
 		state.sortSections();
-		ld::passes::thread_starts::doPass(options, state);  // must be after dylib
+		runPass("thread_starts", ld::passes::thread_starts::doPass, options, state);  // must be after dylib
 
 		// sort final sections
 		state.sortSections();
+		ld::timeline::addSpan("passes", "ld", timelinePhaseStart);
 
 		options.writeDependencyInfo();
 
 		// write output file
 		statistics.startOutput = mach_absolute_time();
+		timelinePhaseStart = ld::timeline::now();
 		ld::tool::OutputFile& out = *(new ld::tool::OutputFile(options, state));
 		out.write(state);
+		if ( incremental != NULL )
+			incremental->save(state, out);
+		if ( linkCache != NULL )
+			linkCache->save(state);
 		statistics.startDone = mach_absolute_time();
+		ld::timeline::addSpan("write output", "ld", timelinePhaseStart);
+		writeTimeline(options);
 
 		// print statistics
 		//mach_o::relocatable::printCounts();
@@ -1696,7 +1784,21 @@ int main(int argc, const char* argv[])
 			fprintf(stderr, "processed %3u object files,  totaling %15s bytes\n", inputFiles._totalObjectLoaded, commatize(inputFiles._totalObjectSize, temp));
 			fprintf(stderr, "processed %3u archive files, totaling %15s bytes\n", inputFiles._totalArchivesLoaded, commatize(inputFiles._totalArchiveSize, temp));
 			fprintf(stderr, "processed %3u dylib files\n", inputFiles._totalDylibsLoaded);
+			char temp2[40];
+			char temp3[40];
+			char temp4[40];
+			fprintf(stderr, "library symbol probes %15s, avoided by index %15s\n",
+								commatize(inputFiles._librarySearchProbes, temp), commatize(inputFiles._librarySearchProbesAvoided, temp2));
+			ld::passes::dedup::Statistics dedupStats;
+			ld::passes::dedup::getStatistics(dedupStats);
+			fprintf(stderr, "dedup functions %15s, hashes %15s, hash buckets %15s, fixup compares %15s\n",
+								commatize(dedupStats.candidates, temp), commatize(dedupStats.functionsHashed, temp2),
+								commatize(dedupStats.buckets, temp3), commatize(dedupStats.fixupCompares, temp4));
+			fprintf(stderr, "dedup constant data saved    totaling %15s bytes\n", commatize(dedupStats.dataBytesSaved, temp));
 			fprintf(stderr, "wrote output file            totaling %15s bytes\n", commatize(out.fileSize(), temp));
+			if ( linkCache != NULL )
+				linkCache->printStatistics();
+			ld::server::printStatistics();
 		}
 		// <rdar://problem/6780050> Would like linker warning to be build error.
 		if ( options.errorBecauseOfWarnings() ) {
@@ -1715,6 +1817,8 @@ int main(int argc, const char* argv[])
 			fprintf(stderr, "ld: %s for architecture %s\n", msg, archName);
 		else
 			fprintf(stderr, "ld: %s\n", msg);
+		// keep the timeline of a failed link, it shows how far the link got
+		(void)ld::timeline::write();
 		// <rdar://50510752> exit but don't run termination routines
 		exit(1);
 	}
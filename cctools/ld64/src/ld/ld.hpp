@@ -26,9 +26,14 @@
 #define __LD_HPP__
 
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
 #include <math.h>
 #include <unistd.h>
 #include <assert.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <set>
 #include <map>
@@ -346,6 +351,9 @@ class Bitcode;
 // File is a static library, justInTimeforEachAtom() will iterate over the base set
 // of Atoms from the archive member implementing 'name'.
 //
+// forEachSearchableName() iterates over every name justInTimeforEachAtom() could find,
+// so that libraries can be indexed up front.  Returns false if the file can't list them.
+//
 class File
 {
 public:
@@ -451,6 +459,7 @@ public:
 	Ordinal								ordinal() const			{ return _ordinal; }
 	virtual bool						forEachAtom(AtomHandler&) const = 0;
 	virtual bool						justInTimeforEachAtom(const char* name, AtomHandler&) const = 0;
+	virtual bool						forEachSearchableName(void (^handler)(const char* name)) const { return false; }
 	virtual uint8_t						swiftVersion() const	{ return 0; }		// ABI version, now fixed
 	virtual uint16_t					swiftLanguageVersion() const	{ return 0; }	// language version in 4.4 format
 	virtual uint32_t					cpuSubType() const		{ return 0; }
@@ -1206,12 +1215,12 @@ public:
 											Atom(const Section& sect, Definition d, Combine c, Scope s, ContentType ct, 
 												SymbolTableInclusion i, bool dds, bool thumb, bool al, Alignment a, bool cold=false) :
 													_section(&sect), _address(0), _alignmentModulus(a.modulus), 
-													_alignmentPowerOf2(a.powerOf2), _definition(d), _combine(c),   
+													_alignmentPowerOf2(a.powerOf2), _live(false), _definition(d), _combine(c),   
 													_dontDeadStrip(dds), _thumb(thumb), _alias(al), _autoHide(false), 
 													_contentType(ct), _symbolTableInclusion(i),
 													_scope(s), _mode(modeSectionOffset), 
 													_overridesADylibsWeakDef(false), _coalescedAway(false),
-													_live(false), _dontDeadStripIfRefLive(false), _cold(cold),
+													_dontDeadStripIfRefLive(false), _cold(cold),
 													_machoSection(0), _weakImportState(weakImportUnset)
 													 {
 													#ifndef NDEBUG
@@ -1263,6 +1272,8 @@ public:
 	void									setDontDeadStripIfReferencesLive() { _dontDeadStripIfRefLive = true; }
 	void									setLive()					{ _live = true; }
 	void									setLive(bool value)			{ _live = value; }
+	// marks the atom live, returns false if it already was live (used by threads marking concurrently)
+	bool									claimLive()					{ return !__atomic_exchange_n(&_live, true, __ATOMIC_RELAXED); }
 	void									setMachoSection(unsigned x) { assert(x != 0); assert(x < 256); _machoSection = x; }
 	void									setSectionOffset(uint64_t o){ assert(_mode == modeSectionOffset); _address = o; _mode = modeSectionOffset; }
 	void									setSectionStartAddress(uint64_t a) { assert(_mode == modeSectionOffset); _address += a; _mode = modeFinalAddress; }
@@ -1345,6 +1356,7 @@ protected:
 	mutable uint32_t					_outputSymbolIndex = UINT32_MAX;
 	uint16_t							_alignmentModulus;
 	uint8_t								_alignmentPowerOf2;
+	bool								_live;			// not a bit field, so claimLive() can exchange it atomically
 	Definition							_definition : 2;
 	Combine								_combine : 2;
 	bool								_dontDeadStrip : 1;
@@ -1357,7 +1369,6 @@ protected:
 	AddressMode							_mode: 2;
 	bool								_overridesADylibsWeakDef : 1;
 	bool								_coalescedAway : 1;
-	bool								_live : 1;
 	bool								_dontDeadStripIfRefLive : 1;
 	bool								_cold : 1;
 	unsigned							_machoSection : 8;
@@ -1521,6 +1532,86 @@ struct utils {
 
 		return total;
 	};
+
+	// modification time in nanoseconds, a file can be rewritten within the same second
+	static uint64_t modTimeNanoseconds(const struct stat& statBuffer) {
+#ifdef HAVE_STAT_ST_MTIMESPEC
+		return statBuffer.st_mtimespec.tv_sec * 1000000000ULL + statBuffer.st_mtimespec.tv_nsec;
+#elif HAVE_STAT_ST_MTIM
+		return statBuffer.st_mtim.tv_sec * 1000000000ULL + statBuffer.st_mtim.tv_nsec;
+#else
+		return statBuffer.st_mtime * 1000000000ULL;
+#endif
+	};
+
+	// start reading in part of a mapped file that is about to be parsed
+	static void adviseWillNeed(const void* start, uint64_t length) {
+		static const uintptr_t pageMask = ::getpagesize() - 1;
+		uintptr_t begin = (uintptr_t)start & ~pageMask;
+		uintptr_t end   = (uintptr_t)start + length;
+		(void)::madvise((void*)begin, end - begin, MADV_WILLNEED);
+	};
+
+	// Writes the file at path through a temporary file in the same directory, which is then
+	// renamed over path, so no other link ever sees a partially written file.  writer(fd) fills
+	// in the temporary file.  With makeDirectory, a missing directory is created first, so a
+	// cache directory that was removed comes back.  Returns false with errno set, and without
+	// leaving the temporary file behind, if any step fails.
+	template <typename W>
+	static bool writeFileAtomically(const std::string& path, mode_t mode, bool makeDirectory, W writer) {
+		std::string tempPath = path + ".ld_XXXXXX";
+		int fd = ::mkstemp(&tempPath[0]);
+		if ( (fd == -1) && (errno == ENOENT) && makeDirectory ) {
+			std::string::size_type slash = path.rfind('/');
+			if ( (slash != std::string::npos) && ((::mkdir(path.substr(0, slash).c_str(), 0700) == 0) || (errno == EEXIST)) ) {
+				tempPath = path + ".ld_XXXXXX";
+				fd = ::mkstemp(&tempPath[0]);
+			}
+		}
+		if ( fd == -1 )
+			return false;
+		bool written = (::fchmod(fd, mode) == 0) && writer(fd);
+		int savedErrno = errno;
+		if ( ::close(fd) != 0 )
+			written = false;
+		else
+			errno = savedErrno;
+		if ( !written || (::rename(tempPath.c_str(), path.c_str()) != 0) ) {
+			savedErrno = errno;
+			::unlink(tempPath.c_str());
+			errno = savedErrno;
+			return false;
+		}
+		return true;
+	};
+
+	// like write64(), but at the given file offset
+	static ssize_t pwrite64(int fildes, const void* buf, size_t nbyte, off_t offset) {
+		const uint8_t* uchars = (uint8_t*)buf;
+		ssize_t        total  = 0;
+
+		while (nbyte)
+		{
+			size_t limit   = 0x7FFFFFFF;
+			size_t towrite = nbyte < limit ? nbyte : limit;
+			ssize_t wrote  = pwrite(fildes, uchars, towrite, offset + total);
+			if ( wrote == -1) {
+				// failure
+				return -1;
+			}
+			else if ( wrote == 0 ) {
+				// done
+				break;
+			}
+			else {
+				nbyte  -= wrote;
+				uchars += wrote;
+				total  += wrote;
+			}
+		}
+
+		return total;
+	};
 };
 
 } // namespace ld 
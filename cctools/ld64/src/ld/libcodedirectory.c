@@ -20,16 +20,18 @@
 #include <sys/mman.h>
 #include <sys/queue.h>
 
-#if defined(HAVE_DISPATCH_DISPATCH_H) && HAVE_DISPATCH_DISPATCH_H // ld64-port
-#define LIBCD_PARALLEL 1
-#endif
-
 #if defined(__APPLE__) && __has_include(<corecrypto/ccdigest.h>) // ld64-port
 #include <corecrypto/ccdigest.h>
 #include <corecrypto/ccsha1.h>
 #include <corecrypto/ccsha2.h>
 #else
 #include "compat_corecrypto.h"
+#include "sha256_mb.h" // ld64-port
+#define LIBCD_MULTI_HASH 1
+#endif
+
+#ifndef LIBCD_MULTI_HASH
+#define LIBCD_MULTI_HASH 0
 #endif
 
 #define LIBCD_HAS_PLATFORM_VERSION 1
@@ -40,7 +42,8 @@
 #define LIBCD_PARALLEL 1
 
 #if LIBCD_PARALLEL
-#include <dispatch/dispatch.h>
+#include <pthread.h>
+#include "TaskPool.h" // ld64-port
 #endif
 
 #if LIBCD_HAS_PLATFORM_VERSION
@@ -233,16 +236,7 @@ libcd_log_none (char *stmt __unused)
 static libcd_log_writer *_configured_log_writer = libcd_log_default;
 
 #if LIBCD_PARALLEL
-static dispatch_queue_t
-_libcd_get_log_queue (void)
-{
-    static dispatch_once_t once = 0;
-    static dispatch_queue_t log_queue = NULL;
-    dispatch_once(&once, ^{
-        log_queue = dispatch_queue_create("libcd_log", DISPATCH_QUEUE_SERIAL);
-    });
-    return log_queue;
-}
+static pthread_mutex_t _libcd_log_lock = PTHREAD_MUTEX_INITIALIZER; // ld64-port
 #endif
 
 void
@@ -250,12 +244,11 @@ libcd_set_log_writer (libcd_log_writer *writer)
 {
     if (writer) {
 #if LIBCD_PARALLEL
-        dispatch_queue_t queue = _libcd_get_log_queue();
-        dispatch_sync(queue, ^{
+        pthread_mutex_lock(&_libcd_log_lock);
 #endif
-            _configured_log_writer = writer;
+        _configured_log_writer = writer;
 #if LIBCD_PARALLEL
-        });
+        pthread_mutex_unlock(&_libcd_log_lock);
 #endif
     }
 }
@@ -270,12 +263,11 @@ _libcd_err_log (const char* fmt, ...)
     va_end(ap);
     if (stmt) {
 #if LIBCD_PARALLEL
-        dispatch_queue_t queue = _libcd_get_log_queue();
-        dispatch_sync(queue, ^{
+        pthread_mutex_lock(&_libcd_log_lock);
 #endif
-            _configured_log_writer(stmt);
+        _configured_log_writer(stmt);
 #if LIBCD_PARALLEL
-        });
+        pthread_mutex_unlock(&_libcd_log_lock);
 #endif
         free(stmt);
     }
@@ -797,36 +789,67 @@ libcd_cd_size (libcd *s, uint32_t hash_type)
     return si;
 }
 
+/* Pages are read and hashed in batches, so SHA256_Multi() can hash
+ * several of them side by side. */
+#if LIBCD_MULTI_HASH
+#define LIBCD_PAGE_BATCH SHA256_MULTI_MAX
+#else
+#define LIBCD_PAGE_BATCH 1
+#endif
+
 static enum libcd_serialize_ret
-_libcd_hash_page(libcd *s,
-                 size_t page_idx,
-                 size_t page_count,
-                 struct _hash_info const *hi,
-                 uint8_t* hash_destination)
+_libcd_hash_pages(libcd *s,
+                  size_t batch_idx,
+                  size_t page_count,
+                  struct _hash_info const *hi,
+                  uint8_t* hash_destination)
 {
-    uint8_t page_hash[_max_known_hash_len]; // = {0};
-    memset(page_hash, 0, sizeof(page_hash)); // ld64-port
-    const unsigned int page_no = (unsigned int)page_idx;
+    const size_t first_page = batch_idx * LIBCD_PAGE_BATCH;
+    const size_t batch_count = MIN(page_count - first_page, (size_t)LIBCD_PAGE_BATCH);
+
+    uint8_t pages[LIBCD_PAGE_BATCH][_cs_page_bytes]; // = {0};
+    memset(pages, 0, sizeof(pages)); // ld64-port
+    const uint8_t* page_data[LIBCD_PAGE_BATCH];
+    size_t page_len[LIBCD_PAGE_BATCH];
+
+    for (size_t i = 0; i < batch_count; i++) {
+        const unsigned int page_no = (unsigned int)(first_page + i);
+        const size_t pos = (first_page + i) * _cs_page_bytes;
+        size_t read_bytes = s->read_page(s, page_no, pos, _cs_page_bytes, pages[i]);
+
+        if (read_bytes == 0) {
+            _libcd_err("read page %d at pos %zu failed (pages: %d)", page_no, pos,
+                      page_count);
+            return LIBCD_SERIALIZE_READ_PAGE_ERROR;
+        }
+        page_data[i] = pages[i];
+        page_len[i] = read_bytes;
+    }
+
+#if LIBCD_MULTI_HASH
+    if (hi->di == ccsha256_di) {
+        uint8_t page_hashes[LIBCD_PAGE_BATCH][SHA256_DIGEST_SIZE];
+        SHA256_Multi(page_data, page_len, (unsigned)batch_count, page_hashes);
+        for (size_t i = 0; i < batch_count; i++) {
+            memcpy(hash_destination + i * hi->hash_len, page_hashes[i], hi->hash_len);
+        }
+        return LIBCD_SERIALIZE_SUCCESS;
+    }
+#endif
 
     struct ccdigest_info const *di = hi->di();
     ccdigest_di_decl(di, ctx);
 
-    const size_t pos = page_idx * _cs_page_bytes;
-    uint8_t page[_cs_page_bytes]; // = {0};
-    memset(page, 0, sizeof(page)); // ld64-port
-    size_t read_bytes = s->read_page(s, page_no, pos, _cs_page_bytes, page);
+    for (size_t i = 0; i < batch_count; i++) {
+        uint8_t page_hash[_max_known_hash_len]; // = {0};
+        memset(page_hash, 0, sizeof(page_hash)); // ld64-port
 
-    if (read_bytes == 0) {
-        _libcd_err("read page %d at pos %zu failed (pages: %d)", page_no, pos,
-                  page_count);
-        return LIBCD_SERIALIZE_READ_PAGE_ERROR;
-    }
-
-    ccdigest_init(di, ctx);
-    ccdigest_update(di, ctx, read_bytes, page);
-    ccdigest_final(di, ctx, page_hash);
+        ccdigest_init(di, ctx);
+        ccdigest_update(di, ctx, page_len[i], page_data[i]);
+        ccdigest_final(di, ctx, page_hash);
 
-    memcpy(hash_destination, page_hash, hi->hash_len);
+        memcpy(hash_destination + i * hi->hash_len, page_hash, hi->hash_len);
+    }
 
     return LIBCD_SERIALIZE_SUCCESS;
 }
@@ -943,18 +966,20 @@ _libcd_serialize_cd (libcd *s, uint32_t hash_type)
 
         volatile enum libcd_serialize_ret _libcd_block ret = LIBCD_SERIALIZE_SUCCESS;
 
+        size_t const batch_count = (page_count + LIBCD_PAGE_BATCH-1) / LIBCD_PAGE_BATCH;
+
 #if LIBCD_PARALLEL
         if(s->parallel_read && s->parallel_write && !s->parallelization_disabled) {
-            dispatch_apply(page_count, DISPATCH_APPLY_AUTO, ^(size_t page_no) {
-                uint8_t* destination = cursor + page_no * hi->hash_len;
-                enum libcd_serialize_ret local_ret = _libcd_hash_page(s, page_no, page_count, hi, destination);
+            ld_parallel_for(batch_count, ^(size_t batch_no) {
+                uint8_t* destination = cursor + batch_no * LIBCD_PAGE_BATCH * hi->hash_len;
+                enum libcd_serialize_ret local_ret = _libcd_hash_pages(s, batch_no, page_count, hi, destination);
                 ret = (ret == LIBCD_SERIALIZE_SUCCESS) ? local_ret : ret;
             });
         } else {
 #endif
-            for (size_t page_no = 0; page_no < page_count; page_no++) {
-                uint8_t* destination = cursor + page_no * hi->hash_len;
-                ret = _libcd_hash_page(s, page_no, page_count, hi, destination);
+            for (size_t batch_no = 0; batch_no < batch_count; batch_no++) {
+                uint8_t* destination = cursor + batch_no * LIBCD_PAGE_BATCH * hi->hash_len;
+                ret = _libcd_hash_pages(s, batch_no, page_count, hi, destination);
                 if (ret != LIBCD_SERIALIZE_SUCCESS) {
                     break;
                 }
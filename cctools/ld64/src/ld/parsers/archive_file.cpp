@@ -25,11 +25,15 @@
 #include <stdint.h>
 #include <math.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/param.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <mach-o/ranlib.h>
 #include <ar.h>
 
 #include <algorithm>
+#include <string>
 
 #include "MachOFileAbstraction.hpp"
 #include "Architectures.hpp"
@@ -38,6 +42,8 @@
 #include "lto_file.h"
 #include "archive_file.h"
 #include "Containers.h"
+#include "TaskPool.h"
+#include "LinkServer.h"
 
 namespace archive {
 
@@ -46,6 +52,142 @@ namespace archive {
 template <typename A> class File;
 
 
+//
+// With -archive_index_cache_path, the table of contents hash table is saved in the cache
+// directory as an open addressing table, which later links mmap and probe directly instead
+// of inserting every table of contents entry into a hash table again.  Names are referenced
+// by their offset in the archive's table of contents string pool, so an index is only used
+// when the checksum of the archive's table of contents member matches the one recorded.
+//
+struct IndexHeader
+{
+	char		magic[8];
+	uint64_t	imageSize;
+	uint64_t	tocSize;
+	uint64_t	tocChecksum;
+	uint32_t	path;				// offset of the archive path in the image
+	uint32_t	bucketsOffset;
+	uint32_t	bucketCount;		// power of 2
+	uint32_t	nameCount;
+};
+
+struct IndexBucket
+{
+	uint32_t	nameOffset;			// kEmptyBucket if unused
+	uint32_t	hash;
+	uint64_t	memberOffset;
+};
+
+static const char		kIndexMagic[8] = { 'l', 'd', 'a', 'r', 'i', 'd', 'x', '1' };
+static const uint32_t	kEmptyBucket = UINT32_MAX;
+
+static uint64_t indexHash(const void* p, size_t length, uint64_t hash=0xcbf29ce484222325ULL)
+{
+	for (size_t i=0; i < length; ++i) {
+		hash ^= ((const uint8_t*)p)[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static uint64_t tocChecksum(const uint8_t* toc, uint64_t tocSize)
+{
+	// eight bytes at a time, the table of contents of a big archive is several megabytes
+	uint64_t hash = indexHash(&tocSize, sizeof(tocSize));
+	uint64_t i = 0;
+	for ( ; i+8 <= tocSize; i += 8) {
+		uint64_t word;
+		memcpy(&word, &toc[i], sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	return indexHash(&toc[i], tocSize-i, hash);
+}
+
+// the same archive can be named by different relative paths, so the cache is keyed by its real path
+static std::string indexKey(const char* archivePath)
+{
+	char realPath[PATH_MAX];
+	if ( ::realpath(archivePath, realPath) != nullptr )
+		return realPath;
+	return archivePath;
+}
+
+// the name of an index in the cache directory, and of the blob the link server keeps
+static std::string indexName(const std::string& archivePath)
+{
+	char leafName[32];
+	snprintf(leafName, sizeof(leafName), "%016llx.aridx", (unsigned long long)indexHash(archivePath.data(), archivePath.size()));
+	return leafName;
+}
+
+static std::string indexPath(const char* cacheDir, const std::string& archivePath)
+{
+	return std::string(cacheDir) + "/" + indexName(archivePath);
+}
+
+// An index is only trusted after checking it belongs to this archive's table of contents,
+// and that every bucket it has references a string and a member inside the archive.
+static bool validIndex(const uint8_t* image, uint64_t imageSize, const char* archivePath, const uint8_t* toc, uint64_t tocSize,
+					   uint64_t stringsSize, uint64_t archiveLength)
+{
+	if ( imageSize < sizeof(IndexHeader) )
+		return false;
+	const IndexHeader* header = (const IndexHeader*)image;
+	if ( (memcmp(header->magic, kIndexMagic, sizeof(header->magic)) != 0) || (header->imageSize != imageSize) )
+		return false;
+	if ( (header->path < sizeof(IndexHeader)) || (header->path >= imageSize) || (memchr(&image[header->path], '\0', imageSize-header->path) == nullptr) )
+		return false;
+	if ( strcmp((const char*)&image[header->path], archivePath) != 0 )
+		return false;
+	if ( (header->bucketCount == 0) || ((header->bucketCount & (header->bucketCount-1)) != 0) || (header->nameCount >= header->bucketCount) )
+		return false;
+	if ( ((header->bucketsOffset % sizeof(uint64_t)) != 0) || ((uint64_t)header->bucketsOffset + (uint64_t)header->bucketCount*sizeof(IndexBucket) > imageSize) )
+		return false;
+	if ( (header->tocSize != tocSize) || (header->tocChecksum != tocChecksum(toc, tocSize)) )
+		return false;
+	const IndexBucket* buckets = (const IndexBucket*)&image[header->bucketsOffset];
+	uint32_t usedBuckets = 0;
+	for (uint32_t i=0; i < header->bucketCount; ++i) {
+		if ( buckets[i].nameOffset == kEmptyBucket )
+			continue;
+		if ( (buckets[i].nameOffset >= stringsSize) || (buckets[i].memberOffset > archiveLength) )
+			return false;
+		++usedBuckets;
+	}
+	return (usedBuckets == header->nameCount);
+}
+
+static const uint8_t* loadIndex(const std::string& path, const char* archivePath, const uint8_t* toc, uint64_t tocSize,
+								uint64_t stringsSize, uint64_t archiveLength)
+{
+	int fd = ::open(path.c_str(), O_RDONLY, 0);
+	if ( fd == -1 )
+		return nullptr;
+	const uint8_t* image = nullptr;
+	struct stat statBuffer;
+	if ( (::fstat(fd, &statBuffer) == 0) && (statBuffer.st_size >= (off_t)sizeof(IndexHeader)) ) {
+		void* p = ::mmap(nullptr, statBuffer.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+		if ( p != MAP_FAILED ) {
+			if ( validIndex((uint8_t*)p, statBuffer.st_size, archivePath, toc, tocSize, stringsSize, archiveLength) )
+				image = (uint8_t*)p;
+			else
+				::munmap(p, statBuffer.st_size);
+		}
+	}
+	::close(fd);
+	return image;
+}
+
+static void saveIndex(const std::string& path, const std::vector<uint8_t>& image)
+{
+	// the next link builds the index again if it can't be saved
+	ld::utils::writeFileAtomically(path, 0600, true, [&image](int fd) {
+		return (ld::utils::write64(fd, image.data(), image.size()) == (ssize_t)image.size());
+	});
+}
+
+
 template <typename A>
 class Parser 
 {
@@ -78,6 +220,7 @@ public:
 	// overrides of ld::File
 	virtual bool										forEachAtom(ld::File::AtomHandler&) const;
 	virtual bool										justInTimeforEachAtom(const char* name, ld::File::AtomHandler&) const;
+	virtual bool										forEachSearchableName(void (^handler)(const char* name)) const;
 	virtual uint32_t									subFileCount() const  { return _archiveFilelength/sizeof(ar_hdr); }
 	
 	// overrides of ld::archive::File
@@ -118,9 +261,15 @@ private:
 
 	typedef std::map<const class Entry*, MemberState> MemberToStateMap;
 
+	MemberState&									memberState(const Entry* member) const;
+	ld::relocatable::File*							parseMember(const Entry* member, uint32_t memberIndex) const;
+	void											parseMembers(const std::vector<const Entry*>& members) const;
 	MemberState&									makeObjectFileForMember(const Entry* member) const;
 	bool											memberHasObjCCategories(const Entry* member) const;
 	void											dumpTableOfContents();
+	bool											findMember(const char* name, uint64_t& offset) const;
+	bool											mapIndex(const char* cacheDir, const Entry* tocMember);
+	void											writeIndex(const char* cacheDir, const Entry* tocMember) const;
 	void											buildHashTable();
 #ifdef SYMDEF_64
 	void											buildHashTable64();
@@ -135,6 +284,8 @@ private:
 	const char*										_tableOfContentStrings;
 	mutable MemberToStateMap						_instantiatedEntries;
 	NameToOffsetMap									_hashTable;
+	const IndexBucket*								_indexBuckets;		// used instead of _hashTable if set
+	uint32_t										_indexBucketCount;
 	const LibraryOptions::ArchiveLoadMode			_loadMode;
 	const bool										_objc2ABI;
 	const bool										_verboseLoad;
@@ -295,7 +446,7 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 #ifdef SYMDEF_64
 	_tableOfContents64(NULL),
 #endif
-	_tableOfContentCount(0), _tableOfContentStrings(NULL),
+	_tableOfContentCount(0), _tableOfContentStrings(NULL), _indexBuckets(NULL), _indexBucketCount(0),
 	_loadMode(opts.loadMode), _objc2ABI(opts.objcABI2), _verboseLoad(opts.verboseLoad), 
 	_logAllFiles(opts.logAllFiles), _alreadyLoadedAll(false), _objOpts(opts.objOpts)
 {
@@ -314,7 +465,10 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 			if ( ((uint8_t*)(&_tableOfContents[_tableOfContentCount]) > &fileContent[fileLength])
 				|| ((uint8_t*)_tableOfContentStrings > &fileContent[fileLength]) )
 				throw "malformed archive, perhaps wrong architecture";
-			this->buildHashTable();
+			if ( !this->mapIndex(opts.indexCachePath, firstMember) ) {
+				this->buildHashTable();
+				this->writeIndex(opts.indexCachePath, firstMember);
+			}
 		}
 #ifdef SYMDEF_64
 		else if ( (strcmp(memberName, SYMDEF_64_SORTED) == 0) || (strcmp(memberName, SYMDEF_64) == 0) ) {
@@ -326,7 +480,10 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 			if ( ((uint8_t*)(&_tableOfContents[_tableOfContentCount]) > &fileContent[fileLength])
 				|| ((uint8_t*)_tableOfContentStrings > &fileContent[fileLength]) )
 				throw "malformed archive, perhaps wrong architecture";
-			this->buildHashTable64();
+			if ( !this->mapIndex(opts.indexCachePath, firstMember) ) {
+				this->buildHashTable64();
+				this->writeIndex(opts.indexCachePath, firstMember);
+			}
 		}
 #endif
 		else
@@ -335,6 +492,7 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 	if ( _loadMode != LibraryOptions::ArchiveLoadMode::lazy ) {
 		// parse all .o files in archive
 		// do this now while ld is multithreaded
+		std::vector<const Entry*> members;
 		const Entry* const start = (Entry*)&_archiveFileContent[8];
 		const Entry* const end = (Entry*)&_archiveFileContent[_archiveFilelength];
 		for (const Entry* p=start; p < end; p = p->next()) {
@@ -352,8 +510,9 @@ File<A>::File(const uint8_t fileContent[], uint64_t fileLength, const char* pth,
 			|| !validLTOFile(p->content(), p->contentSize(), _objOpts)
 #endif 
 			)
-				this->makeObjectFileForMember(p);
+				members.push_back(p);
 		}
+		this->parseMembers(members);
 	}
 
 }
@@ -383,36 +542,34 @@ bool File<A>::memberHasObjCCategories(const Entry* member) const
 
 
 template <typename A>
-typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* member) const
+typename File<A>::MemberState& File<A>::memberState(const Entry* member) const
 {
-	uint32_t memberIndex = 0;
 	// in case member was instantiated earlier but not needed yet
 	typename MemberToStateMap::iterator pos = _instantiatedEntries.find(member);
-	if ( pos == _instantiatedEntries.end() ) {
-		// Have to find the index of this member
-		const Entry* start;
-		uint32_t index;
-		if (_instantiatedEntries.size() == 0) {
-			start = (Entry*)&_archiveFileContent[8];
-			index = 1;
-		} else {
-			MemberState &lastKnown = _instantiatedEntries.rbegin()->second;
-			start = lastKnown.entry->next();
-			index = lastKnown.index+1;
-		}
-		for (const Entry* p=start; p <= member; p = p->next(), index++) {
-			MemberState state = {NULL, p, false, false, index};
-			_instantiatedEntries[p] = state;
-			if (member == p) {
-				memberIndex = index;
-			}
-		}
+	if ( pos != _instantiatedEntries.end() )
+		return pos->second;
+
+	// Have to find the index of this member
+	const Entry* start;
+	uint32_t index;
+	if (_instantiatedEntries.size() == 0) {
+		start = (Entry*)&_archiveFileContent[8];
+		index = 1;
 	} else {
-		MemberState& state = pos->second;
-		if (state.file)
-			return state;
-		memberIndex = state.index;
+		MemberState &lastKnown = _instantiatedEntries.rbegin()->second;
+		start = lastKnown.entry->next();
+		index = lastKnown.index+1;
 	}
+	for (const Entry* p=start; p <= member; p = p->next(), index++) {
+		MemberState state = {NULL, p, false, false, index};
+		_instantiatedEntries[p] = state;
+	}
+	return _instantiatedEntries[member];
+}
+
+template <typename A>
+ld::relocatable::File* File<A>::parseMember(const Entry* member, uint32_t memberIndex) const
+{
 	assert(memberIndex != 0);
 	char memberName[256];
 	member->getName(memberName, sizeof(memberName));
@@ -431,24 +588,20 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 		const char* mPath = strdup(memberPath);
 		// see if member is mach-o file
 		ld::File::Ordinal ordinal = this->ordinal().archiveOrdinalWithMemberIndex(memberIndex);
+		// only the archive's table of contents was prefetched, read in the whole member now
+		ld::utils::adviseWillNeed(member->content(), member->contentSize());
 		ld::relocatable::File* result = mach_o::relocatable::parse(member->content(), member->contentSize(), 
 																	mPath, member->modificationTime(), 
 																	ordinal, _objOpts);
-		if ( result != NULL ) {
-			MemberState state = {result, member, false, false, memberIndex};
-			_instantiatedEntries[member] = state;
-			return _instantiatedEntries[member];
-		}
+		if ( result != NULL )
+			return result;
 #ifdef LTO_SUPPORT
 		// see if member is llvm bitcode file
 		result = lto::parse(member->content(), member->contentSize(), 
 								mPath, member->modificationTime(), ordinal, 
 								_objOpts.architecture, _objOpts.subType, _logAllFiles, _objOpts.verboseOptimizationHints);
-		if ( result != NULL ) {
-			MemberState state = {result, member, false, false, memberIndex};
-			_instantiatedEntries[member] = state;
-			return _instantiatedEntries[member];
-		}
+		if ( result != NULL )
+			return result;
 #endif /* LTO_SUPPORT */
 			
 		throwf("archive member '%s' with length %d is not mach-o or llvm bitcode", memberName, member->contentSize());
@@ -458,6 +611,58 @@ typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* mem
 	}
 }
 
+template <typename A>
+typename File<A>::MemberState& File<A>::makeObjectFileForMember(const Entry* member) const
+{
+	MemberState& state = this->memberState(member);
+	if ( state.file == NULL )
+		state.file = this->parseMember(member, state.index);
+	return state;
+}
+
+//
+// Parses the given members that are not parsed yet.  Mach-o members are parsed in parallel.
+// Everything else is parsed afterwards in archive order, because instantiating a bitcode
+// member merges it into the LTO state.
+//
+template <typename A>
+void File<A>::parseMembers(const std::vector<const Entry*>& members) const
+{
+	// assign member indexes before going parallel, _instantiatedEntries is not thread safe
+	std::vector<MemberState*> machoStates;
+	std::vector<const Entry*> otherMembers;
+	for (const Entry* member : members) {
+		MemberState& state = this->memberState(member);
+		if ( state.file != NULL )
+			continue;
+		if ( (member->content() + member->contentSize() <= _archiveFileContent+_archiveFilelength)
+			&& validMachOFile(member->content(), member->contentSize(), _objOpts) )
+			machoStates.push_back(&state);
+		else
+			otherMembers.push_back(member);
+	}
+
+	// report the error of the first bad member in archive order, whichever thread found it first
+	std::vector<const char*> errors(machoStates.size(), nullptr);
+	MemberState** const states = machoStates.data();
+	const char** const stateErrors = errors.data();
+	ld::parallelFor(machoStates.size(), ^(size_t index) {
+		try {
+			states[index]->file = this->parseMember(states[index]->entry, states[index]->index);
+		}
+		catch (const char* msg) {
+			stateErrors[index] = msg;
+		}
+	});
+	for (const char* msg : errors) {
+		if ( msg != nullptr )
+			throw msg;
+	}
+
+	for (const Entry* member : otherMembers)
+		this->makeObjectFileForMember(member);
+}
+
 
 template <typename A>
 bool File<A>::loadMember(MemberState& state, ld::File::AtomHandler& handler, const char *format, ...) const
@@ -520,6 +725,7 @@ bool File<A>::forEachAtom(ld::File::AtomHandler& handler) const
 		// ObjC2 has no symbols in .o files with categories but not classes, look deeper for those
 		const Entry* const start = (Entry*)&_archiveFileContent[8];
 		const Entry* const end = (Entry*)&_archiveFileContent[_archiveFilelength];
+		std::vector<const Entry*> members;
 		for (const Entry* member=start; member < end; member = member->next()) {
 			char mname[256];
 			member->getName(mname, sizeof(mname));
@@ -530,11 +736,25 @@ bool File<A>::forEachAtom(ld::File::AtomHandler& handler) const
 			if ( (member==start) && ((strcmp(mname, SYMDEF_64_SORTED) == 0) || (strcmp(mname, SYMDEF_64) == 0)) )
 				continue;
 #endif
-			if ( validMachOFile(member->content(), member->contentSize(), _objOpts) ) {
+			members.push_back(member);
+		}
+		// classify the mach-o members in parallel, then load them in archive order
+		enum : uint8_t { kNotMachO, kMachO, kMachOWithCategories };
+		std::vector<uint8_t> kinds(members.size(), kNotMachO);
+		const Entry* const* const memberArray = members.data();
+		uint8_t* const kindArray = kinds.data();
+		ld::parallelFor(members.size(), ^(size_t index) {
+			const Entry* member = memberArray[index];
+			if ( validMachOFile(member->content(), member->contentSize(), _objOpts) )
+				kindArray[index] = this->memberHasObjCCategories(member) ? kMachOWithCategories : kMachO;
+		});
+		for (size_t memberIndex=0; memberIndex < members.size(); ++memberIndex) {
+			const Entry* member = members[memberIndex];
+			if ( kinds[memberIndex] != kNotMachO ) {
 				MemberState& state = this->makeObjectFileForMember(member);
 				// only look at files not already loaded
 				if ( ! state.loaded ) {
-					if ( this->memberHasObjCCategories(member) ) {
+					if ( kinds[memberIndex] == kMachOWithCategories ) {
 						typename MemberToStateMap::iterator pos = _instantiatedEntries.find(member);
 						if ( pos == _instantiatedEntries.end() )
 							this->makeObjectFileForMember(member);
@@ -600,18 +820,34 @@ bool File<A>::justInTimeforEachAtom(const char* name, ld::File::AtomHandler& han
 		return false;
 	
 	// do a hash search of table of contents looking for requested symbol
-	const auto& pos = _hashTable.find(name);
-	if ( pos == _hashTable.end() )
+	uint64_t memberOffset;
+	if ( !this->findMember(name, memberOffset) )
 		return false;
 
 	// do a hash search of table of contents looking for requested symbol
-	const Entry* member = (Entry*)&_archiveFileContent[pos->second];
+	const Entry* member = (Entry*)&_archiveFileContent[memberOffset];
 	MemberState& state = this->makeObjectFileForMember(member);
 	char memberName[256];
 	member->getName(memberName, sizeof(memberName));
 	return loadMember(state, handler, "%s forced load of %s(%s)\n", name, this->path(), memberName);
 }
 
+template <typename A>
+bool File<A>::forEachSearchableName(void (^handler)(const char* name)) const
+{
+	if ( _indexBuckets != NULL ) {
+		for (uint32_t i=0; i < _indexBucketCount; ++i) {
+			if ( _indexBuckets[i].nameOffset != kEmptyBucket )
+				handler(&_tableOfContentStrings[_indexBuckets[i].nameOffset]);
+		}
+		return true;
+	}
+	// table of contents strings are nul terminated, so the hash table keys can be used as c-strings
+	for (const auto& entry : _hashTable)
+		handler(entry.first.data());
+	return true;
+}
+
 class CheckIsDataSymbolHandler : public ld::File::AtomHandler
 {
 public:
@@ -641,11 +877,11 @@ bool File<A>::justInTimeDataOnlyforEachAtom(const char* name, ld::File::AtomHand
 		return false;
 	
 	// do a hash search of table of contents looking for requested symbol
-	const auto& pos = _hashTable.find(name);
-	if ( pos == _hashTable.end() )
+	uint64_t memberOffset;
+	if ( !this->findMember(name, memberOffset) )
 		return false;
 
-	const Entry* member = (Entry*)&_archiveFileContent[pos->second];
+	const Entry* member = (Entry*)&_archiveFileContent[memberOffset];
 	MemberState& state = this->makeObjectFileForMember(member);
 	// only call handler for each member once
 	if ( ! state.loaded ) {
@@ -662,6 +898,104 @@ bool File<A>::justInTimeDataOnlyforEachAtom(const char* name, ld::File::AtomHand
 	return false;
 }
 
+template <typename A>
+bool File<A>::findMember(const char* name, uint64_t& offset) const
+{
+	if ( _indexBuckets != NULL ) {
+		const uint64_t hash = indexHash(name, strlen(name));
+		const uint32_t mask = _indexBucketCount - 1;
+		for (uint32_t i = (uint32_t)hash & mask; _indexBuckets[i].nameOffset != kEmptyBucket; i = (i+1) & mask) {
+			const IndexBucket& bucket = _indexBuckets[i];
+			if ( (bucket.hash == (uint32_t)hash) && (strcmp(&_tableOfContentStrings[bucket.nameOffset], name) == 0) ) {
+				offset = bucket.memberOffset;
+				return true;
+			}
+		}
+		return false;
+	}
+	const auto& pos = _hashTable.find(name);
+	if ( pos == _hashTable.end() )
+		return false;
+	offset = pos->second;
+	return true;
+}
+
+template <typename A>
+bool File<A>::mapIndex(const char* cacheDir, const Entry* tocMember)
+{
+	// -ObjC walks the hash table, and the order it loads members in must not change
+	if ( _loadMode == LibraryOptions::ArchiveLoadMode::objc )
+		return false;
+	if ( (cacheDir == NULL) && !ld::server::keepsBlobs() )
+		return false;
+	const uint8_t* tocEnd = tocMember->content() + tocMember->contentSize();
+	if ( (tocEnd > _archiveFileContent+_archiveFilelength) || ((uint8_t*)_tableOfContentStrings > tocEnd) )
+		return false;
+	const std::string archivePath = indexKey(this->path());
+	const uint64_t stringsSize = tocEnd - (uint8_t*)_tableOfContentStrings;
+	uint64_t blobSize;
+	const uint8_t* image = ld::server::findBlob(indexName(archivePath), blobSize);
+	if ( (image != NULL) && !validIndex(image, blobSize, archivePath.c_str(), tocMember->content(), tocMember->contentSize(), stringsSize, _archiveFilelength) )
+		image = NULL;
+	if ( (image == NULL) && (cacheDir != NULL) ) {
+		image = loadIndex(indexPath(cacheDir, archivePath), archivePath.c_str(), tocMember->content(), tocMember->contentSize(),
+						  stringsSize, _archiveFilelength);
+		if ( image != NULL )
+			ld::server::keepBlob(indexName(archivePath), image, ((const IndexHeader*)image)->imageSize);
+	}
+	if ( image == NULL )
+		return false;
+	const IndexHeader* header = (const IndexHeader*)image;
+	_indexBuckets = (const IndexBucket*)&image[header->bucketsOffset];
+	_indexBucketCount = header->bucketCount;
+	return true;
+}
+
+template <typename A>
+void File<A>::writeIndex(const char* cacheDir, const Entry* tocMember) const
+{
+	if ( (_loadMode == LibraryOptions::ArchiveLoadMode::objc) || ((cacheDir == NULL) && !ld::server::keepsBlobs()) )
+		return;
+	const uint8_t* tocEnd = tocMember->content() + tocMember->contentSize();
+	if ( tocEnd > _archiveFileContent+_archiveFilelength )
+		return;
+
+	// at most half full, so probe sequences stay short and always reach an empty bucket
+	uint32_t bucketCount = 16;
+	while ( bucketCount < 2*_hashTable.size() )
+		bucketCount *= 2;
+	const uint32_t mask = bucketCount - 1;
+	std::vector<IndexBucket> buckets(bucketCount, IndexBucket{ kEmptyBucket, 0, 0 });
+	for (const auto& entry : _hashTable) {
+		uint64_t nameOffset = entry.first.data() - _tableOfContentStrings;
+		if ( nameOffset >= kEmptyBucket )
+			return;
+		uint64_t hash = indexHash(entry.first.data(), entry.first.size());
+		uint32_t i = (uint32_t)hash & mask;
+		while ( buckets[i].nameOffset != kEmptyBucket )
+			i = (i+1) & mask;
+		buckets[i] = IndexBucket{ (uint32_t)nameOffset, (uint32_t)hash, entry.second };
+	}
+
+	const std::string archivePath = indexKey(this->path());
+	IndexHeader header;
+	memcpy(header.magic, kIndexMagic, sizeof(header.magic));
+	header.tocSize			= tocMember->contentSize();
+	header.tocChecksum		= tocChecksum(tocMember->content(), tocMember->contentSize());
+	header.path				= sizeof(IndexHeader);
+	header.bucketsOffset	= (uint32_t)((sizeof(IndexHeader) + archivePath.size() + 1 + 7) & (-8));
+	header.bucketCount		= bucketCount;
+	header.nameCount		= (uint32_t)_hashTable.size();
+	header.imageSize		= header.bucketsOffset + bucketCount*sizeof(IndexBucket);
+	std::vector<uint8_t> image(header.imageSize, 0);
+	memcpy(&image[0], &header, sizeof(header));
+	memcpy(&image[header.path], archivePath.c_str(), archivePath.size()+1);
+	memcpy(&image[header.bucketsOffset], buckets.data(), bucketCount*sizeof(IndexBucket));
+	ld::server::keepBlob(indexName(archivePath), image.data(), image.size());
+	if ( cacheDir != NULL )
+		saveIndex(indexPath(cacheDir, archivePath), image);
+}
+
 template <typename A>
 void File<A>::buildHashTable()
 {
@@ -88,6 +88,7 @@ File::File(const char* path, time_t mTime, ld::File::Ordinal ord, const ld::Vers
       _hasPublicInstallName(false),
       _appExtensionSafe(false),
       _isUnzipperedTwin(false),
+      _lazyExports(false),
       _allowWeakImports(allowWeakImports),
       _allowSimToMacOSXLinking(allowSimToMacOSX),
       _addVersionLoadCommand(addVers)
@@ -121,11 +122,30 @@ File::File(const char* path, time_t mTime, ld::File::Ordinal ord, const ld::Vers
     }
 }
 
-std::pair<bool, bool> File::hasWeakDefinitionImpl(const char* name) const
+const File::AtomAndWeak* File::findExport(const char* name) const
 {
     const auto pos = _atoms.find(name);
-    if ( pos != this->_atoms.end() )
-        return std::make_pair(true, pos->second.weakDef);
+    if ( pos != _atoms.end() )
+        return &pos->second;
+    // hidden symbols would never have been added to the hash table
+    if ( !_lazyExports || (_ignoreExports.count(name) != 0) )
+        return nullptr;
+
+    // not in hash table yet, so ask subclass and remember what it found
+    AtomAndWeak bucket;
+    if ( !findLazyExport(name, bucket) )
+        return nullptr;
+    if ( _s_logHashtable )
+        fprintf(stderr, "  lazily adding %s to hash table for %s\n", name, this->path());
+    AtomAndWeak& entry = _atoms[strdup(name)];
+    entry = bucket;
+    return &entry;
+}
+
+std::pair<bool, bool> File::hasWeakDefinitionImpl(const char* name) const
+{
+    if ( const AtomAndWeak* found = findExport(name) )
+        return std::make_pair(true, found->weakDef);
 
     // look in re-exported libraries.
     for (const auto &dep : _dependentDylibs) {
@@ -140,8 +160,7 @@ std::pair<bool, bool> File::hasWeakDefinitionImpl(const char* name) const
 
 bool File::hasDefinitionImpl(const char* name) const
 {
-    const auto pos = _atoms.find(name);
-    if ( pos != this->_atoms.end() )
+    if ( findExport(name) != nullptr )
         return true;
 
     // look in re-exported libraries.
@@ -178,9 +197,8 @@ bool File::containsOrReExports(const char* name, AtomAndWeak& atom) const
         return false;
 
     // check myself
-    const auto pos = _atoms.find(name);
-    if ( pos != _atoms.end() ) {
-        atom = pos->second;
+    if ( const AtomAndWeak* found = findExport(name) ) {
+        atom = *found;
         return true;
     }
 
@@ -230,11 +248,57 @@ bool File::justInTimeforEachAtom(const char* name, ld::File::AtomHandler& handle
     return false;
 }
 
+bool File::exportsListable() const
+{
+    // re-exported dylibs are not known until processIndirectLibraries()
+    if ( !_indirectDylibsProcessed )
+        return false;
+    // listing lazy exports would mean walking all of them, which is what being lazy avoids
+    if ( _lazyExports )
+        return false;
+    for (const auto& dep : _dependentDylibs) {
+        if ( dep.reExport ) {
+            if ( (dep.dylib == nullptr) || !dep.dylib->exportsListable() )
+                return false;
+        }
+    }
+    return true;
+}
+
+void File::forEachNameOrReExport(void (^handler)(const char* name)) const
+{
+    for (const auto& entry : _atoms) {
+        if ( _ignoreExports.count(entry.first) == 0 )
+            handler(entry.first);
+    }
+    for (const auto& dep : _dependentDylibs) {
+        if ( dep.reExport )
+            dep.dylib->forEachNameOrReExport(handler);
+    }
+}
+
+bool File::forEachSearchableName(void (^handler)(const char* name)) const
+{
+    // names can only be listed once all re-exports are bound, and must be listed completely
+    if ( !exportsListable() )
+        return false;
+
+    forEachNameOrReExport(handler);
+    return true;
+}
+
 void File::forEachExportedSymbol(void (^handler)(const char* symbolName, bool weakDef)) const
 {
     for (const auto& entry : _atoms) {
         handler(entry.first, entry.second.weakDef);
     }
+    // exports not looked up yet
+    if ( _lazyExports ) {
+        forEachLazyExport(^(const char* name, bool weakDef) {
+            if ( (_atoms.count(name) == 0) && (_ignoreExports.count(name) == 0) )
+                handler(name, weakDef);
+        });
+    }
 }
 
 File* File::createSyntheticDylib(const char* installName, uint32_t version) const {
@@ -258,9 +322,9 @@ void File::addExportedSymbol(const ExportAtom* atom) {
     _atoms[atom->name()] = bucket;
 }
 
-void File::addExportedSymbol(const char *name, bool weakDef, bool tlv, uint64_t address) {
+void File::addExportedSymbol(const char *name, bool weakDef, bool tlv, uint64_t address, bool copyName) {
     const char* copiedInstallname = nullptr;
-    const char* copiedName = strdup(name);
+    const char* copiedName = copyName ? strdup(name) : name;
     uint32_t compat_version = 0;
     if ( strncmp(name, "$ld$", 4) == 0 ) {
         //    $ld$ <action> $ <condition> $ <symbol-name>
@@ -316,7 +380,8 @@ void File::addExportedSymbol(const char *name, bool weakDef, bool tlv, uint64_t
             }
             compat_version = Options::parseVersionNumber32(&*compatVersion);
             copiedInstallname = strdup(&*installname);
-            free((void*)copiedName);
+            if ( copyName )
+                free((void*)copiedName);
             copiedName = strdup(&*symbol);
         }
     }
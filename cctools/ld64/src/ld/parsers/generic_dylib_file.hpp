@@ -107,6 +107,7 @@ public:
 	// overrides of ld::File
 	virtual bool							forEachAtom(ld::File::AtomHandler&) const override final;
 	virtual bool							justInTimeforEachAtom(const char* name, ld::File::AtomHandler&) const override final;
+	virtual bool							forEachSearchableName(void (^handler)(const char* name)) const override final;
 	virtual uint8_t							swiftVersion() const override final { return _swiftVersion; }
 	virtual ld::Bitcode*					getBitcode() const override final { return _bitcode.get(); }
     virtual const ld::VersionSet &          platforms() const override final { return _platforms; }
@@ -132,7 +133,7 @@ public:
     virtual bool						    isUnzipperedTwin() const override { return _isUnzipperedTwin; }
     File*                                   createSyntheticDylib(const char* insstallName, uint32_t version) const;
     void                                    addExportedSymbol(const ExportAtom*);
-    void                                    addExportedSymbol(const char *name, bool weakDef, bool tlv, uint64_t address);
+    void                                    addExportedSymbol(const char *name, bool weakDef, bool tlv, uint64_t address, bool copyName=true);
     void                                    reservedSymbolSpace(size_t size);
 
 private:
@@ -155,14 +156,22 @@ private:
 	using NameToAtomMap = ld::CStringMap<AtomAndWeak>;
 	using NameSet = ld::CStringSet;
 
+	const AtomAndWeak*			findExport(const char* name) const;
 	std::pair<bool, bool>		hasWeakDefinitionImpl(const char* name) const;
     bool                        hasDefinitionImpl(const char* name) const;
 	bool						containsOrReExports(const char* name, AtomAndWeak& atom) const;
+	bool						exportsListable() const;
+	void						forEachNameOrReExport(void (^handler)(const char* name)) const;
 	void						assertNoReExportCycles(ReExportChain*) const;
 
 protected:
 	bool						isPublicLocation(const char* path) const;
 
+	// Subclasses that set _lazyExports look up exports on demand instead of adding them all
+	// with addExportedSymbol() up front.  Lookups that succeed are remembered in _atoms.
+	virtual bool				findLazyExport(const char* name, AtomAndWeak& result) const { return false; }
+	virtual void				forEachLazyExport(void (^handler)(const char* name, bool weakDef)) const { }
+
 private:
 	ld::Section							_importProxySection;
 	ld::Section							_flatDummySection;
@@ -190,6 +199,7 @@ protected:
 	bool								_hasPublicInstallName;
 	bool								_appExtensionSafe;
     bool                                _isUnzipperedTwin;
+	bool								_lazyExports;
     const bool                          _allowWeakImports;
 	const bool							_allowSimToMacOSXLinking;
 	const bool							_addVersionLoadCommand;
@@ -67,8 +67,8 @@ public:
 													bool allowSimToMacOSX, bool addVers,  bool buildingForSimulator,
 													bool logAllFiles, const char* installPath,
 													bool indirectDylib, bool usingBitcode, bool internalSDK,
-													bool fromSDK, bool platformMismatchesAreWarning);
-	virtual									~File() noexcept {}
+													bool fromSDK, bool platformMismatchesAreWarning, bool lazyExports);
+	virtual									~File() noexcept;
 
 private:
 	using P = typename A::P;
@@ -77,7 +77,7 @@ private:
 
 	void				addDyldFastStub();
 	void				buildExportHashTableFromExportInfo(uint32_t exportsOffset, uint32_t exportsSize,
-															const uint8_t* fileContent);
+															const uint8_t* fileContent, bool lazyExports);
 	void				buildExportHashTableFromSymbolTable(const macho_dysymtab_command<P>* dynamicInfo,
 														const macho_nlist<P>* symbolTable, const char* strings,
 														const uint8_t* fileContent);
@@ -85,9 +85,16 @@ private:
 	static const char*	objCInfoSegmentName();
 	static const char*	objCInfoSectionName();
 
+	// overrides of generic::dylib::File
+	virtual bool		findLazyExport(const char* name, AtomAndWeak& result) const override final;
+	virtual void		forEachLazyExport(void (^handler)(const char* name, bool weakDef)) const override final;
 
-	uint64_t  _fileLength;
-	uint32_t  _linkeditStartOffset;
+
+	const uint8_t*	_fileContent;
+	uint64_t		_fileLength;
+	uint32_t		_linkeditStartOffset;
+	const uint8_t*	_exportsStart;
+	const uint8_t*	_exportsEnd;
 
 };
 
@@ -105,9 +112,10 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 			  bool hoistImplicitPublicDylibs, const ld::VersionSet& cmdLinePlatforms, bool allowWeakImports,
 			  bool allowSimToMacOSX, bool addVers, bool buildingForSimulator, bool logAllFiles,
 			  const char* targetInstallPath, bool indirectDylib, bool usingBitcode, bool internalSDK,
-			  bool fromSDK, bool platformMismatchesAreWarning)
+			  bool fromSDK, bool platformMismatchesAreWarning, bool lazyExports)
 	: Base(strdup(path), mTime, ord, cmdLinePlatforms, allowWeakImports, linkingFlatNamespace,
-		   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers), _fileLength(fileLength), _linkeditStartOffset(0)
+		   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers), _fileContent(fileContent), _fileLength(fileLength),
+		   _linkeditStartOffset(0), _exportsStart(nullptr), _exportsEnd(nullptr)
 {
 	const macho_header<P>* header = (const macho_header<P>*)fileContent;
 	const uint32_t cmd_count = header->ncmds();
@@ -405,14 +413,22 @@ File<A>::File(const uint8_t* fileContent, uint64_t fileLength, const char* path,
 
 	// build hash table
 	if ( dyldInfo != nullptr )
-		buildExportHashTableFromExportInfo(dyldInfo->export_off(), dyldInfo->export_size(), fileContent);
+		buildExportHashTableFromExportInfo(dyldInfo->export_off(), dyldInfo->export_size(), fileContent, lazyExports);
 	else if ( exportsTrie != nullptr )
-		buildExportHashTableFromExportInfo(exportsTrie->dataoff(), exportsTrie->datasize(), fileContent);
+		buildExportHashTableFromExportInfo(exportsTrie->dataoff(), exportsTrie->datasize(), fileContent, lazyExports);
 	else
 		buildExportHashTableFromSymbolTable(dynamicInfo, symbolTable, strings, fileContent);
-	
-	// unmap file
-	munmap((caddr_t)fileContent, fileLength);
+
+	// unmap file, unless exports will be looked up in its export trie
+	if ( !this->_lazyExports )
+		munmap((caddr_t)fileContent, fileLength);
+}
+
+template <typename A>
+File<A>::~File() noexcept
+{
+	if ( this->_lazyExports )
+		munmap((caddr_t)_fileContent, _fileLength);
 }
 
 template <typename A>
@@ -451,17 +467,27 @@ void File<A>::buildExportHashTableFromSymbolTable(const macho_dysymtab_command<P
 
 template <typename A>
 void File<A>::buildExportHashTableFromExportInfo(uint32_t exportsOffset, uint32_t exportsSize,
-												 const uint8_t* fileContent)
+												 const uint8_t* fileContent, bool lazyExports)
 {
 	if ( this->_s_logHashtable )
-		fprintf(stderr, "ld: building hashtable from export trie in %s\n", this->path());
+		fprintf(stderr, "ld: building %shashtable from export trie in %s\n", lazyExports ? "lazy " : "", this->path());
 	if ( exportsSize > 0 ) {
 		const uint8_t* start = fileContent + exportsOffset;
 		const uint8_t* end = &start[exportsSize];
 		if ( ((uint64_t)exportsOffset + (uint64_t)exportsSize) > _fileLength )
 			throwf("malformed mach-o dylib, exports trie extends beyond end of file");
 		std::vector<mach_o::trie::Entry> list;
-		parseTrie(start, end, list);
+		if ( lazyExports ) {
+			// Other exports are looked up in the trie when first needed, but $ld$ symbols change
+			// what this dylib exports so must be processed now.  They all share one sub-trie.
+			_exportsStart = start;
+			_exportsEnd = end;
+			this->_lazyExports = true;
+			parseTrie(start, end, "$ld$", list);
+		}
+		else {
+			parseTrie(start, end, list);
+		}
 		for (const auto &entry : list)
 			this->addSymbol(entry.name,
 							entry.flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION,
@@ -547,6 +573,46 @@ void File<A>::addSymbol(const char* name, bool weakDef, bool tlv, pint_t address
 	}
 }
 
+template <typename A>
+bool File<A>::findLazyExport(const char* name, AtomAndWeak& result) const
+{
+	// all $ld$ symbols were processed when the dylib was loaded
+	if ( strncmp(name, "$ld$", 4) == 0 )
+		return false;
+
+	mach_o::trie::Entry entry;
+	try {
+		if ( !mach_o::trie::findTrieEntry(_exportsStart, _exportsEnd, name, entry) )
+			return false;
+	}
+	catch (const char* msg) {
+		throwf("%s in %s", msg, this->path());
+	}
+	result.atom = nullptr;
+	result.weakDef = (entry.flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION);
+	result.tlv = ((entry.flags & EXPORT_SYMBOL_FLAGS_KIND_MASK) == EXPORT_SYMBOL_FLAGS_KIND_THREAD_LOCAL);
+	result.address = entry.address;
+	result.installname = nullptr;
+	result.compat_version = 0;
+	return true;
+}
+
+template <typename A>
+void File<A>::forEachLazyExport(void (^handler)(const char* name, bool weakDef)) const
+{
+	std::vector<mach_o::trie::Entry> list;
+	try {
+		parseTrie(_exportsStart, _exportsEnd, list);
+	}
+	catch (const char* msg) {
+		throwf("%s in %s", msg, this->path());
+	}
+	for (const auto &entry : list) {
+		if ( strncmp(entry.name, "$ld$", 4) != 0 )
+			handler(entry.name, (entry.flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION));
+	}
+}
+
 template <>
 void File<x86_64>::addDyldFastStub()
 {
@@ -585,7 +651,7 @@ public:
 						   opts.allowSimulatorToLinkWithMacOSX(), opts.addVersionLoadCommand(),
 						   opts.targetIOSSimulator(), opts.logAllFiles(), opts.installPath(),
 						   indirectDylib, opts.bundleBitcode(), opts.internalSDK(), fromSDK,
-						   opts.platformMismatchesAreWarning());
+						   opts.platformMismatchesAreWarning(), opts.lazyDylibExports());
 	}
 
 };
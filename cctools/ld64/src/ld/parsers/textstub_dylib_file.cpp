@@ -26,8 +26,12 @@
 
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <tapi/tapi.h>
 #include <vector>
+#include <string>
 #include <memory> // ld64-port
 #include <functional> // ld64-port
 
@@ -37,11 +41,306 @@
 #include "MachOTrie.hpp"
 #include "generic_dylib_file.hpp"
 #include "textstub_dylib_file.hpp"
+#include "LinkServer.h"
 
 
 namespace textstub {
 namespace dylib {
 
+//
+// With -tbd_cache_path, or in a child of the link server, the interface libtapi parses out of
+// a .tbd file is also flattened into an image, which is saved in the cache directory or handed
+// to the server.  Later links map the image and use its strings in place instead of parsing the
+// .tbd file again.  An image is a header, followed by lists, followed by a string pool.  Strings
+// are referenced by their offset in the image, so lists of strings are arrays of offsets.
+//
+struct ImageList		{ uint32_t offset; uint32_t count; };
+struct ImagePlatform	{ uint32_t platform; uint32_t minOS; };
+struct ImageExport		{ uint32_t name; uint32_t flags; };
+
+struct ImageHeader
+{
+	char		magic[8];
+	uint32_t	imageSize;
+	uint32_t	attributes;
+	// what the image was made from
+	uint64_t	mTime;					// nanoseconds
+	uint64_t	fileLength;
+	uint32_t	path;
+	uint32_t	cpuType;
+	uint32_t	cpuSubType;
+	uint32_t	parsingFlags;
+	uint32_t	minOSVersion;
+	// the interface
+	uint32_t	installName;
+	uint32_t	parentUmbrella;			// zero if none
+	uint32_t	currentVersion;
+	uint32_t	compatibilityVersion;
+	uint32_t	swiftVersion;
+	ImageList	allowableClients;
+	ImageList	rpaths;
+	ImageList	platforms;
+	ImageList	reexportedLibraries;
+	ImageList	ignoreExports;
+	ImageList	undefineds;
+	ImageList	exports;
+};
+
+// change when ImageHeader or anything it refers to changes
+static const char kImageMagic[8] = "tbdimg2";
+
+enum {
+	kImageHasReexports					= 0x01,
+	kImageHasWeakDefinedExports			= 0x02,
+	kImageInstallNameVersionSpecific	= 0x04,
+	kImageAppExtensionSafe				= 0x08,
+	kImageHasAllowableClients			= 0x10,
+	kImageTwoLevelNamespace				= 0x20,
+	kImagePlatformsHaveMinOS			= 0x40
+};
+
+enum {
+	kImageExportWeakDef					= 0x01,
+	kImageExportThreadLocal				= 0x02
+};
+
+// everything the interface libtapi returns depends on
+struct ImageKey
+{
+	const char*		path;
+	uint64_t		mTime;			// nanoseconds
+	uint64_t		fileLength;
+	cpu_type_t		cpuType;
+	cpu_subtype_t	cpuSubType;
+	uint32_t		parsingFlags;
+	uint32_t		minOSVersion;
+};
+
+static inline const char* imageString(const uint8_t* image, uint32_t offset)
+{
+	return (const char*)&image[offset];
+}
+
+template <typename T>
+static inline const T* imageList(const uint8_t* image, const ImageList& list)
+{
+	return (const T*)&image[list.offset];
+}
+
+static void buildImage(const tapi::LinkerInterfaceFile* file, const ImageKey& key, std::vector<uint8_t>& image)
+{
+	std::vector<std::string> rpaths;
+	std::vector<ImagePlatform> platforms;
+	uint32_t attributes = 0;
+#if (TAPI_API_VERSION_MAJOR == 2 && TAPI_API_VERSION_MINOR >= 2)
+	if (tapi::APIVersion::isAtLeast(2, 2)) {
+		for (const auto &rpath : file->rPaths())
+			rpaths.emplace_back(rpath);
+		for (const auto &[platform, minOS] : file->getPlatformsAndMinDeployment())
+			platforms.push_back({ (uint32_t)platform, minOS });
+		attributes |= kImagePlatformsHaveMinOS;
+	} else
+#endif
+	{
+		for (const auto &platform : file->getPlatformSet())
+			platforms.push_back({ (uint32_t)platform, 0 });
+	}
+	if ( file->hasReexportedLibraries() )
+		attributes |= kImageHasReexports;
+	if ( file->hasWeakDefinedExports() )
+		attributes |= kImageHasWeakDefinedExports;
+	if ( file->isInstallNameVersionSpecific() )
+		attributes |= kImageInstallNameVersionSpecific;
+	if ( file->isApplicationExtensionSafe() )
+		attributes |= kImageAppExtensionSafe;
+	if ( file->hasAllowableClients() )
+		attributes |= kImageHasAllowableClients;
+	if ( file->hasTwoLevelNamespace() )
+		attributes |= kImageTwoLevelNamespace;
+
+	// all list sizes are known up front, so lay out lists first and append strings after them
+	const auto& undefineds = file->undefineds();
+	const auto& exports = file->exports();
+	const size_t stringListsCount = file->allowableClients().size() + rpaths.size() + file->reexportedLibraries().size()
+									+ file->ignoreExports().size() + undefineds.size();
+	image.clear();
+	image.resize(sizeof(ImageHeader) + stringListsCount*sizeof(uint32_t) + platforms.size()*sizeof(ImagePlatform)
+				 + exports.size()*sizeof(ImageExport), 0);
+	uint32_t nextListOffset = sizeof(ImageHeader);
+	auto addString = [&image](const std::string& str) -> uint32_t {
+		uint32_t offset = (uint32_t)image.size();
+		image.insert(image.end(), str.begin(), str.end());
+		image.push_back('\0');
+		return offset;
+	};
+	auto addList = [&nextListOffset](size_t count, size_t elementSize) -> ImageList {
+		ImageList list = { nextListOffset, (uint32_t)count };
+		nextListOffset += count*elementSize;
+		return list;
+	};
+	auto addStrings = [&](const std::vector<std::string>& strs) -> ImageList {
+		ImageList list = addList(strs.size(), sizeof(uint32_t));
+		for (size_t i=0; i < strs.size(); ++i) {
+			uint32_t offset = addString(strs[i]);
+			memcpy(&image[list.offset + i*sizeof(uint32_t)], &offset, sizeof(uint32_t));
+		}
+		return list;
+	};
+
+	ImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kImageMagic, sizeof(header.magic));
+	header.attributes			= attributes;
+	header.mTime				= key.mTime;
+	header.fileLength			= key.fileLength;
+	header.path					= addString(key.path);
+	header.cpuType				= key.cpuType;
+	header.cpuSubType			= key.cpuSubType;
+	header.parsingFlags			= key.parsingFlags;
+	header.minOSVersion			= key.minOSVersion;
+	header.installName			= addString(file->getInstallName());
+	if ( !file->getParentFrameworkName().empty() )
+		header.parentUmbrella	= addString(file->getParentFrameworkName());
+	header.currentVersion		= file->getCurrentVersion();
+	header.compatibilityVersion	= file->getCompatibilityVersion();
+	header.swiftVersion			= file->getSwiftVersion();
+	header.allowableClients		= addStrings(file->allowableClients());
+	header.rpaths				= addStrings(rpaths);
+	header.reexportedLibraries	= addStrings(file->reexportedLibraries());
+	header.ignoreExports		= addStrings(file->ignoreExports());
+	header.undefineds			= addList(undefineds.size(), sizeof(uint32_t));
+	for (size_t i=0; i < undefineds.size(); ++i) {
+		uint32_t offset = addString(undefineds[i].getName());
+		memcpy(&image[header.undefineds.offset + i*sizeof(uint32_t)], &offset, sizeof(uint32_t));
+	}
+	header.platforms			= addList(platforms.size(), sizeof(ImagePlatform));
+	if ( !platforms.empty() )
+		memcpy(&image[header.platforms.offset], &platforms[0], platforms.size()*sizeof(ImagePlatform));
+	header.exports				= addList(exports.size(), sizeof(ImageExport));
+	for (size_t i=0; i < exports.size(); ++i) {
+		const auto& sym = exports[i];
+		ImageExport exp = { addString(sym.getName()), 0 };
+		if ( sym.isWeakDefined() )
+			exp.flags |= kImageExportWeakDef;
+		if ( sym.isThreadLocalValue() )
+			exp.flags |= kImageExportThreadLocal;
+		memcpy(&image[header.exports.offset + i*sizeof(ImageExport)], &exp, sizeof(ImageExport));
+	}
+	header.imageSize			= (uint32_t)image.size();
+	memcpy(&image[0], &header, sizeof(header));
+}
+
+// Cached images are only trusted after checking they match the .tbd file and that every
+// string and list they reference is inside the image.
+static bool validImage(const uint8_t* image, uint64_t imageSize, const ImageKey& key)
+{
+	if ( imageSize < sizeof(ImageHeader) )
+		return false;
+	const ImageHeader* header = (const ImageHeader*)image;
+	if ( (memcmp(header->magic, kImageMagic, sizeof(header->magic)) != 0) || (header->imageSize != imageSize) )
+		return false;
+	auto validString = [&](uint32_t offset) -> bool {
+		return (offset >= sizeof(ImageHeader)) && (offset < imageSize) && (memchr(&image[offset], '\0', imageSize-offset) != nullptr);
+	};
+	auto validList = [&](const ImageList& list, size_t elementSize) -> bool {
+		return ((list.offset % sizeof(uint32_t)) == 0) && ((uint64_t)list.offset + (uint64_t)list.count*elementSize <= imageSize);
+	};
+	auto validStrings = [&](const ImageList& list) -> bool {
+		if ( !validList(list, sizeof(uint32_t)) )
+			return false;
+		const uint32_t* strs = imageList<uint32_t>(image, list);
+		for (uint32_t i=0; i < list.count; ++i) {
+			if ( !validString(strs[i]) )
+				return false;
+		}
+		return true;
+	};
+	if ( !validString(header->path) || (strcmp(imageString(image, header->path), key.path) != 0) )
+		return false;
+	if ( (header->mTime != key.mTime) || (header->fileLength != key.fileLength)
+		|| (header->cpuType != (uint32_t)key.cpuType) || (header->cpuSubType != (uint32_t)key.cpuSubType)
+		|| (header->parsingFlags != key.parsingFlags) || (header->minOSVersion != key.minOSVersion) )
+		return false;
+	if ( !validString(header->installName) )
+		return false;
+	if ( (header->parentUmbrella != 0) && !validString(header->parentUmbrella) )
+		return false;
+	if ( !validStrings(header->allowableClients) || !validStrings(header->rpaths) || !validStrings(header->reexportedLibraries)
+		|| !validStrings(header->ignoreExports) || !validStrings(header->undefineds) )
+		return false;
+	if ( !validList(header->platforms, sizeof(ImagePlatform)) || !validList(header->exports, sizeof(ImageExport)) )
+		return false;
+	const ImageExport* exports = imageList<ImageExport>(image, header->exports);
+	for (uint32_t i=0; i < header->exports.count; ++i) {
+		if ( !validString(exports[i].name) )
+			return false;
+	}
+	return true;
+}
+
+// the name of an image in the cache directory
+static std::string cachedImageName(const ImageKey& key)
+{
+	// The file's mTime and size are checked when the image is loaded, so they are not part of
+	// the name.  That way an image for an updated .tbd file replaces the stale one.
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	auto mix = [&hash](const void* p, size_t length) {
+		for (size_t i=0; i < length; ++i) {
+			hash ^= ((const uint8_t*)p)[i];
+			hash *= 0x100000001b3ULL;
+		}
+	};
+	mix(key.path, strlen(key.path));
+	mix(&key.cpuType, sizeof(key.cpuType));
+	mix(&key.cpuSubType, sizeof(key.cpuSubType));
+	mix(&key.parsingFlags, sizeof(key.parsingFlags));
+	mix(&key.minOSVersion, sizeof(key.minOSVersion));
+	char leafName[32];
+	snprintf(leafName, sizeof(leafName), "%016llx.tbdimg", (unsigned long long)hash);
+	return leafName;
+}
+
+// the link server serves clients in many directories, so relative paths are named with the directory
+static std::string imageBlobName(const ImageKey& key, const std::string& imageName)
+{
+	char cwd[PATH_MAX];
+	if ( (key.path[0] == '/') || (getcwd(cwd, sizeof(cwd)) == nullptr) )
+		return imageName;
+	return std::string(cwd) + "/" + imageName;
+}
+
+static const uint8_t* loadCachedImage(const std::string& imagePath, const ImageKey& key, uint64_t& imageSize)
+{
+	int fd = ::open(imagePath.c_str(), O_RDONLY, 0);
+	if ( fd == -1 )
+		return nullptr;
+	const uint8_t* image = nullptr;
+	struct stat statBuffer;
+	if ( (::fstat(fd, &statBuffer) == 0) && (statBuffer.st_size >= (off_t)sizeof(ImageHeader)) ) {
+		void* p = ::mmap(nullptr, statBuffer.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+		if ( p != MAP_FAILED ) {
+			if ( validImage((uint8_t*)p, statBuffer.st_size, key) ) {
+				image = (uint8_t*)p;
+				imageSize = statBuffer.st_size;
+			}
+			else {
+				::munmap(p, statBuffer.st_size);
+			}
+		}
+	}
+	::close(fd);
+	return image;
+}
+
+static void saveCachedImage(const std::string& imagePath, const std::vector<uint8_t>& image)
+{
+	// the next link parses the .tbd file again if the image can't be saved
+	ld::utils::writeFileAtomically(imagePath, 0600, true, [&image](int fd) {
+		return (ld::utils::write64(fd, image.data(), image.size()) == (ssize_t)image.size());
+	});
+}
+
+
 //
 // The reader for a dylib extracts all exported symbols names from the memory-mapped
 // dylib, builds a hash table, then unmaps the file.  This is an important memory
@@ -69,7 +368,7 @@ public:
 						 bool allowSimToMacOSX, bool addVers, bool buildingForSimulator,
 						 bool logAllFiles, const char* installPath, bool indirectDylib,
 					     bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning);
-	virtual			~File() noexcept {}
+	virtual			~File() noexcept;
 	
 	// overrides of generic::dylib::File
 	virtual void	processIndirectLibraries(ld::dylib::File::DylibHandler*, bool addImplicitDylibs) override final;
@@ -79,11 +378,18 @@ private:
 									 bool indirectDylib, bool linkingFlatNamespace, bool linkingMainExecutable,
 									 const char *path, const ld::VersionSet& platforms, const char *targetInstallPath,
 									 bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning);
+	void				init(const uint8_t* image, const Options *opts, bool buildingForSimulator,
+									 bool indirectDylib, bool linkingFlatNamespace, bool linkingMainExecutable,
+									 const char *path, const ld::VersionSet& platforms, const char *targetInstallPath,
+									 bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning);
 	void				buildExportHashTable(const tapi::LinkerInterfaceFile* file);
+	void				buildExportHashTable(const uint8_t* image);
 	static bool useSimulatorVariant();
 	
 	const Options* _opts;
 	tapi::LinkerInterfaceFile* _interface;
+	const uint8_t* _mappedImage;		// strings of the File point into it
+	uint64_t _mappedImageSize;
 };
 
 template <> bool File<x86>::useSimulatorVariant() { return true; }
@@ -99,7 +405,7 @@ File<A>::File(const char* path, const uint8_t* fileContent, uint64_t fileLength,
 		  bool buildingForSimulator, bool logAllFiles, const char* targetInstallPath,
 		  bool indirectDylib, bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning)
 : Base(strdup(path), mTime, ord, platforms, allowWeakImports, linkingFlatNamespace,
-	   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers)
+	   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers), _mappedImage(nullptr), _mappedImageSize(0)
 {
 #if (TAPI_API_VERSION_MAJOR >= 1)
 	if(!tapi::APIVersion::isAtLeast(1,6))
@@ -127,6 +433,41 @@ File<A>::File(const char* path, const uint8_t* fileContent, uint64_t fileLength,
 	if (!allowWeakImports)
 		flags |= tapi::ParsingFlags::DisallowWeakImports;
 
+	// use image of interface from a previous link if the .tbd file has not changed
+	const char* cacheDir = opts->tbdCachePath();
+	bool useImages = (cacheDir != nullptr) || ld::server::keepsBlobs();
+	ImageKey key = { path, 0, fileLength, cpuType, cpuSubType, (uint32_t)flags, linkMinOSVersion };
+	struct stat statBuffer;
+	if ( useImages && (::stat(path, &statBuffer) == 0) )
+		key.mTime = ld::utils::modTimeNanoseconds(statBuffer);
+	else
+		useImages = false;
+	std::string imageName;
+	if ( useImages ) {
+		imageName = cachedImageName(key);
+		uint64_t imageSize = 0;
+		const uint8_t* image = ld::server::findBlob(imageBlobName(key, imageName), imageSize);
+		if ( (image != nullptr) && !validImage(image, imageSize, key) )
+			image = nullptr;
+		if ( (image == nullptr) && (cacheDir != nullptr) ) {
+			image = loadCachedImage(std::string(cacheDir) + "/" + imageName, key, imageSize);
+			if ( image != nullptr ) {
+				_mappedImage = image;
+				_mappedImageSize = imageSize;
+				ld::server::keepBlob(imageBlobName(key, imageName), image, imageSize);
+			}
+		}
+		if ( image != nullptr ) {
+			_interface = nullptr;
+			munmap((void *)fileContent, fileLength);
+			if ( logAllFiles )
+				printf("%s\n", path);
+			init(image, opts, buildingForSimulator, indirectDylib, linkingFlatNamespace,
+				 linkingMainExecutable, path, platforms, targetInstallPath, usingBitcode, internalSDK, fromSDK, platformMismatchesAreWarning);
+			return;
+		}
+	}
+
 	_interface = tapi::LinkerInterfaceFile::create(
 		path, cpuType, cpuSubType, flags,
 		tapi::PackedVersion32(linkMinOSVersion), errorMessage);
@@ -143,6 +484,19 @@ File<A>::File(const char* path, const uint8_t* fileContent, uint64_t fileLength,
 
 	init(_interface, opts, buildingForSimulator, indirectDylib, linkingFlatNamespace,
 		 linkingMainExecutable, path, platforms, targetInstallPath, usingBitcode, internalSDK, fromSDK, platformMismatchesAreWarning);
+
+	// inlined frameworks are parsed from the interface later, so it has to come from libtapi every time
+	bool cacheable = useImages;
+#if ((TAPI_API_VERSION_MAJOR == 1 &&  TAPI_API_VERSION_MINOR >= 6) || (TAPI_API_VERSION_MAJOR > 1))
+	cacheable = cacheable && _interface->inlinedFrameworkNames().empty();
+#endif
+	if ( cacheable ) {
+		std::vector<uint8_t> image;
+		buildImage(_interface, key, image);
+		ld::server::keepBlob(imageBlobName(key, imageName), image.data(), image.size());
+		if ( cacheDir != nullptr )
+			saveCachedImage(std::string(cacheDir) + "/" + imageName, image);
+	}
 }
 
 	template<typename A>
@@ -155,11 +509,18 @@ File<A>::File(const char* path, const uint8_t* fileContent, uint64_t fileLength,
 				 bool logAllFiles, const char* installPath, bool indirectDylib,
 				 bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning)
 	: Base(strdup(path), mTime, ordinal, platforms, allowWeakImports, linkingFlatNamespace,
-		   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers), _interface(file)
+		   hoistImplicitPublicDylibs, allowSimToMacOSX, addVers), _interface(file), _mappedImage(nullptr), _mappedImageSize(0)
 {
 	init(_interface, opts, buildingForSimulator, indirectDylib, linkingFlatNamespace,
 		 linkingMainExecutable, path, platforms, installPath, usingBitcode, internalSDK, fromSDK, platformMismatchesAreWarning);
 }
+
+template <typename A>
+File<A>::~File() noexcept
+{
+	if ( _mappedImage != nullptr )
+		munmap((void *)_mappedImage, _mappedImageSize);
+}
 	
 template<typename A>
 void File<A>::init(tapi::LinkerInterfaceFile* file, const Options *opts, bool buildingForSimulator,
@@ -256,6 +617,106 @@ void File<A>::buildExportHashTable(const tapi::LinkerInterfaceFile* file) {
 	}
 }
 
+template<typename A>
+void File<A>::init(const uint8_t* image, const Options *opts, bool buildingForSimulator,
+				   bool indirectDylib, bool linkingFlatNamespace, bool linkingMainExecutable,
+				   const char *path, const ld::VersionSet& cmdLinePlatforms, const char *targetInstallPath,
+				   bool usingBitcode, bool internalSDK, bool fromSDK, bool platformMismatchesAreWarning) {
+	// images are never unmapped while the File is in use, so their strings are used in place
+	const ImageHeader* header = (const ImageHeader*)image;
+	_opts = opts;
+	this->_bitcode = std::unique_ptr<ld::Bitcode>(new ld::Bitcode(nullptr, 0));
+	this->_noRexports = (header->attributes & kImageHasReexports) == 0;
+	this->_hasWeakExports = (header->attributes & kImageHasWeakDefinedExports) != 0;
+	this->_dylibInstallPath = imageString(image, header->installName);
+	this->_installPathOverride = (header->attributes & kImageInstallNameVersionSpecific) != 0;
+	this->_dylibCurrentVersion = header->currentVersion;
+	this->_dylibCompatibilityVersion = header->compatibilityVersion;
+	this->_swiftVersion = header->swiftVersion;
+	this->_parentUmbrella = (header->parentUmbrella == 0) ? nullptr : imageString(image, header->parentUmbrella);
+	this->_appExtensionSafe = (header->attributes & kImageAppExtensionSafe) != 0;
+
+	// if framework, capture framework name
+	const char* lastSlash = strrchr(this->_dylibInstallPath, '/');
+	if ( lastSlash != NULL ) {
+		const char* leafName = lastSlash+1;
+		char frname[strlen(leafName)+32];
+		strcpy(frname, leafName);
+		strcat(frname, ".framework/");
+
+		if ( strstr(this->_dylibInstallPath, frname) != NULL )
+			this->_frameworkName = leafName;
+	}
+	
+	const uint32_t* allowableClients = imageList<uint32_t>(image, header->allowableClients);
+	for (uint32_t i=0; i < header->allowableClients.count; ++i)
+		this->_allowableClients.push_back(imageString(image, allowableClients[i]));
+	
+	// <rdar://problem/20659505> [TAPI] Don't hoist "public" (in /usr/lib/) dylibs that should not be directly linked
+	this->_hasPublicInstallName = (header->attributes & kImageHasAllowableClients) ? false : this->isPublicLocation(this->_dylibInstallPath);
+	
+	for (uint32_t i=0; i < header->allowableClients.count; ++i)
+		this->_allowableClients.emplace_back(imageString(image, allowableClients[i]));
+
+	const uint32_t* rpaths = imageList<uint32_t>(image, header->rpaths);
+	for (uint32_t i=0; i < header->rpaths.count; ++i)
+		this->_rpaths.emplace_back(imageString(image, rpaths[i]));
+
+	ld::VersionSet lcPlatforms;
+	const ImagePlatform* platforms = imageList<ImagePlatform>(image, header->platforms);
+	for (uint32_t i=0; i < header->platforms.count; ++i) {
+		if ( header->attributes & kImagePlatformsHaveMinOS )
+			lcPlatforms.insert(ld::PlatformVersion((ld::Platform)platforms[i].platform, platforms[i].minOS));
+		else
+			lcPlatforms.insert((ld::Platform)platforms[i].platform);
+	}
+
+	// check cross-linking
+	cmdLinePlatforms.checkDylibCrosslink(lcPlatforms, path, ".tbd", internalSDK, indirectDylib, usingBitcode, _isUnzipperedTwin, _dylibInstallPath, fromSDK, platformMismatchesAreWarning);
+
+	const uint32_t* reexports = imageList<uint32_t>(image, header->reexportedLibraries);
+	for (uint32_t i=0; i < header->reexportedLibraries.count; ++i) {
+		const char *path = imageString(image, reexports[i]);
+		if ( (targetInstallPath == nullptr) || (strcmp(targetInstallPath, path) != 0) )
+			this->_dependentDylibs.emplace_back(path, true);
+	}
+	
+	const uint32_t* ignoreExports = imageList<uint32_t>(image, header->ignoreExports);
+	for (uint32_t i=0; i < header->ignoreExports.count; ++i)
+		this->_ignoreExports.insert(imageString(image, ignoreExports[i]));
+	
+	// if linking flat and this is a flat dylib, create one atom that references all imported symbols.
+	if ( linkingFlatNamespace && linkingMainExecutable && ((header->attributes & kImageTwoLevelNamespace) == 0) ) {
+		std::vector<const char*> importNames;
+		importNames.reserve(header->undefineds.count);
+		// We do not need to strdup the name, because that will be done by the
+		// ImportAtom constructor.
+		const uint32_t* undefineds = imageList<uint32_t>(image, header->undefineds);
+		for (uint32_t i=0; i < header->undefineds.count; ++i)
+			importNames.emplace_back(imageString(image, undefineds[i]));
+		this->_importAtom = new generic::dylib::ImportAtom(*this, importNames);
+	}
+	
+	// build hash table
+	buildExportHashTable(image);
+}
+
+template <typename A>
+void File<A>::buildExportHashTable(const uint8_t* image) {
+	if (this->_s_logHashtable )
+		fprintf(stderr, "ld: building hashtable from text-stub info in %s\n", this->path());
+
+	const ImageHeader* header = (const ImageHeader*)image;
+	const ImageExport* exports = imageList<ImageExport>(image, header->exports);
+	this->reservedSymbolSpace(header->exports.count);
+	for (uint32_t i=0; i < header->exports.count; ++i) {
+		const char* name = imageString(image, exports[i].name);
+		bool weakDef = (exports[i].flags & kImageExportWeakDef) != 0;
+		bool tlv = (exports[i].flags & kImageExportThreadLocal) != 0;
+		addExportedSymbol(name, weakDef, tlv, 0, false);
+	}
+}
+
 template <typename A>
 void File<A>::processIndirectLibraries(ld::dylib::File::DylibHandler* handler, bool addImplicitDylibs) {
 	if (_interface)
@@ -28,14 +28,16 @@
 #include <unistd.h>
 #include <dlfcn.h>
 #include <mach/machine.h>
-#include <dispatch/dispatch.h>
 
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <atomic>
 #include <unordered_map>
 
 #include "ld.hpp"
+#include "Containers.h"
+#include "TaskPool.h"
 #include "code_dedup.h"
 
 namespace ld {
@@ -74,23 +76,32 @@ private:
 
 
 namespace {
-    typedef std::unordered_map<const ld::Atom*, unsigned long> CachedHashes;
-
-    ld::Internal*   sState = nullptr;
-    CachedHashes    sSavedHashes;
-    unsigned long   sHashCount = 0;
-    unsigned long   sFixupCompareCount = 0;
+    // hashes of the candidate functions are computed up front, so lookups during comparisons are read only
+    typedef ld::Map<const ld::Atom*, unsigned long> CachedHashes;
+    typedef std::unordered_map<const ld::Atom*, const ld::Atom*> ReplacementMap;
+
+    ld::Internal*               sState = nullptr;
+    CachedHashes                sSavedHashes;
+    ld::Map<const ld::Atom*, const ld::Atom*> sMasterOf;	// atoms folded so far, to the atom they were folded into
+    std::atomic<unsigned long>  sHashCount(0);
+    std::atomic<unsigned long>  sFixupCompareCount(0);
+    unsigned long               sCandidateCount = 0;
+    unsigned long               sBucketCount = 0;
+    uint64_t                    sDataBytesSaved = 0;
 };
 
 
-// A helper for std::unordered_map<> that hashes the instructions of a function
+// Hashes the instructions of a function and the names of what it references
 struct atom_hashing {
 
     static unsigned long hash(const ld::Atom* atom) {
         auto pos = sSavedHashes.find(atom);
         if ( pos != sSavedHashes.end() )
             return pos->second;
+        return compute(atom);
+    }
 
+    static unsigned long compute(const ld::Atom* atom) {
         const unsigned instructionBytes = atom->size();
         const uint8_t*	instructions = atom->rawContentPointer();
         unsigned long hash = instructionBytes;
@@ -129,18 +140,13 @@ struct atom_hashing {
                     hash = (hash * 33) + *s;
             }
         }
-        ++sHashCount;
-        sSavedHashes[atom] = hash;
+        sHashCount.fetch_add(1, std::memory_order_relaxed);
         return hash;
     }
-
-    unsigned long operator()(const ld::Atom* atom) const {
-        return hash(atom);
-    }
 };
 
 
-// A helper for std::unordered_map<> that compares functions
+// Compares functions, following calls into functions that may de-dup together
 struct atom_equal {
 
     struct BackChain {
@@ -158,7 +164,7 @@ struct atom_equal {
     };
 
     static bool sameFixups(const ld::Atom* atom1, const ld::Atom* atom2, BackChain& backChain) {
-        ++sFixupCompareCount;
+        sFixupCompareCount.fetch_add(1, std::memory_order_relaxed);
         //fprintf(stderr, "sameFixups(%s,%s)\n", atom1->name(), atom2->name());
         Fixup::iterator	f1   = atom1->fixupsBegin();
         Fixup::iterator	end1 = atom1->fixupsEnd();
@@ -242,7 +248,7 @@ struct atom_equal {
         return result;
     }
 
-    bool operator()(const ld::Atom* atom1, const ld::Atom* atom2) const {
+    static bool equal(const ld::Atom* atom1, const ld::Atom* atom2) {
         BackChain backChain = { NULL, atom1, atom2 };
         return equal(atom1, atom2, backChain);
     }
@@ -250,23 +256,208 @@ struct atom_equal {
 
 
 
-void doPass(const Options& opts, ld::Internal& state)
+// Compares read-only data atoms, references must go to the same atom once earlier folding is taken into account
+struct data_equal {
+
+    static const ld::Atom* target(const ld::Fixup* fit) {
+        const ld::Atom* result = NULL;
+        switch ( fit->binding ) {
+            case ld::Fixup::bindingDirectlyBound:
+                result = fit->u.target;
+                break;
+            case ld::Fixup::bindingsIndirectlyBound:
+                result = sState->indirectBindingTable[fit->u.bindingIndex];
+                break;
+            default:
+                return NULL;
+        }
+        for (auto pos = sMasterOf.find(result); pos != sMasterOf.end(); pos = sMasterOf.find(result))
+            result = pos->second;
+        return result;
+    }
+
+    static bool foldable(const ld::Atom* atom) {
+        if ( (atom->size() == 0) || !atom->autoHide() || (atom->definition() != ld::Atom::definitionRegular) )
+            return false;
+        if ( atom->rawContentPointer() == NULL )
+            return false;
+        for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+            switch ( fit->binding ) {
+                case ld::Fixup::bindingNone:
+                case ld::Fixup::bindingDirectlyBound:
+                case ld::Fixup::bindingsIndirectlyBound:
+                    break;
+                default:
+                    return false;
+            }
+            switch ( fit->kind ) {
+                case ld::Fixup::kindNoneFollowOn:
+                case ld::Fixup::kindNoneGroupSubordinate:
+                case ld::Fixup::kindNoneGroupSubordinateFDE:
+                case ld::Fixup::kindNoneGroupSubordinateLSDA:
+                case ld::Fixup::kindNoneGroupSubordinatePersonality:
+                    return false;
+                default:
+                    break;
+            }
+        }
+        return true;
+    }
+
+    static unsigned long hash(const ld::Atom* atom) {
+        const unsigned bytes = atom->size();
+        const uint8_t* content = atom->rawContentPointer();
+        unsigned long hash = bytes;
+        for (unsigned i=0; i < bytes; ++i)
+            hash = (hash * 33) + content[i];
+        for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+            hash = (hash * 33) + fit->offsetInAtom;
+            hash = (hash * 33) + fit->kind;
+            hash = (hash * 33) + (uintptr_t)target(fit);
+        }
+        sHashCount.fetch_add(1, std::memory_order_relaxed);
+        return hash;
+    }
+
+    static bool equal(const ld::Atom* atom1, const ld::Atom* atom2) {
+        if ( atom1->size() != atom2->size() )
+            return false;
+        if ( (atom1->alignment().powerOf2 != atom2->alignment().powerOf2) || (atom1->alignment().modulus != atom2->alignment().modulus) )
+            return false;
+        if ( memcmp(atom1->rawContentPointer(), atom2->rawContentPointer(), atom1->size()) != 0 )
+            return false;
+        sFixupCompareCount.fetch_add(1, std::memory_order_relaxed);
+        Fixup::iterator	f1   = atom1->fixupsBegin();
+        Fixup::iterator	end1 = atom1->fixupsEnd();
+        Fixup::iterator	f2   = atom2->fixupsBegin();
+        Fixup::iterator	end2 = atom2->fixupsEnd();
+        if ( (end1 - f1) != (end2 - f2) )
+            return false;
+        for ( ; f1 != end1; ++f1, ++f2) {
+            if ( (f1->offsetInAtom != f2->offsetInAtom) || (f1->kind != f2->kind) || (f1->clusterSize != f2->clusterSize) )
+                return false;
+            if ( (f1->binding != f2->binding) || (f1->weakImport != f2->weakImport) )
+                return false;
+            if ( (f1->contentAddendOnly != f2->contentAddendOnly) || (f1->contentDetlaToAddendOnly != f2->contentDetlaToAddendOnly)
+              || (f1->contentIgnoresAddend != f2->contentIgnoresAddend) )
+                return false;
+            if ( f1->binding == ld::Fixup::bindingNone ) {
+                if ( f1->u.addend != f2->u.addend )
+                    return false;
+            }
+            else if ( target(f1) != target(f2) ) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+
+// Groups candidates into sets of duplicates.  Candidates are hashed in parallel, then only candidates
+// with the same hash are compared, each bucket in parallel.  Each candidate joins the first set whose
+// first atom it is equal to.  Returned sets have at least two atoms, and are in candidate order
+// of their first atom, which is the atom that is kept.
+template <typename H, typename E>
+static void findDuplicates(const std::vector<const ld::Atom*>& candidates, H hasher, E equals,
+                           std::vector<std::vector<const ld::Atom*>>& duplicates)
 {
-	const bool log = false;
-	
-    // only de-duplicate in final linked images
-    if ( opts.outputKind() == Options::kObjectFile )
-        return;
+    std::vector<unsigned long> hashes(candidates.size());
+    unsigned long* hashesPtr = hashes.data();
+    const ld::Atom* const* candidatesPtr = candidates.data();
+    ld::parallelFor(candidates.size(), ^(size_t index) {
+        hashesPtr[index] = hasher(candidatesPtr[index]);
+    });
 
-	  // only de-duplicate for architectures that use relocations that don't store bits in instructions
-    if ( (opts.architecture() != CPU_TYPE_ARM64) && (opts.architecture() != CPU_TYPE_X86_64) )
-        return;
+    // only atoms with the same hash can be equal, so group them into buckets
+    // in each bucket atoms stay in candidate order, so the first one of a set of duplicates is kept
+    std::vector<uint32_t> order(candidates.size());
+    for (uint32_t i=0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t left, uint32_t right) {
+        if ( hashes[left] != hashes[right] )
+            return (hashes[left] < hashes[right]);
+        return (left < right);
+    });
+    std::vector<std::pair<uint32_t, uint32_t>> buckets;	// range in order[] of buckets with more than one atom
+    for (size_t start=0, end; start < order.size(); start = end) {
+        for (end=start+1; (end < order.size()) && (hashes[order[end]] == hashes[order[start]]); ++end)
+            ;
+        if ( end - start > 1 )
+            buckets.push_back(std::make_pair((uint32_t)start, (uint32_t)(end - start)));
+    }
+    sBucketCount += buckets.size();
+
+    // compare the atoms in each bucket, all buckets in parallel
+    std::vector<std::vector<std::vector<uint32_t>>> bucketSets(buckets.size());
+    std::vector<std::vector<uint32_t>>* bucketSetsPtr = bucketSets.data();
+    const std::pair<uint32_t, uint32_t>* bucketsPtr = buckets.data();
+    const uint32_t* orderPtr = order.data();
+    ld::parallelFor(buckets.size(), ^(size_t index) {
+        std::vector<std::vector<uint32_t>>& sets = bucketSetsPtr[index];
+        for (uint32_t i=0; i < bucketsPtr[index].second; ++i) {
+            uint32_t candidate = orderPtr[bucketsPtr[index].first + i];
+            bool found = false;
+            for (std::vector<uint32_t>& set : sets) {
+                if ( equals(candidatesPtr[set.front()], candidatesPtr[candidate]) ) {
+                    set.push_back(candidate);
+                    found = true;
+                    break;
+                }
+            }
+            if ( !found )
+                sets.push_back(std::vector<uint32_t>(1, candidate));
+        }
+    });
 
-    // support -no_deduplicate to suppress this pass
-    if ( ! opts.deduplicateFunctions() )
-        return;
+    std::vector<const std::vector<uint32_t>*> sets;
+    for (const std::vector<std::vector<uint32_t>>& setsInBucket : bucketSets) {
+        for (const std::vector<uint32_t>& set : setsInBucket) {
+            if ( set.size() > 1 )
+                sets.push_back(&set);
+        }
+    }
+    std::sort(sets.begin(), sets.end(), [](const std::vector<uint32_t>* left, const std::vector<uint32_t>* right) {
+        return (left->front() < right->front());
+    });
+    for (const std::vector<uint32_t>* set : sets) {
+        duplicates.emplace_back();
+        for (uint32_t index : *set)
+            duplicates.back().push_back(candidates[index]);
+    }
+}
 
-    const bool verbose = opts.verboseDeduplicate();
+
+// Replaces all but the first atom of each set with an alias to the first atom
+static uint64_t replaceDuplicates(const std::vector<std::vector<const ld::Atom*>>& duplicates, std::vector<const ld::Atom*>& sectionAtoms,
+                                  const char* kindName, bool verbose, ReplacementMap& replacementMap)
+{
+    uint64_t savings = 0;
+    for (const std::vector<const ld::Atom*>& dups : duplicates) {
+        const ld::Atom* masterAtom = dups.front();
+        savings += ((dups.size() - 1) * masterAtom->size());
+        if ( verbose )
+            fprintf(stderr, "deduplicate the following %lu %s (%llu bytes apiece):\n", dups.size(), kindName, masterAtom->size());
+
+        for (const ld::Atom* dupAtom : dups) {
+            if ( verbose )
+                fprintf(stderr, "    %s\n", dupAtom->name());
+            if ( dupAtom == masterAtom )
+                continue;
+            const ld::Atom* aliasAtom = new DeDupAliasAtom(dupAtom, masterAtom);
+            sectionAtoms.push_back(aliasAtom);
+            replacementMap[dupAtom] = aliasAtom;
+            sMasterOf[dupAtom] = masterAtom;
+            (const_cast<ld::Atom*>(dupAtom))->setCoalescedAway();
+        }
+    }
+    return savings;
+}
+
+
+static void deduplicateFunctions(ld::Internal& state, bool verbose, ReplacementMap& replacementMap)
+{
+	const bool log = false;
 
     // find __text section
     ld::Internal::FinalSection* textSection = NULL;
@@ -279,64 +470,209 @@ void doPass(const Options& opts, ld::Internal& state)
     if ( textSection == NULL )
         return;
 
-    // build map of auto-hide functions and their duplicates
-    // the key for the map is always the first element in the value vector
-    // the key is always earlier in the atoms list then matching other atoms
-    sState = &state;
-    std::unordered_map<const ld::Atom*, std::vector<const ld::Atom*>, atom_hashing, atom_equal> map;
-    std::unordered_set<const ld::Atom*> masterAtoms;
+    // hash all auto-hide functions in parallel
+    std::vector<const ld::Atom*> candidates;
     for (const ld::Atom* atom : textSection->atoms) {
         // ignore empty (alias) atoms
         if ( atom->size() == 0 )
             continue;
         if ( atom->autoHide() )
-            map[atom].push_back(atom);
-	  }
+            candidates.push_back(atom);
+    }
+    sCandidateCount += candidates.size();
+    std::vector<unsigned long> hashes(candidates.size());
+    unsigned long* hashesPtr = hashes.data();
+    const ld::Atom** candidatesPtr = candidates.data();
+    ld::parallelFor(candidates.size(), ^(size_t index) {
+        hashesPtr[index] = atom_hashing::compute(candidatesPtr[index]);
+    });
+    sSavedHashes.reserve(candidates.size());
+    for (size_t i=0; i < candidates.size(); ++i)
+        sSavedHashes[candidates[i]] = hashes[i];
+
+    // build list of auto-hide functions and their duplicates
+    // the first element in each vector is always earlier in the atoms list then matching other atoms
+    std::vector<std::vector<const ld::Atom*>> duplicates;
+    findDuplicates(candidates, [](const ld::Atom* atom) { return atom_hashing::hash(atom); },
+                   [](const ld::Atom* atom1, const ld::Atom* atom2) { return atom_equal::equal(atom1, atom2); }, duplicates);
 
     if ( log ) {
-        for (auto& entry : map) {
-            if ( entry.second.size() > 1 ) {
-                printf("Found following matching functions:\n");
-                for (const ld::Atom* atom : entry.second) {
-                    printf("  %p %s\n", atom, atom->name());
-                }
+        for (const std::vector<const ld::Atom*>& dups : duplicates) {
+            printf("Found following matching functions:\n");
+            for (const ld::Atom* atom : dups) {
+                printf("  %p %s\n", atom, atom->name());
             }
         }
         fprintf(stderr, "duplicate sets count:\n");
-        for (auto& entry : map)
-            fprintf(stderr, "  %p -> %lu\n", entry.first, entry.second.size());
+        for (const std::vector<const ld::Atom*>& dups : duplicates)
+            fprintf(stderr, "  %p -> %lu\n", dups.front(), dups.size());
     }
 
     // construct alias atoms to replace atoms found to be duplicates
-    unsigned atomsBeingComparedCount = 0;
-    uint64_t dedupSavings = 0;
-    std::vector<const ld::Atom*>& textAtoms = textSection->atoms;
-    std::unordered_map<const ld::Atom*, const ld::Atom*> replacementMap;
-    for (auto& entry : map) {
-        const ld::Atom* masterAtom = entry.first;
-        std::vector<const ld::Atom*>& dups = entry.second;
-        atomsBeingComparedCount += dups.size();
-        if ( dups.size() == 1 )
-            continue;
-        if ( verbose )  {
-            dedupSavings += ((dups.size() - 1) * masterAtom->size());
-            fprintf(stderr, "deduplicate the following %lu functions (%llu bytes apiece):\n", dups.size(), masterAtom->size());
-        }
+    uint64_t dedupSavings = replaceDuplicates(duplicates, textSection->atoms, "functions", verbose, replacementMap);
+    if ( verbose )  {
+        fprintf(stderr, "deduplication saved %llu bytes of __text\n", dedupSavings);
+    }
+    sSavedHashes.clear();
+}
 
-        for (const ld::Atom* dupAtom : dups) {
-            if ( verbose )
-                fprintf(stderr, "    %s\n", dupAtom->name());
-            if ( dupAtom == masterAtom )
-                continue;
-            const ld::Atom* aliasAtom = new DeDupAliasAtom(dupAtom, masterAtom);
-            textAtoms.push_back(aliasAtom);
-            replacementMap[dupAtom] = aliasAtom;
-            (const_cast<ld::Atom*>(dupAtom))->setCoalescedAway();
+
+static bool isConstDataSection(const ld::Internal::FinalSection* sect)
+{
+    if ( sect->type() != ld::Section::typeUnclassified )
+        return false;
+    if ( strcmp(sect->sectionName(), "__const") != 0 )
+        return false;
+    return ( (strcmp(sect->segmentName(), "__TEXT") == 0) || (strcmp(sect->segmentName(), "__DATA_CONST") == 0)
+          || (strcmp(sect->segmentName(), "__DATA") == 0) );
+}
+
+
+// True if the fixup that ends a cluster is in an instruction that only reads the target's content:
+// an x86_64 instruction with a RIP relative memory operand other than LEA, or an arm64 load through
+// an ADRP page.  Anything else, like storing the address as a pointer, loading it from the GOT, or
+// computing it with LEA or ADD, makes the address significant.
+static bool loadsContentOnly(const ld::Atom* atom, const ld::Fixup* fit)
+{
+    const uint8_t* content = atom->rawContentPointer();
+    if ( content == NULL )
+        return false;
+    const uint8_t* fixUpLocation = content + fit->offsetInAtom;
+    switch ( fit->kind ) {
+        case ld::Fixup::kindStoreX86PCRel32:
+        case ld::Fixup::kindStoreX86PCRel32_1:
+        case ld::Fixup::kindStoreX86PCRel32_2:
+        case ld::Fixup::kindStoreX86PCRel32_4:
+        case ld::Fixup::kindStoreTargetAddressX86PCRel32:
+            // the ModRM byte in front of the displacement selects RIP relative addressing, and the opcode in front of it is not LEA
+            if ( fit->offsetInAtom < 2 )
+                return false;
+            return ( ((fixUpLocation[-1] & 0xC7) == 0x05) && (fixUpLocation[-2] != 0x8D) );
+        case ld::Fixup::kindStoreARM64Page21:
+        case ld::Fixup::kindStoreTargetAddressARM64Page21:
+            // ADRP only forms the page, the instruction with the page offset decides how the address is used
+            return true;
+        case ld::Fixup::kindStoreARM64PageOff12:
+        case ld::Fixup::kindStoreTargetAddressARM64PageOff12:
+            // LDR has bit 27 set, ADD does not
+            return ( (*((uint32_t*)fixUpLocation) & 0x08000000) != 0 );
+        default:
+            return false;
+    }
+}
+
+// Finds the atoms that must keep their own address, which are the targets of every fixup cluster
+// that does more than load the target's content.
+static void findPinnedAtoms(ld::Internal& state, ld::Set<const ld::Atom*>& pinned)
+{
+    for (ld::Internal::FinalSection* sect : state.sections) {
+        for (const ld::Atom* atom : sect->atoms) {
+            ld::Fixup::iterator clusterStart = atom->fixupsBegin();
+            bool contentOnly = true;
+            for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
+                if ( fit->firstInCluster() ) {
+                    clusterStart = fit;
+                    contentOnly = true;
+                }
+                if ( !fit->lastInCluster() ) {
+                    // only the target and an addend may lead up to the load
+                    if ( (fit->kind != ld::Fixup::kindSetTargetAddress) && (fit->kind != ld::Fixup::kindAddAddend) )
+                        contentOnly = false;
+                    continue;
+                }
+                if ( contentOnly && loadsContentOnly(atom, fit) )
+                    continue;
+                for (ld::Fixup::iterator cit = clusterStart; cit != fit+1; ++cit) {
+                    switch ( cit->binding ) {
+                        case ld::Fixup::bindingDirectlyBound:
+                            pinned.insert(cit->u.target);
+                            break;
+                        case ld::Fixup::bindingsIndirectlyBound:
+                            pinned.insert(state.indirectBindingTable[cit->u.bindingIndex]);
+                            break;
+                        default:
+                            break;
+                    }
+                }
+            }
         }
     }
-    if ( verbose )  {
-        fprintf(stderr, "deduplication saved %llu bytes of __text\n", dedupSavings);
+}
+
+
+// Folds identical auto-hide atoms in __const sections.  Auto-hide (weak_def_can_be_hidden) only says
+// no other image can see the symbol, so an atom is also kept when anything in the link does more
+// than load its content, like storing its address as a pointer or comparing addresses.
+static void deduplicateData(ld::Internal& state, bool verbose, ReplacementMap& replacementMap)
+{
+    ld::Set<const ld::Atom*> pinned;
+    findPinnedAtoms(state, pinned);
+
+    for (ld::Internal::FinalSection* sect : state.sections) {
+        if ( !isConstDataSection(sect) )
+            continue;
+
+        std::vector<const ld::Atom*> candidates;
+        for (const ld::Atom* atom : sect->atoms) {
+            if ( data_equal::foldable(atom) && (pinned.count(atom) == 0) )
+                candidates.push_back(atom);
+        }
+        sCandidateCount += candidates.size();
+
+        // references to other folded atoms may make more atoms equal, so repeat until nothing folds
+        uint64_t sectionSavings = 0;
+        while ( candidates.size() > 1 ) {
+            std::vector<std::vector<const ld::Atom*>> duplicates;
+            findDuplicates(candidates, [](const ld::Atom* atom) { return data_equal::hash(atom); },
+                           [](const ld::Atom* atom1, const ld::Atom* atom2) { return data_equal::equal(atom1, atom2); }, duplicates);
+            if ( duplicates.empty() )
+                break;
+            sectionSavings += replaceDuplicates(duplicates, sect->atoms, "constants", verbose, replacementMap);
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](const ld::Atom* atom) {
+                                return (replacementMap.count(atom) != 0);
+                             }), candidates.end());
+        }
+        sDataBytesSaved += sectionSavings;
+        if ( verbose && (sectionSavings != 0) )
+            fprintf(stderr, "deduplication saved %llu bytes of %s,%s\n", sectionSavings, sect->segmentName(), sect->sectionName());
     }
+}
+
+
+void doPass(const Options& opts, ld::Internal& state)
+{
+	const bool log = false;
+	
+    // only de-duplicate in final linked images
+    if ( opts.outputKind() == Options::kObjectFile )
+        return;
+
+	  // only de-duplicate for architectures that use relocations that don't store bits in instructions
+    if ( (opts.architecture() != CPU_TYPE_ARM64) && (opts.architecture() != CPU_TYPE_X86_64) )
+        return;
+
+    // support -no_deduplicate to suppress this pass
+    if ( ! opts.deduplicateFunctions() )
+        return;
+
+    const bool verbose = opts.verboseDeduplicate();
+
+    sState = &state;
+    sHashCount = 0;
+    sFixupCompareCount = 0;
+    sCandidateCount = 0;
+    sBucketCount = 0;
+    sDataBytesSaved = 0;
+    ReplacementMap replacementMap;
+    deduplicateFunctions(state, verbose, replacementMap);
+
+    // support -deduplicate_data to also fold read-only constants
+    if ( opts.deduplicateData() )
+        deduplicateData(state, verbose, replacementMap);
+
+    sMasterOf.clear();
+    if ( replacementMap.empty() )
+        return;
 
     if ( log ) {
         fprintf(stderr, "replacement map:\n");
@@ -346,10 +682,10 @@ void doPass(const Options& opts, ld::Internal& state)
 
     // walk all atoms and replace references to dups with references to alias
     // the replacement map is now read only so this can be done concurrently for all sections
-    dispatch_apply(state.sections.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
+    ld::parallelFor(state.sections.size(), ^(size_t index) {
         for (const ld::Atom* atom : state.sections[index]->atoms) {
             for (ld::Fixup::iterator fit = atom->fixupsBegin(), end=atom->fixupsEnd(); fit != end; ++fit) {
-                std::unordered_map<const ld::Atom*, const ld::Atom*>::const_iterator pos;
+                ReplacementMap::const_iterator pos;
                 switch ( fit->binding ) {
                     case ld::Fixup::bindingsIndirectlyBound:
                         pos = replacementMap.find(state.indirectBindingTable[fit->u.bindingIndex]);
@@ -368,25 +704,24 @@ void doPass(const Options& opts, ld::Internal& state)
         }
     });
 
-    if ( log ) {
-        fprintf(stderr, "atoms before pruning:\n");
-        for (const ld::Atom* atom : textSection->atoms)
-            fprintf(stderr, "  %p (size=%llu) %s\n", atom, atom->size(), atom->name());
-    }
-    // remove replaced atoms from section
-    textSection->atoms.erase(std::remove_if(textSection->atoms.begin(), textSection->atoms.end(),
-                [&](const ld::Atom* atom) {
-                    return (replacementMap.count(atom) != 0);
-                }),
-                textSection->atoms.end());
+    // remove replaced atoms from sections
+    ld::parallelFor(state.sections.size(), ^(size_t index) {
+        std::vector<const ld::Atom*>& atoms = state.sections[index]->atoms;
+        atoms.erase(std::remove_if(atoms.begin(), atoms.end(), [&](const ld::Atom* atom) {
+                        return (replacementMap.count(atom) != 0);
+                    }),
+                    atoms.end());
+    });
+}
 
-    if ( log ) {
-        fprintf(stderr, "atoms after pruning:\n");
-        for (const ld::Atom* atom : textSection->atoms)
-            fprintf(stderr, "  %p (size=%llu) %s\n", atom, atom->size(), atom->name());
-    }
 
-   //fprintf(stderr, "hash-count=%lu, fixup-compares=%lu, atom-count=%u\n", sHashCount, sFixupCompareCount, atomsBeingComparedCount);
+void getStatistics(Statistics& stats)
+{
+    stats.functionsHashed = sHashCount.load();
+    stats.candidates      = sCandidateCount;
+    stats.buckets         = sBucketCount;
+    stats.fixupCompares   = sFixupCompareCount.load();
+    stats.dataBytesSaved  = sDataBytesSaved;
 }
 
 
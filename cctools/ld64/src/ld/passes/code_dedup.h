@@ -37,6 +37,16 @@ namespace dedup {
 // called by linker to merge duplicate functions
 extern void doPass(const Options& opts, ld::Internal& internal);
 
+// for -print_statistics
+struct Statistics {
+	uint64_t	functionsHashed;
+	uint64_t	candidates;
+	uint64_t	buckets;
+	uint64_t	fixupCompares;
+	uint64_t	dataBytesSaved;
+};
+extern void getStatistics(Statistics& stats);
+
 
 } // namespace huge
 } // namespace passes 
@@ -27,7 +27,6 @@
 #include <math.h>
 #include <unistd.h>
 #include <mach/machine.h>
-#include <dispatch/dispatch.h>
 
 #include <algorithm>
 #include <vector>
@@ -37,6 +36,7 @@
 #include <span>
 
 #include "ld.hpp"
+#include "TaskPool.h"
 #include "order.h"
 
 namespace ld {
@@ -655,7 +655,7 @@ void Layout::doPass()
 	this->buildOrdinalOverrideMap();
 
 	// sort atoms in each section
-	dispatch_apply(_state.sections.size(), DISPATCH_APPLY_AUTO, ^(size_t index) {
+	ld::parallelFor(_state.sections.size(), ^(size_t index) {
 		ld::Internal::FinalSection* sect = _state.sections[index];
 
 		bool needsSort = true;
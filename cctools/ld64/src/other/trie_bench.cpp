@@ -0,0 +1,112 @@
+/* -*- mode: C++; c-basic-offset: 4; tab-width: 4 -*- 
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ * 
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ * 
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ * 
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+//
+// export lookup micro benchmark, decoding the whole trie into a table (-no_lazy_dylib_exports)
+// against finding each symbol in the trie.  Not part of the build:
+//   c++ -O2 -D__LITTLE_ENDIAN__=1 -DHAVE_BCOPY=1 -DHAVE_BCMP=1 -DHAVE_BZERO=1 -DHAVE_INDEX=1 -DHAVE_RINDEX=1 \
+//       -I../abstraction -I../3rd -I../../../include -I../../../include/foreign -o trie_bench trie_bench.cpp && ./trie_bench [exports]
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <unordered_map>
+
+#include "MachOTrie.hpp"
+static double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, const char* argv[])
+{
+	const unsigned exportCount = (argc > 1) ? atoi(argv[1]) : 100000;
+	const unsigned lookupCounts[] = { 10, 100, 1000, 10000 };
+	const unsigned rounds = 20;
+
+	// names shaped like a framework: shared prefixes per class, varied method names
+	std::vector<std::string> names;
+	for (unsigned i=0; i < exportCount; ++i) {
+		char name[128];
+		snprintf(name, sizeof(name), "__ZN4Core%04u5Class%03uE%uMethod%ub", i % 977, i % 313, i, (i * 2654435761u) % 10007);
+		names.push_back(name);
+	}
+	std::vector<mach_o::trie::Entry> entries;
+	for (unsigned i=0; i < exportCount; ++i) {
+		mach_o::trie::Entry entry;
+		entry.name = names[i].c_str();
+		entry.flags = 0;
+		entry.address = 0x1000 + i*16;
+		entry.other = 0;
+		entry.importName = NULL;
+		entries.push_back(entry);
+	}
+	std::vector<uint8_t> trie;
+	mach_o::trie::makeTrie(entries, trie);
+	const uint8_t* start = &trie[0];
+	const uint8_t* end = start + trie.size();
+	printf("%u exports, trie %lu bytes\n", exportCount, (unsigned long)trie.size());
+
+	for (unsigned lookups : lookupCounts) {
+		if ( lookups > exportCount )
+			break;
+		// the symbols a link uses, spread over the dylib
+		std::vector<const char*> wanted;
+		for (unsigned i=0; i < lookups; ++i)
+			wanted.push_back(names[((uint64_t)i * 7919) % exportCount].c_str());
+
+		uint64_t eagerSum = 0;
+		double eagerStart = now();
+		for (unsigned r=0; r < rounds; ++r) {
+			std::vector<mach_o::trie::Entry> all;
+			mach_o::trie::parseTrie(start, end, all);
+			std::unordered_map<std::string, uint64_t> table;
+			table.reserve(all.size());
+			for (const mach_o::trie::Entry& e : all)
+				table[e.name] = e.address;
+			for (const char* name : wanted)
+				eagerSum += table[name];
+			for (const mach_o::trie::Entry& e : all)
+				free((void*)e.name);
+		}
+		double eager = (now() - eagerStart) / rounds;
+
+		uint64_t lazySum = 0;
+		double lazyStart = now();
+		for (unsigned r=0; r < rounds; ++r) {
+			for (const char* name : wanted) {
+				mach_o::trie::Entry e;
+				if ( mach_o::trie::findTrieEntry(start, end, name, e) )
+					lazySum += e.address;
+			}
+		}
+		double lazy = (now() - lazyStart) / rounds;
+
+		if ( eagerSum != lazySum )
+			printf("lookups differ\n");
+		printf("%6u lookups: eager %9.3f ms  lazy %9.3f ms  (%.1fx)\n", lookups, eager*1000, lazy*1000, eager/lazy);
+	}
+	return 0;
+}